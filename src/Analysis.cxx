@@ -69,6 +69,20 @@ void Cell::removeObservation(short time)
     }
 }
 
+std::auto_ptr<CellObservation> Cell::releaseObservation(short time)
+{
+    std::auto_ptr<CellObservation> observation;
+
+    ObservationMap::iterator observationMapIt = observationMap_.find(time);
+    if (observationMapIt != observationMap_.end())
+    {
+        observation.reset((*observationMapIt).second);
+        observationMap_.erase(observationMapIt);
+    }
+
+    return observation;
+}
+
 CellObservation* Cell::getObservation(short time)
 {
     Cell::ObservationMap::iterator it = observationMap_.find(time);
@@ -162,6 +176,23 @@ void Analysis::addImageSeries(const ImageSeries& imageSeries)
     }
 }
 
+void Analysis::extendImageSeries(const ImageSeries& imageSeries)
+{
+    ImageSeriesMap::iterator it = imageSeriesMap_.find(imageSeries.location);
+    if (it == imageSeriesMap_.end())
+    {
+        throw NoSuchElementException("no such image series");
+    }
+
+    ImageSeries::TimeRange& timeRange = (*it).second.timeRange;
+    if (imageSeries.timeRange.min != timeRange.min || imageSeries.timeRange.max < timeRange.max)
+    {
+        throw InvalidArgumentException("time range does not extend the one of the image series");
+    }
+
+    timeRange.max = imageSeries.timeRange.max;
+}
+
 void Analysis::addCell(std::auto_ptr<Cell> cell)
 {
     std::pair<int, Cell*> p(cell->getId(), cell.get());
@@ -231,6 +262,42 @@ std::auto_ptr<CellSelection> Analysis::selectCellsInImage(const ImageKey& imageK
     return cellSet;
 }
 
+void Analysis::moveAnalysis(Analysis& analysis, int cellIdOffset)
+{
+    // copy image series
+    {
+        ImageSeriesMap::const_iterator it = analysis.imageSeriesMap_.begin();
+        ImageSeriesMap::const_iterator end = analysis.imageSeriesMap_.end();
+        for (; it != end; ++it)
+        {
+            addImageSeries((*it).second);
+        }
+    }
+
+    // move cells
+    {
+        CellMap::iterator it = analysis.cellMap_.begin();
+        CellMap::iterator end = analysis.cellMap_.end();
+        for (; it != end; ++it)
+        {
+            Cell* sourceCell = (*it).second;
+
+            std::auto_ptr<Cell> cell(
+                new Cell(sourceCell->getId() + cellIdOffset, sourceCell->getLocation()));
+            while (sourceCell->getNumberOfObservations() > 0)
+            {
+                short time = (*sourceCell->getObservationStart())->getTime();
+                cell->addObservation(sourceCell->releaseObservation(time));
+            }
+            addCell(cell);
+
+            delete sourceCell;
+            (*it).second = 0;
+        }
+        analysis.cellMap_.clear();
+    }
+}
+
 std::auto_ptr<CellSelection> Analysis::invertCellSelection(CellSelection* cellSelection)
 {
     assert(cellSelection != 0);
@@ -154,6 +154,12 @@ public:
     void addObservation(std::auto_ptr<CellObservation> observation);
 
     void removeObservation(short time);
+
+    /**
+     * Removes the observation from the cell without deleting it.  A null
+     * pointer is returned if there is no observation at the given time.
+     */
+    std::auto_ptr<CellObservation> releaseObservation(short time);
     
     CellObservation* getObservation(short time);
 
@@ -281,6 +287,13 @@ public:
 
     void addImageSeries(const ImageSeries& imageSeries);
 
+    /**
+     * Extends the time range of the contained image series with the same
+     * location to the one of the given image series, e.g. after images were
+     * appended to a scan.  The start of the time ranges must be equal.
+     */
+    void extendImageSeries(const ImageSeries& imageSeries);
+
     void addCell(std::auto_ptr<Cell> cell);
 
     void removeCell(int id);
@@ -297,6 +310,14 @@ public:
         return cellMap_.size();
     }
 
+    /**
+     * Returns the highest cell id or 0 if there are no cells.
+     */
+    int getMaxCellId() const
+    {
+        return cellMap_.empty() ? 0 : (*cellMap_.rbegin()).first;
+    }
+
     CellIterator getCellStart()
     {
         return CellIterator(cellMap_.begin());
@@ -313,6 +334,13 @@ public:
 
     std::auto_ptr<CellSelection> invertCellSelection(CellSelection* cellSelection);
 
+    /**
+     * Moves all cells of the given analysis to this analysis and copies its
+     * image series.  The ids of the moved cells are increased by
+     * cellIdOffset.
+     */
+    void moveAnalysis(Analysis& analysis, int cellIdOffset);
+
     static inline unsigned short decodeCellId(const RGBAPixel& pixel)
     {
         return pixel[0] | (pixel[1] << 8);
@@ -328,6 +356,27 @@ public:
         return pixel[3];
     }
 
+    /**
+     * The largest cell id which can be stored in an analysis image.
+     */
+    static const int MAX_ENCODABLE_CELL_ID = 0xffff;
+
+    /**
+     * Returns false if the ids of the cells exceed MAX_ENCODABLE_CELL_ID, so
+     * that they cannot be stored in the analysis images.  The analyzers stop
+     * at the first image for which this happens.
+     */
+    bool hasEncodableCellIds() const
+    {
+        return getMaxCellId() <= MAX_ENCODABLE_CELL_ID;
+    }
+
+    static inline void encodeCellId(int cellId, RGBAPixel& pixel)
+    {
+        pixel[0] = 0xff & cellId;
+        pixel[1] = (0xff00 & cellId) >> 8;
+    }
+
 private:
 
     AnalysisMetadata metadata_;
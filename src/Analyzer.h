@@ -65,6 +65,7 @@ public:
     enum Id
     {
         MESSAGE,
+        ERROR_MESSAGE,
         PROGRESS,
         CHECK_GUI
     };
@@ -76,6 +77,14 @@ public:
     {
     }
 
+    AnalyzerEvent(Id id, const std::string& message) :
+        id_(id), 
+        message_(message), 
+        progress_(0.0)
+    {
+        assert(id == AnalyzerEvent::MESSAGE || id == AnalyzerEvent::ERROR_MESSAGE);
+    }
+
     AnalyzerEvent(float progress) :
         id_(AnalyzerEvent::PROGRESS),
         progress_(progress)
@@ -95,7 +104,7 @@ public:
 
     const std::string& getMessage() const
     {
-        assert(id_ == AnalyzerEvent::MESSAGE);
+        assert(id_ == AnalyzerEvent::MESSAGE || id_ == AnalyzerEvent::ERROR_MESSAGE);
         return message_;
     }
 
@@ -128,6 +137,58 @@ public:
 
     virtual void cancel() = 0;
 
+    /**
+     * Sets the number of threads the analyzer may use for processing.
+     * Analyzers which do not support multithreading ignore this value.
+     */
+    virtual void setNumberOfThreads(int numberOfThreads) { }
+
+    /**
+     * Sets the number of images the analyzer may read ahead in the
+     * background.  A value of zero disables reading ahead.  Analyzers which
+     * do not support reading ahead ignore this value.
+     */
+    virtual void setNumberOfPrefetchedImages(int numberOfPrefetchedImages) { }
+
+    /**
+     * If enabled, the analyzer skips the image series which were finished by
+     * a previous, interrupted run with the same scan and assay.  Analyzers
+     * which do not keep a journal ignore this value.
+     */
+    virtual void setResumeEnabled(bool resumeEnabled) { }
+
+    /**
+     * If enabled, an existing analysis in the analysis directory is
+     * continued instead of being replaced.  Only the images following the
+     * stored time range of every image series are processed.  Analyzers
+     * which do not support this ignore this value.
+     */
+    virtual void setIncrementalEnabled(bool incrementalEnabled) { }
+
+    /**
+     * If enabled, intermediate images are released as soon as they are
+     * processed, instead of being kept and reused for the next image.  This
+     * lowers the peak memory usage at the cost of allocating the images for
+     * every image.  Analyzers which do not support this ignore this value.
+     */
+    virtual void setLowMemoryEnabled(bool lowMemoryEnabled) { }
+
+    /**
+     * Sets the minimum time in seconds between two savings of the analysis.
+     * A call of process() which finishes earlier keeps the analysis in
+     * memory only, until a later call of process() or flushAnalysis() saves
+     * it.  This is meant for calling process() repeatedly while images are
+     * added to the scan, as every call continues the analysis of the
+     * previous one with the new images.  Zero saves the analysis after
+     * every call.  Analyzers which do not support this ignore this value.
+     */
+    virtual void setSaveInterval(double saveInterval) { }
+
+    /**
+     * Saves the analysis if the last successful call of process() did not.
+     */
+    virtual void flushAnalysis() { }
+
 };
 
 class Visualization
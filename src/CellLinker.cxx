@@ -0,0 +1,199 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <CellLinker.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <itkVector.h>
+
+namespace PT
+{
+
+class AffinityVectorEntry 
+{
+public:
+    float affinity;
+    int oldCellId;
+    Cell* cell;
+
+    AffinityVectorEntry(float affinityParam, int oldCellIdParam, Cell* cellParam) :
+        affinity(affinityParam),
+        oldCellId(oldCellIdParam),
+        cell(cellParam)
+    {
+    }
+
+    bool operator<(const AffinityVectorEntry& entry) const
+    {
+        return affinity < entry.affinity;
+    }
+}; 
+
+CellLinker::CellLinker(float maxMatchingOffset, int matchingPeriod) :
+    maxMatchingOffset_(maxMatchingOffset),
+    matchingPeriod_(matchingPeriod)
+{
+    assert(matchingPeriod >= 0);
+}
+
+float CellLinker::estimateAffinity(
+        const CellObservation* previousObservation,
+        const CellObservation* currentObservation) const
+{
+    typedef itk::Vector<float, 2> FloatVec2D;
+
+    const ImageRegion& prevRegion = previousObservation->getRegion();
+    const ImageRegion& curRegion = currentObservation->getRegion();
+
+    FloatVec2D prevCenter;
+    prevCenter[0] = prevRegion.GetIndex()[0] + (prevRegion.GetSize()[0] / 2.0);
+    prevCenter[1] = prevRegion.GetIndex()[1] + (prevRegion.GetSize()[1] / 2.0);
+
+    FloatVec2D curCenter;
+    curCenter[0] = curRegion.GetIndex()[0] + (curRegion.GetSize()[0] / 2.0);
+    curCenter[1] = curRegion.GetIndex()[1] + (curRegion.GetSize()[1] / 2.0);
+
+    float distance = (curCenter - prevCenter).GetNorm();
+    if (distance > maxMatchingOffset_)
+        return 0;
+    else
+        return (maxMatchingOffset_ - distance) / maxMatchingOffset_;
+}
+
+void CellLinker::linkObservations(
+        Analysis& analysis,
+        const ImageKey& imageKey,
+        CellObservationMap& cellObservationMap,
+        CellIdMap& cellIdMap) const
+{
+    // iterate over previous time steps and try to find matching cells
+    ImageKey prevImageKey = imageKey;
+    for (int timeStep = 1; timeStep <= matchingPeriod_; ++timeStep)
+    {
+        prevImageKey = prevImageKey.previous();
+
+        // check whether we are still in the valid time range
+        if (! prevImageKey.isValid())
+            break;
+
+        std::auto_ptr<CellSelection> cellsInPrevImage = analysis.selectCellsInImage(prevImageKey);
+
+        // initialize affinity vector
+        std::vector<AffinityVectorEntry> affinityVector;
+        {
+            CellObservationMap::const_iterator cellObservationIt = cellObservationMap.begin();
+            CellObservationMap::const_iterator cellObservationItEnd = cellObservationMap.end();
+            for (;cellObservationIt != cellObservationItEnd; ++cellObservationIt)
+            {
+                int oldCellId = (*cellObservationIt).first;
+                const CellObservation* cellObservation = (*cellObservationIt).second;
+
+                CellSelection::CellIterator cellIt = cellsInPrevImage->getCellStart();
+                CellSelection::CellIterator cellItEnd = cellsInPrevImage->getCellEnd();
+                for (;cellIt != cellItEnd; ++cellIt)
+                {
+                    Cell* cell = *cellIt;
+
+                    CellObservation* prevObservation = cell->getObservation(prevImageKey.time);
+                    assert(prevObservation != 0);
+
+                    float affinity = estimateAffinity(prevObservation, cellObservation);
+                    if (affinity > 0)
+                    {
+                        AffinityVectorEntry entry(affinity, oldCellId, cell);
+                        affinityVector.push_back(entry);
+                    }
+                }
+            }
+        }
+
+        // sort affinity vector ascendingly by affinity
+        sort(affinityVector.begin(), affinityVector.end());
+
+        // assing CellObservation objects to Cell objects with the highest affinity
+        // affinityVector is sorted ascendingly, so iterate in reverse direction
+        std::vector<AffinityVectorEntry>::reverse_iterator affinityVectorIt = affinityVector.rbegin();
+        std::vector<AffinityVectorEntry>::reverse_iterator affinityVectorItEnd = affinityVector.rend();
+        for (; affinityVectorIt != affinityVectorItEnd; ++affinityVectorIt)
+        {
+            const AffinityVectorEntry& entry = *affinityVectorIt;
+            int oldCellId = entry.oldCellId;
+            Cell* cell = entry.cell;
+
+            if (! cell->isObservedInImage(imageKey))
+            {
+                CellObservationMap::iterator cellObservationIt = cellObservationMap.find(oldCellId);
+
+                // check if CellObservation is still available, i. e. is not already assigned
+                if (cellObservationIt != cellObservationMap.end())
+                {
+                    CellObservation* cellObservation = (*cellObservationIt).second;
+
+                    cell->addObservation( std::auto_ptr<CellObservation>(cellObservation) );
+                    cellIdMap.insert( CellIdMap::value_type(oldCellId, cell->getId()));
+
+                    cellObservationMap.erase(cellObservationIt);
+                }
+            }
+        }
+    }
+
+    // create new cells for observations that could not be assigned to any
+    // existing cell
+    CellObservationMap::iterator cellObservationIt = cellObservationMap.begin();
+    CellObservationMap::iterator cellObservationItEnd = cellObservationMap.end();
+    while (cellObservationIt != cellObservationItEnd)
+    {
+        int oldCellId = (*cellObservationIt).first;
+        CellObservation* cellObservation = (*cellObservationIt).second;
+
+        int newCellId = analysis.getNumberOfCells() + 1;
+        Cell* cell =  new Cell(newCellId, imageKey.location);
+        analysis.addCell( std::auto_ptr<Cell>(cell) );
+
+        cell->addObservation( std::auto_ptr<CellObservation>(cellObservation) );
+
+        cellIdMap.insert( CellIdMap::value_type( oldCellId, newCellId ) );
+
+        // it is important to increment the iterator before erasing the element
+        ++cellObservationIt;
+
+        cellObservationMap.erase(oldCellId);
+    }
+}
+
+FrameObservations::~FrameObservations()
+{
+    CellLinker::CellObservationMap::iterator cellObservationIt = cellObservations.begin();
+    CellLinker::CellObservationMap::iterator cellObservationEnd = cellObservations.end();
+    for (; cellObservationIt != cellObservationEnd; ++cellObservationIt)
+    {
+        delete (*cellObservationIt).second;
+    }
+}
+
+}
@@ -0,0 +1,116 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef CellLinker_h
+#define CellLinker_h
+
+#include <itk_hash_map.h>
+
+#include <Analysis.h>
+
+namespace PT
+{
+
+/**
+ * The CellLinker assigns the cell observations extracted from an image to
+ * the cells of an analysis.  An observation is assigned to the cell with the
+ * highest affinity which was observed in one of the preceding images of the
+ * same image series.  For observations which cannot be assigned, new cells
+ * are created.
+ *
+ * The images of an image series must be linked in the order of time, but
+ * the extraction of the observations does not depend on the analysis and can
+ * be done in any order.
+ */
+class CellLinker
+{
+public:
+
+    /**
+     * Maps the frame-local ids of the extracted observations to the
+     * observations.
+     */
+    typedef itk::hash_map<int, CellObservation*> CellObservationMap;
+
+    /**
+     * Maps the frame-local ids of the extracted observations to the ids of
+     * the cells they were assigned to.
+     */
+    typedef itk::hash_map<int, int> CellIdMap;
+
+    CellLinker(float maxMatchingOffset, int matchingPeriod);
+
+    /**
+     * Assigns the observations to cells of the analysis.  The observations
+     * are removed from the map and owned by the analysis afterwards.
+     */
+    void linkObservations(
+            Analysis& analysis,
+            const ImageKey& imageKey,
+            CellObservationMap& cellObservationMap,
+            CellIdMap& cellIdMap) const;
+
+    float estimateAffinity(
+            const CellObservation* previousObservation, 
+            const CellObservation* currentObservation) const;
+
+private:
+
+    float maxMatchingOffset_;
+
+    int matchingPeriod_;
+};
+
+/**
+ * The cell observations extracted from a single image, which are not yet
+ * linked with an analysis.
+ */
+class FrameObservations
+{
+public:
+
+    FrameObservations(const ImageKey& imageKeyParam) :
+        imageKey(imageKeyParam)
+    {
+    }
+
+    /**
+     * Deletes the observations which were not linked.
+     */
+    ~FrameObservations();
+
+    ImageKey imageKey;
+
+    CellLinker::CellObservationMap cellObservations;
+
+private:
+
+    // not implemented
+    FrameObservations(const FrameObservations&);
+    void operator=(const FrameObservations&);
+};
+
+}
+#endif
@@ -0,0 +1,127 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef ImageBufferPool_h
+#define ImageBufferPool_h
+
+#include <vector>
+
+#include <itkMutexLock.h>
+
+namespace PT
+{
+
+/**
+ * The ImageBufferPool recycles the pixel buffers of images which are created
+ * anew for every frame, e.g. read images or analysis images handed over to
+ * another thread.  The frames of a scan usually have the same size, so the
+ * buffer of a finished frame can be reused for the next one instead of
+ * allocating and faulting in fresh memory.
+ *
+ * The pool keeps a reference to every buffer it hands out.  A buffer is free
+ * again as soon as the pool holds the only reference, i.e. when the image
+ * using it was destroyed or got another buffer.  At most
+ * maxNumberOfBuffers buffers are kept; images which are assigned a buffer
+ * beyond this limit allocate their own.  The pool is thread-safe.
+ */
+template <class TImage>
+class ImageBufferPool
+{
+public:
+
+    typedef typename TImage::PixelContainer PixelContainer;
+    typedef typename TImage::PixelContainerPointer PixelContainerPointer;
+
+    ImageBufferPool(unsigned int maxNumberOfBuffers) :
+        maxNumberOfBuffers_(maxNumberOfBuffers)
+    {
+    }
+
+    /**
+     * Changes the maximum number of buffers.  Surplus buffers are no longer
+     * kept by the pool.
+     */
+    void setMaxNumberOfBuffers(unsigned int maxNumberOfBuffers)
+    {
+        mutex_.Lock();
+        maxNumberOfBuffers_ = maxNumberOfBuffers;
+        if (buffers_.size() > maxNumberOfBuffers_)
+        {
+            buffers_.resize(maxNumberOfBuffers_);
+        }
+        mutex_.Unlock();
+    }
+
+    /**
+     * Lets the image use a free buffer of the pool.  The buffer is sized when
+     * the image is allocated, which only allocates memory if the buffer has
+     * never been as large before.  Call this before the image is allocated,
+     * e.g. before updating the filter producing it.
+     */
+    void assignBuffer(TImage* image)
+    {
+        PixelContainerPointer buffer;
+
+        mutex_.Lock();
+        {
+            // prefer the largest free buffer, so that it does not need to grow
+            for (unsigned int i = 0; i < buffers_.size(); ++i)
+            {
+                if (buffers_[i]->GetReferenceCount() == 1 && 
+                    (buffer.IsNull() || buffers_[i]->Capacity() > buffer->Capacity()))
+                {
+                    buffer = buffers_[i];
+                }
+            }
+
+            if (buffer.IsNull() && buffers_.size() < maxNumberOfBuffers_)
+            {
+                buffer = PixelContainer::New();
+                buffers_.push_back(buffer);
+            }
+        }
+        mutex_.Unlock();
+
+        if (buffer.IsNotNull())
+        {
+            image->SetPixelContainer(buffer);
+        }
+    }
+
+private:
+
+    // not implemented
+    ImageBufferPool(const ImageBufferPool&);
+    void operator=(const ImageBufferPool&);
+
+    unsigned int maxNumberOfBuffers_;
+
+    std::vector<PixelContainerPointer> buffers_;
+
+    itk::SimpleMutexLock mutex_;
+};
+
+}
+#endif
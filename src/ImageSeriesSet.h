@@ -202,6 +202,16 @@ public:
 
     const ImageSeries& getImageSeries(const ImageLocation& location) const;
 
+    bool containsImageSeries(const ImageLocation& location) const
+    {
+        return imageSeriesMap_.find(location) != imageSeriesMap_.end();
+    }
+
+    int getNumberOfImageSeries() const
+    {
+        return imageSeriesMap_.size();
+    }
+
     ImageSeriesConstIterator getImageSeriesStart() const
     {
         return ImageSeriesConstIterator(imageSeriesMap_.begin());
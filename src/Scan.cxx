@@ -25,6 +25,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <Scan.h>
 
+#include <stdlib.h>
+
 #include <algorithm>
 #include <iostream>
 #include <iterator>
@@ -33,6 +35,62 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace PT
 {
 
+/**
+ * Sets the given component to the number at the given index, which starts
+ * with 1.  An index of 0 sets the component to 0 if this is allowed.
+ */
+static bool parseImageKeyComponent(const std::vector<int>& tokens, int index, bool zeroAllowed, short& component)
+{
+    if (index == 0 && zeroAllowed)
+    {
+        component = 0;
+        return true;
+    }
+    else if (index >= 1 && index <= (int)tokens.size())
+    {
+        component = tokens[index - 1];
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+bool parseImageFilename(const std::string& filename, const ImageFilenameFormat& format, ImageKey& key)
+{
+    // parse tokens
+    std::vector<int> tokens;
+    {
+        std::string token;
+        std::string::const_iterator it = filename.begin();
+        std::string::const_iterator end = filename.end();
+        for(;it != end; it++)
+        {
+            char c = *it;
+            if (c >= '0' && c <= '9') {
+                token += *it;
+            }
+            else
+            {
+                if (token.size() > 0)
+                {
+                    int value = atoi(token.c_str()); 
+                    tokens.push_back(value);
+                    token.clear();
+                }
+            }
+        }
+    }
+
+    bool valid = true;
+    valid = parseImageKeyComponent(tokens, format.wellIndex, true, key.location.well) && valid;
+    valid = parseImageKeyComponent(tokens, format.positionIndex, true, key.location.position) && valid;
+    valid = parseImageKeyComponent(tokens, format.slideIndex, true, key.location.slide) && valid;
+    valid = parseImageKeyComponent(tokens, format.timeIndex, false, key.time) && valid;
+    return valid;
+}
+
 void Scan::addImageMetadata(const ImageMetadata& metadata)
 {
     const ImageKey& imageKey = metadata.key;
@@ -77,4 +135,34 @@ const ImageMetadata& Scan::getImageMetadata(const ImageKey& key) const
         throw(NoSuchElementException("no such image key"));
 }
 
+std::auto_ptr<Scan> createScanShard(const Scan& scan, int shardIndex, int numberOfShards)
+{
+    assert(numberOfShards > 0);
+    assert(shardIndex >= 0 && shardIndex < numberOfShards);
+
+    std::auto_ptr<Scan> shard(new Scan());
+
+    int numberOfImageSeries = scan.getNumberOfImageSeries();
+
+    int imageSeriesIndex = 0;
+    Scan::ImageSeriesConstIterator imageSeriesIt = scan.getImageSeriesStart();
+    Scan::ImageSeriesConstIterator imageSeriesEnd = scan.getImageSeriesEnd();
+    for (; imageSeriesIt != imageSeriesEnd; ++imageSeriesIt, ++imageSeriesIndex)
+    {
+        if (imageSeriesIndex * numberOfShards / numberOfImageSeries != shardIndex)
+        {
+            continue;
+        }
+
+        const ImageSeries& imageSeries = *imageSeriesIt;
+        const ImageSeries::TimeRange& timeRange = imageSeries.timeRange;
+        for (short time = timeRange.min; time <= timeRange.max; ++time)
+        {
+            shard->addImageMetadata(scan.getImageMetadata(imageSeries.getImageKey(time)));
+        }
+    }
+
+    return shard;
+}
+
 }
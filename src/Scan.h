@@ -26,7 +26,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef Scan_h
 #define Scan_h
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <ImageSeriesSet.h>
 
@@ -43,6 +45,30 @@ struct ImageMetadata
     {};
 };
 
+/**
+ * Describes how image keys are parsed from the numbers in image filenames.
+ * Each index refers to a number of the filename, starting with 1.  An index
+ * of 0 sets the respective location component to 0, the time always has to
+ * be given by a number.
+ */
+struct ImageFilenameFormat
+{
+    int wellIndex;
+    int positionIndex;
+    int slideIndex;
+    int timeIndex;
+
+    ImageFilenameFormat() : wellIndex(0), positionIndex(0), slideIndex(0), timeIndex(1)
+    {}
+};
+
+/**
+ * Parses the image key of an image filename.  Returns false if the filename
+ * does not contain the numbers required by the format, in which case the key
+ * is only partially set.
+ */
+bool parseImageFilename(const std::string& filename, const ImageFilenameFormat& format, ImageKey& key);
+
 class Scan : public ImageSeriesSet
 {
 private:
@@ -85,6 +111,15 @@ private:
 
 };
 
+/**
+ * Creates a scan of the image series belonging to the given shard, so that
+ * a scan can be analyzed on several machines.  The image series are split
+ * into numberOfShards contiguous ranges in the order of their locations, so
+ * that merging the analyses of the shards in this order assigns the same
+ * cell ids as analyzing the whole scan.
+ */
+std::auto_ptr<Scan> createScanShard(const Scan& scan, int shardIndex, int numberOfShards);
+
 }
 
 #endif
@@ -0,0 +1,199 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <WorkerPool.h>
+
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+#include <ctime>
+#include <exception>
+
+namespace PT
+{
+
+WorkerPool::WorkerPool(int numberOfWorkers) :
+    threader_(itk::MultiThreader::New()),
+    jobAvailable_(itk::ConditionVariable::New()),
+    jobsFinished_(itk::ConditionVariable::New()),
+    numberOfRunningJobs_(0),
+    numberOfStartedWorkers_(0),
+    terminating_(false)
+{
+    assert(numberOfWorkers > 0);
+
+    // the multi threader cannot spawn more threads than ITK_MAX_THREADS
+    if (numberOfWorkers > ITK_MAX_THREADS)
+    {
+        numberOfWorkers = ITK_MAX_THREADS;
+    }
+
+    for (int i = 0; i < numberOfWorkers; ++i)
+    {
+        int threadId = threader_->SpawnThread(&WorkerPool::executeWorker, this);
+        threadIds_.push_back(threadId);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    mutex_.Lock();
+    terminating_ = true;
+    jobAvailable_->Broadcast();
+    mutex_.Unlock();
+
+    // TerminateThread() joins the thread, which returns as soon as the job
+    // queue is empty
+    for (unsigned int i = 0; i < threadIds_.size(); ++i)
+    {
+        threader_->TerminateThread(threadIds_[i]);
+    }
+
+    // delete jobs which were never started
+    while (!priorityJobs_.empty())
+    {
+        delete priorityJobs_.front();
+        priorityJobs_.pop_front();
+    }
+    while (!jobs_.empty())
+    {
+        delete jobs_.front();
+        jobs_.pop_front();
+    }
+}
+
+void WorkerPool::addJob(std::auto_ptr<Job> job)
+{
+    mutex_.Lock();
+    jobs_.push_back(job.release());
+    jobAvailable_->Signal();
+    mutex_.Unlock();
+}
+
+void WorkerPool::addPriorityJob(std::auto_ptr<Job> job)
+{
+    mutex_.Lock();
+    priorityJobs_.push_back(job.release());
+    jobAvailable_->Signal();
+    mutex_.Unlock();
+}
+
+void WorkerPool::waitForJobs()
+{
+    mutex_.Lock();
+    while (hasJobs() || numberOfRunningJobs_ > 0)
+    {
+        jobsFinished_->Wait(&mutex_);
+    }
+    std::string errorMessage = errorMessage_;
+    errorMessage_.clear();
+    mutex_.Unlock();
+
+    if (!errorMessage.empty())
+    {
+        throw Exception(errorMessage.c_str());
+    }
+}
+
+ITK_THREAD_RETURN_TYPE WorkerPool::executeWorker(void* threadInfo)
+{
+    itk::MultiThreader::ThreadInfoStruct* info = 
+        static_cast<itk::MultiThreader::ThreadInfoStruct*>(threadInfo);
+    WorkerPool* workerPool = static_cast<WorkerPool*>(info->UserData);
+
+    workerPool->runWorker();
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+void WorkerPool::runWorker()
+{
+    mutex_.Lock();
+    int workerIndex = numberOfStartedWorkers_++;
+
+    while (true)
+    {
+        while (!hasJobs() && !terminating_)
+        {
+            jobAvailable_->Wait(&mutex_);
+        }
+
+        if (!hasJobs())
+        {
+            // terminating and no more work to do
+            break;
+        }
+
+        std::deque<Job*>& jobs = priorityJobs_.empty() ? jobs_ : priorityJobs_;
+        Job* job = jobs.front();
+        jobs.pop_front();
+        ++numberOfRunningJobs_;
+        mutex_.Unlock();
+
+        std::string errorMessage;
+        try
+        {
+            job->run(workerIndex);
+        }
+        catch (std::exception& e)
+        {
+            errorMessage = e.what();
+        }
+        catch (...)
+        {
+            errorMessage = "unknown error in worker thread";
+        }
+        delete job;
+
+        mutex_.Lock();
+        if (!errorMessage.empty() && errorMessage_.empty())
+        {
+            errorMessage_ = errorMessage;
+        }
+        --numberOfRunningJobs_;
+        if (!hasJobs() && numberOfRunningJobs_ == 0)
+        {
+            jobsFinished_->Broadcast();
+        }
+    }
+
+    mutex_.Unlock();
+}
+
+double getThreadCpuTime()
+{
+#ifdef RUSAGE_THREAD
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+    {
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+#endif
+    return clock() / (double) CLOCKS_PER_SEC;
+}
+
+}
@@ -0,0 +1,144 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef WorkerPool_h
+#define WorkerPool_h
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <itkConditionVariable.h>
+#include <itkMultiThreader.h>
+#include <itkMutexLock.h>
+
+#include <common.h>
+
+namespace PT
+{
+
+/**
+ * A unit of work which is executed by one of the workers of a WorkerPool.
+ */
+class Job
+{
+public:
+    /**
+     * Ensure that destructor of subclasses is called.
+     */
+    virtual ~Job() {}
+
+    /**
+     * Executes the job.  The index of the executing worker is passed, so
+     * that jobs can use resources which are reserved for a single worker,
+     * like a filter pipeline.
+     */
+    virtual void run(int workerIndex) = 0;
+};
+
+/**
+ * The WorkerPool executes jobs on a fixed number of threads.  Jobs are
+ * started in the order in which they were added, but priority jobs are
+ * started before all other jobs.  An exception thrown by a
+ * job does not terminate the worker.  Instead the message of the first
+ * exception is kept and rethrown by waitForJobs().
+ */
+class WorkerPool
+{
+public:
+
+    WorkerPool(int numberOfWorkers);
+
+    /**
+     * Waits for all pending jobs and terminates the workers.
+     */
+    ~WorkerPool();
+
+    int getNumberOfWorkers() const
+    {
+        return threadIds_.size();
+    }
+
+    void addJob(std::auto_ptr<Job> job);
+
+    /**
+     * Adds a job which is started before the jobs added with addJob(), e.g.
+     * because it releases resources which the other jobs are waiting for.
+     */
+    void addPriorityJob(std::auto_ptr<Job> job);
+
+    /**
+     * Blocks until all jobs added so far are finished.
+     */
+    void waitForJobs();
+
+private:
+
+    // not implemented
+    WorkerPool(const WorkerPool&);
+    void operator=(const WorkerPool&);
+
+    static ITK_THREAD_RETURN_TYPE executeWorker(void* threadInfo);
+
+    bool hasJobs() const
+    {
+        return !priorityJobs_.empty() || !jobs_.empty();
+    }
+
+    void runWorker();
+
+    itk::MultiThreader::Pointer threader_;
+
+    std::vector<int> threadIds_;
+
+    itk::SimpleMutexLock mutex_;
+
+    itk::ConditionVariable::Pointer jobAvailable_;
+
+    itk::ConditionVariable::Pointer jobsFinished_;
+
+    std::deque<Job*> priorityJobs_;
+
+    std::deque<Job*> jobs_;
+
+    int numberOfRunningJobs_;
+
+    int numberOfStartedWorkers_;
+
+    bool terminating_;
+
+    std::string errorMessage_;
+};
+
+/**
+ * Returns the CPU time of the calling thread in seconds.  On platforms which
+ * do not report the CPU time per thread, the CPU time of the whole process
+ * is returned.
+ */
+double getThreadCpuTime();
+
+}
+#endif
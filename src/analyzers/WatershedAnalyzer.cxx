@@ -25,35 +25,458 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <analyzers/WatershedAnalyzer.h>
 
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+#include <itkConditionVariable.h>
 #include <itkExceptionObject.h>
+#include <itkMultiThreader.h>
+#include <itkMutexLock.h>
+#include <itksys/SystemTools.hxx>
 
+#include <algorithm>
 #include <sstream>
 
+#include <CellLinker.h>
+#include <WorkerPool.h>
 #include <io/AnalysisIO.h>
+#include <io/ImagePrefetcher.h>
+#include <io/ImageWriterQueue.h>
 
 namespace PT 
 {
 
 static const std::string ANALYZER_NAME("Watershed");
 
+static const int DEFAULT_NUMBER_OF_PREFETCHED_IMAGES = 2;
+
+// the number of analysis images which may wait for every writer thread
+static const int NUMBER_OF_PENDING_IMAGES_PER_WRITER = 2;
+
+// the minimum time between two CHECK_GUI events in seconds; the filters
+// report their progress far more often, and every event makes a graphical
+// user interface process its pending events
+static const double GUI_CHECK_INTERVAL = 0.04;
+
+/**
+ * Returns the peak resident memory of the process in bytes or 0 if it is
+ * unknown on this platform.
+ */
+static double getPeakMemoryUsage()
+{
+#ifdef WIN32
+    return 0.0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0.0;
+    }
+#ifdef __APPLE__
+    return (double) usage.ru_maxrss;
+#else
+    // Linux reports kilobytes
+    return usage.ru_maxrss * 1024.0;
+#endif
+#endif
+}
+
+/**
+ * Adds the statistics of the images written by the queue.
+ */
+static void addWritingStatistics(FilterStatistics& target, ImageWriterQueue& imageWriterQueue)
+{
+    ImageWriterQueue::Statistics writerStatistics = imageWriterQueue.getStatistics();
+
+    FilterStatistics statistics(target.filterName);
+    statistics.numberOfExecutions = writerStatistics.numberOfImages;
+    statistics.wallTime = writerStatistics.wallTime;
+    statistics.cpuTime = writerStatistics.cpuTime;
+    statistics.numberOfPixels = writerStatistics.numberOfPixels;
+    target.add(statistics);
+}
+
+/**
+ * Creates an ImagePrefetcher which reads the given images in the background
+ * and shrinks them as required by the assay or returns a null pointer if
+ * numberOfPrefetchedImages is zero.
+ */
+static std::auto_ptr<ImagePrefetcher> createImagePrefetcher(
+        const std::vector<const ImageMetadata*>& images,
+        const Assay& assay,
+        int numberOfPrefetchedImages)
+{
+    std::auto_ptr<ImagePrefetcher> imagePrefetcher;
+    if (numberOfPrefetchedImages > 0 && !images.empty())
+    {
+        std::vector<std::string> filePaths;
+        for (unsigned int i = 0; i < images.size(); ++i)
+        {
+            filePaths.push_back(images[i]->filepath);
+        }
+
+        // reading is dominated by latency, so every prefetched image is read
+        // by a thread of its own
+        imagePrefetcher.reset(new ImagePrefetcher(
+                    filePaths, 
+                    assay.getParameter(PARAMETER_SHRINK_FACTOR).getIntValue(),
+                    numberOfPrefetchedImages, 
+                    numberOfPrefetchedImages));
+    }
+    return imagePrefetcher;
+}
+
+/**
+ * Collects the messages and the extracted observations of the workers.  They
+ * are passed on by the thread which called process(), because event handlers
+ * are not required to be thread-safe and the observations have to be linked
+ * in order.
+ */
+class WorkerProgress
+{
+public:
+
+    struct ExtractedImage
+    {
+        int imageIndex;
+
+        FrameObservations* frame;
+
+        RGBAImage::Pointer analysisImage;
+    };
+
+    typedef std::vector<ExtractedImage> FrameVector;
+
+    WorkerProgress(int numberOfJobs) :
+        changed_(itk::ConditionVariable::New()),
+        numberOfPendingJobs_(numberOfJobs),
+        guiCheckRequested_(false)
+    {
+    }
+
+    ~WorkerProgress()
+    {
+        for (unsigned int i = 0; i < frames_.size(); ++i)
+        {
+            delete frames_[i].frame;
+        }
+    }
+
+    void addMessage(const std::string& message)
+    {
+        mutex_.Lock();
+        messages_.push_back(message);
+        changed_->Signal();
+        mutex_.Unlock();
+    }
+
+    /**
+     * Wakes up the waiting thread, so that it can keep a graphical user
+     * interface responsive while the workers are busy.
+     */
+    void requestGuiCheck()
+    {
+        mutex_.Lock();
+        guiCheckRequested_ = true;
+        changed_->Signal();
+        mutex_.Unlock();
+    }
+
+    /**
+     * Called once for every job.  The observations and the analysis image
+     * are null if the image was not processed.
+     */
+    void finishImage(
+            int imageIndex, 
+            std::auto_ptr<FrameObservations> frame, 
+            RGBAImage* analysisImage)
+    {
+        ExtractedImage extractedImage;
+        extractedImage.imageIndex = imageIndex;
+        extractedImage.frame = frame.release();
+        extractedImage.analysisImage = analysisImage;
+
+        mutex_.Lock();
+        frames_.push_back(extractedImage);
+        --numberOfPendingJobs_;
+        changed_->Signal();
+        mutex_.Unlock();
+    }
+
+    /**
+     * Blocks until there are new messages, finished images or a requested
+     * GUI check.  The caller takes ownership of the returned observations.
+     * Returns false if all jobs are finished and everything has been
+     * reported.
+     */
+    bool waitForChange(std::vector<std::string>& messages, FrameVector& frames)
+    {
+        mutex_.Lock();
+        while (messages_.empty() && frames_.empty() && !guiCheckRequested_ && numberOfPendingJobs_ > 0)
+        {
+            changed_->Wait(&mutex_);
+        }
+
+        bool changed = !messages_.empty() || !frames_.empty() || guiCheckRequested_;
+        guiCheckRequested_ = false;
+
+        messages.swap(messages_);
+        messages_.clear();
+        frames.swap(frames_);
+        frames_.clear();
+        mutex_.Unlock();
+
+        return changed;
+    }
+
+private:
+
+    itk::SimpleMutexLock mutex_;
+
+    itk::ConditionVariable::Pointer changed_;
+
+    std::vector<std::string> messages_;
+
+    FrameVector frames_;
+
+    int numberOfPendingJobs_;
+
+    bool guiCheckRequested_;
+};
+
+/**
+ * Passes the filter progress of a worker on as GUI check requests, at most
+ * once per GUI_CHECK_INTERVAL.  The workers have a handler of their own, so
+ * that checking the interval needs no synchronization.
+ */
+class WorkerProgressHandler : public EventHandler<FilterProgressEvent>
+{
+public:
+
+    WorkerProgressHandler(WorkerProgress& progress) : 
+        progress_(progress),
+        lastGuiCheckTime_(0.0)
+    {
+    }
+
+    void handleEvent(const FilterProgressEvent &event)
+    {
+        double time = itksys::SystemTools::GetTime();
+        if (time - lastGuiCheckTime_ >= GUI_CHECK_INTERVAL)
+        {
+            lastGuiCheckTime_ = time;
+            progress_.requestGuiCheck();
+        }
+    }
+
+private:
+
+    WorkerProgress& progress_;
+
+    double lastGuiCheckTime_;
+};
+
+/**
+ * Extracts the cell observations of an image with the filter pipeline of the
+ * executing worker.  The analysis image contains frame-local cell ids.
+ */
+class ImageJob : public Job
+{
+public:
+
+    ImageJob(
+            const ImageMetadata& imageMetadata,
+            int imageIndex,
+            ImagePrefetcher* imagePrefetcher,
+            const std::vector<WatershedFilterPipeline*>& pipelines,
+            WorkerProgress& progress,
+            volatile bool& cancelled) :
+        imageMetadata_(imageMetadata),
+        imageIndex_(imageIndex),
+        imagePrefetcher_(imagePrefetcher),
+        pipelines_(pipelines),
+        progress_(progress),
+        cancelled_(cancelled)
+    {
+    }
+
+    void run(int workerIndex)
+    {
+        std::auto_ptr<FrameObservations> frame;
+        RGBAImage::Pointer analysisImage;
+        try
+        {
+            if (!cancelled_)
+            {
+                WatershedFilterPipeline& pipeline = *pipelines_[workerIndex];
+                analysisImage = process(pipeline);
+                frame = pipeline.analysisFilter_->releaseFrameObservations();
+            }
+        }
+        catch (itk::ProcessAborted&)
+        {
+            // the analysis was cancelled
+        }
+        catch (...)
+        {
+            // stop the remaining jobs, the error is reported by the worker pool
+            cancelled_ = true;
+            progress_.finishImage(imageIndex_, frame, 0);
+            throw;
+        }
+        progress_.finishImage(imageIndex_, frame, analysisImage);
+    }
+
+private:
+
+    RGBAImage::Pointer process(WatershedFilterPipeline& pipeline)
+    {
+        std::stringstream message;
+        message << "processing image " << imageMetadata_.filepath << std::endl;
+        progress_.addMessage(message.str());
+
+        if (imagePrefetcher_ != 0)
+        {
+            IntensityImage::Pointer image = imagePrefetcher_->takeImage(imageIndex_);
+            pipeline.setImage(imageMetadata_, image);
+        }
+        else
+        {
+            pipeline.setImage(imageMetadata_);
+        }
+
+        return pipeline.generateAnalysisImage();
+    }
+
+    const ImageMetadata imageMetadata_;
+    int imageIndex_;
+    ImagePrefetcher* imagePrefetcher_;
+    const std::vector<WatershedFilterPipeline*>& pipelines_;
+    WorkerProgress& progress_;
+    volatile bool& cancelled_;
+};
+
+/**
+ * Replaces the frame-local cell ids in an analysis image by the ids of the
+ * cells the observations were assigned to and queues the image for writing.
+ */
+class AnalysisImageJob : public Job
+{
+public:
+
+    AnalysisImageJob(
+            RGBAImage* analysisImage,
+            const CellLinker::CellIdMap& cellIdMap,
+            const std::string& filePath,
+            ImageWriterQueue& imageWriterQueue,
+            volatile bool& cancelled) :
+        analysisImage_(analysisImage),
+        filePath_(filePath),
+        imageWriterQueue_(imageWriterQueue),
+        cancelled_(cancelled)
+    {
+        CellLinker::CellIdMap::const_iterator cellIdIt = cellIdMap.begin();
+        CellLinker::CellIdMap::const_iterator cellIdEnd = cellIdMap.end();
+        for (; cellIdIt != cellIdEnd; ++cellIdIt)
+        {
+            unsigned int localCellId = (*cellIdIt).first;
+            if (localCellId >= cellIds_.size())
+            {
+                cellIds_.resize(localCellId + 1, 0);
+            }
+            cellIds_[localCellId] = (*cellIdIt).second;
+        }
+    }
+
+    void run(int workerIndex)
+    {
+        try
+        {
+            mapAnalysisImageCellIds(analysisImage_, cellIds_);
+            imageWriterQueue_.writeImage(analysisImage_, filePath_);
+        }
+        catch (...)
+        {
+            // stop the remaining jobs, the error is reported by the worker pool
+            cancelled_ = true;
+            throw;
+        }
+    }
+
+private:
+
+    RGBAImage::Pointer analysisImage_;
+    std::vector<int> cellIds_;
+    std::string filePath_;
+    ImageWriterQueue& imageWriterQueue_;
+    volatile bool& cancelled_;
+};
+
+/**
+ * Deletes the contained observations on destruction.
+ */
+class FrameObservationsVector
+{
+public:
+
+    FrameObservationsVector(int size) : frames_(size, 0) { }
+
+    ~FrameObservationsVector()
+    {
+        for (unsigned int i = 0; i < frames_.size(); ++i)
+        {
+            delete frames_[i];
+        }
+    }
+
+    FrameObservations*& operator[](int index)
+    {
+        return frames_[index];
+    }
+
+private:
+
+    std::vector<FrameObservations*> frames_;
+};
+
 WatershedAnalyzer::WatershedAnalyzer(
         const Assay& assay, 
         const Scan* scan,
         const std::string& analysisDirectory) :
+            assay_(assay),
             scan_(scan), 
+            numberOfThreads_(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()),
+            numberOfPrefetchedImages_(DEFAULT_NUMBER_OF_PREFETCHED_IMAGES),
+            resumeEnabled_(false),
+            incrementalEnabled_(false),
+            lowMemoryEnabled_(false),
+            cancelled_(false),
+            lastGuiCheckTime_(0.0),
+            analysisImagePool_(0),
             filterPipeline_(
                     AnalysisMetadata( 
-                        FEATURE_NAMES, 
-                        SUBREGION_NAMES, 
-                        analysisDirectory) )
+                        WatershedFeatures(getNumberOfRings(assay)).getFeatureNames(), 
+                        WatershedFeatures(getNumberOfRings(assay)).getSubregionNames(), 
+                        analysisDirectory) ),
+            writingStatistics_("Writing"),
+            saveInterval_(0.0),
+            lastSaveTime_(0.0),
+            unsavedAnalysis_(false)
 {
     filterPipeline_.setEventHandler(this);
     filterPipeline_.setAssay(assay);
+    filterPipeline_.setAnalysisImagePool(&analysisImagePool_);
+}
+
+WatershedAnalyzer::~WatershedAnalyzer()
+{
+    deleteWorkerPipelines();
 }
 
 void WatershedAnalyzer::process()
 {
-    int imageCounter = 0;
+    cancelled_ = false;
 
     try 
     {
@@ -65,40 +488,40 @@ void WatershedAnalyzer::process()
             notifyEventHandler( AnalyzerEvent(0.0) );
         }
 
-        // iterator over image series
-        Scan::ImageSeriesConstIterator imageSeriesIt = scan_->getImageSeriesStart();
-        Scan::ImageSeriesConstIterator imageSeriesEnd = scan_->getImageSeriesEnd();
-        for (;imageSeriesIt != imageSeriesEnd; ++imageSeriesIt)
+        // the analysis of a previous call is continued with the images
+        // added to the scan since, without loading it again
+        if (filterPipeline_.analysis_->getNumberOfImageSeries() > 0)
         {
-            const ImageSeries& imageSeries = *imageSeriesIt;
-
-            // add image series to analysis
-            filterPipeline_.analysis_->addImageSeries(imageSeries);
-
-            // iterator over time range
-            const ImageSeries::TimeRange& timeRange = imageSeries.timeRange;
-            for (short time = timeRange.min; time <= timeRange.max; ++time)
-            {
-                ImageKey imageKey = imageSeries.getImageKey(time);
-                const ImageMetadata& imageMetadata = scan_->getImageMetadata(imageKey);
-
-                // generate message event
-                std::stringstream message;
-                message << "processing image " << imageMetadata.filepath << std::endl;
-                notifyEventHandler( AnalyzerEvent(message.str()) );
-
-                // process image
-                filterPipeline_.setImage(imageMetadata);
-                filterPipeline_.fileWriter_->Update();
+            std::stringstream message;
+            message << "continuing analysis with " 
+                << filterPipeline_.analysis_->getNumberOfCells() << " cells" << std::endl;
+            notifyEventHandler( AnalyzerEvent(message.str()) );
+        }
+        else if (incrementalEnabled_ && loadStoredAnalysis())
+        {
+            std::stringstream message;
+            message << "continuing stored analysis with " 
+                << filterPipeline_.analysis_->getNumberOfCells() << " cells" << std::endl;
+            notifyEventHandler( AnalyzerEvent(message.str()) );
+        }
 
-                // generate progress event
-                float progress = (++imageCounter / (float) scan_->getNumberOfImages());
-                notifyEventHandler(AnalyzerEvent(progress));
-            }
+        // only the linking of the observations depends on the preceding
+        // images, so the images can be processed in parallel
+        if (numberOfThreads_ > 1 && scan_->getNumberOfImages() > 1)
+        {
+            processImageSeriesInParallel();
+        }
+        else
+        {
+            processImageSeries();
         }
 
-        // save analysis
-        saveAnalysis(*filterPipeline_.analysis_.get());
+        // save analysis, unless it was saved recently
+        unsavedAnalysis_ = true;
+        if (itksys::SystemTools::GetTime() - lastSaveTime_ >= saveInterval_)
+        {
+            storeAnalysis();
+        }
 
         filterPipeline_.analysisFilter_->ResetPipeline();
 
@@ -109,29 +532,534 @@ void WatershedAnalyzer::process()
             notifyEventHandler( AnalyzerEvent(message.str()) );
             notifyEventHandler(AnalyzerEvent(1.0));
         }
+
+        notifyFilterStatistics();
     }
     catch(PT::Exception& err)
     {
+        discardAnalysis();
+
         std::stringstream message;
         message << "an error occurred: " << err.what() << std::endl;
-        notifyEventHandler( AnalyzerEvent(message.str()) );
+        notifyEventHandler( AnalyzerEvent(AnalyzerEvent::ERROR_MESSAGE, message.str()) );
     }
     catch(itk::ProcessAborted&)
     {
+        discardAnalysis();
+
         filterPipeline_.fileWriter_->ResetPipeline();
-        filterPipeline_.analysis_.reset();
 
         // notify event handler
         std::stringstream message;
         message << "analysis cancelled" << std::endl;
-        notifyEventHandler( AnalyzerEvent(message.str()) );
+        notifyEventHandler( AnalyzerEvent(AnalyzerEvent::ERROR_MESSAGE, message.str()) );
     }
     catch(itk::ExceptionObject& err)
+    {
+        discardAnalysis();
+
+        std::stringstream message;
+        message << "an error occurred: " << err.what() << std::endl;
+        notifyEventHandler( AnalyzerEvent(AnalyzerEvent::ERROR_MESSAGE, message.str()) );
+    }
+}
+
+void WatershedAnalyzer::flushAnalysis()
+{
+    if (!unsavedAnalysis_)
+    {
+        return;
+    }
+
+    try
+    {
+        storeAnalysis();
+    }
+    catch(PT::Exception& err)
     {
         std::stringstream message;
         message << "an error occurred: " << err.what() << std::endl;
+        notifyEventHandler( AnalyzerEvent(AnalyzerEvent::ERROR_MESSAGE, message.str()) );
+    }
+}
+
+void WatershedAnalyzer::storeAnalysis()
+{
+    Analysis* analysis = filterPipeline_.analysis_.get();
+    saveAnalysis(*analysis);
+
+    // the journals are not needed any more once the analysis is saved
+    Scan::ImageSeriesConstIterator imageSeriesIt = scan_->getImageSeriesStart();
+    Scan::ImageSeriesConstIterator imageSeriesEnd = scan_->getImageSeriesEnd();
+    for (;imageSeriesIt != imageSeriesEnd; ++imageSeriesIt)
+    {
+        removeImageSeriesJournal(*analysis, *imageSeriesIt);
+    }
+
+    unsavedAnalysis_ = false;
+    lastSaveTime_ = itksys::SystemTools::GetTime();
+}
+
+void WatershedAnalyzer::discardAnalysis()
+{
+    deleteWorkerPipelines();
+    filterPipeline_.resetAnalysis();
+    unsavedAnalysis_ = false;
+}
+
+void WatershedAnalyzer::processImageSeries()
+{
+    std::vector<const ImageMetadata*> images;
+    std::vector<ImageSeries> imageSeries;
+    std::vector<int> imageSeriesEnds;
+    collectImages(images, imageSeries, imageSeriesEnds);
+    int numberOfImages = images.size();
+
+    const AnalysisMetadata& analysisMetadata = filterPipeline_.analysis_->getMetadata();
+    unsigned int imageSeriesIndex = 0;
+
+    std::auto_ptr<ImagePrefetcher> imagePrefetcher = 
+        createImagePrefetcher(images, assay_, numberOfPrefetchedImages_);
+
+    // the analysis images are written while the next image is processed, a
+    // pooled buffer is needed for each pending image and the current one
+    ImageWriterQueue imageWriterQueue(NUMBER_OF_PENDING_IMAGES_PER_WRITER, 1);
+    analysisImagePool_.setMaxNumberOfBuffers(
+            lowMemoryEnabled_ ? 0 : NUMBER_OF_PENDING_IMAGES_PER_WRITER + 2);
+
+    for (int i = 0; i < numberOfImages; ++i)
+    {
+        // the pipeline might have been cancelled between two updates
+        if (cancelled_)
+        {
+            throw itk::ProcessAborted(__FILE__, __LINE__);
+        }
+
+        const ImageMetadata& imageMetadata = *images[i];
+
+        // generate message event
+        std::stringstream message;
+        message << "processing image " << imageMetadata.filepath << std::endl;
         notifyEventHandler( AnalyzerEvent(message.str()) );
+
+        // process image
+        if (imagePrefetcher.get() != 0)
+        {
+            IntensityImage::Pointer image = imagePrefetcher->takeImage(i);
+            filterPipeline_.setImage(imageMetadata, image);
+        }
+        else
+        {
+            filterPipeline_.setImage(imageMetadata);
+        }
+        RGBAImage::Pointer analysisImage = filterPipeline_.generateAnalysisImage();
+        imageWriterQueue.writeImage(analysisImage, analysisMetadata.getFilePath(imageMetadata.key));
+
+        // journal finished image series
+        if (imageSeriesIndex < imageSeriesEnds.size() && i + 1 == imageSeriesEnds[imageSeriesIndex])
+        {
+            saveImageSeriesJournal(*filterPipeline_.analysis_.get(), imageSeries[imageSeriesIndex]);
+            ++imageSeriesIndex;
+        }
+
+        // generate progress event
+        float progress = ((i + 1) / (float) numberOfImages);
+        notifyEventHandler(AnalyzerEvent(progress));
+    }
+
+    imageWriterQueue.waitForImages();
+    addWritingStatistics(writingStatistics_, imageWriterQueue);
+}
+
+void WatershedAnalyzer::processImageSeriesInParallel()
+{
+    Analysis* analysis = filterPipeline_.analysis_.get();
+    const AnalysisMetadata& analysisMetadata = analysis->getMetadata();
+
+    std::vector<const ImageMetadata*> images;
+    std::vector<ImageSeries> imageSeries;
+    std::vector<int> imageSeriesEnds;
+    collectImages(images, imageSeries, imageSeriesEnds);
+    int numberOfImages = images.size();
+
+    if (numberOfImages == 0)
+    {
+        return;
+    }
+
+    // the threads are distributed among the workers, remaining threads are
+    // used by the multithreaded filters
+    int numberOfWorkers = std::min(numberOfThreads_, numberOfImages);
+    int numberOfFilterThreads = std::max(1, numberOfThreads_ / numberOfWorkers);
+
+    // create the missing filter pipelines of workers, those of a previous
+    // call are reused
+    for (int i = workerPipelines_.size(); i < numberOfWorkers; ++i)
+    {
+        WatershedFilterPipeline* pipeline = new WatershedFilterPipeline(analysisMetadata);
+        workerPipelines_.push_back(pipeline);
+        pipeline->setAssay(assay_);
+        pipeline->setAnalysisImagePool(&analysisImagePool_);
+        pipeline->analysisFilter_->setLinkingDeferred(true);
+    }
+    for (int i = 0; i < numberOfWorkers; ++i)
+    {
+        workerPipelines_[i]->setNumberOfThreads(numberOfFilterThreads);
+        workerPipelines_[i]->setReleaseDataEnabled(lowMemoryEnabled_);
+    }
+
+    CellLinker cellLinker(
+            filterPipeline_.analysisFilter_->getMaxMatchingOffset(), 
+            filterPipeline_.analysisFilter_->getMatchingPeriod());
+
+    // every worker needs an image in stock in addition to the ones read
+    // ahead
+    int numberOfPrefetchedImages = 0;
+    if (numberOfPrefetchedImages_ > 0)
+    {
+        numberOfPrefetchedImages = numberOfWorkers + numberOfPrefetchedImages_;
+    }
+
+    // writing shares the threads with the workers, as it is only a part of
+    // the work per image
+    int numberOfWriterThreads = std::max(1, numberOfWorkers / 2);
+
+    // the analysis images are pooled for the workers, the pending writes and
+    // as many images waiting for linking, more images allocate their own
+    // buffers
+    analysisImagePool_.setMaxNumberOfBuffers(lowMemoryEnabled_ ? 0 :
+            2 * numberOfWorkers + numberOfWriterThreads * NUMBER_OF_PENDING_IMAGES_PER_WRITER);
+
+    FrameObservationsVector frames(numberOfImages);
+    std::vector<RGBAImage::Pointer> analysisImages(numberOfImages);
+    WorkerProgress progress(numberOfImages);
+    std::vector<WorkerProgressHandler> progressHandlers(numberOfWorkers, WorkerProgressHandler(progress));
+    for (int i = 0; i < numberOfWorkers; ++i)
+    {
+        workerPipelines_[i]->setEventHandler(&progressHandlers[i]);
+    }
+    std::auto_ptr<ImagePrefetcher> imagePrefetcher = 
+        createImagePrefetcher(images, assay_, numberOfPrefetchedImages);
+    ImageWriterQueue imageWriterQueue(
+            numberOfWriterThreads * NUMBER_OF_PENDING_IMAGES_PER_WRITER, 
+            numberOfWriterThreads);
+    {
+        // the worker pool is destroyed before the observations, the progress,
+        // the image prefetcher and the writer queue, so no job can access
+        // them afterwards
+        WorkerPool workerPool(numberOfWorkers);
+
+        for (int i = 0; i < numberOfImages; ++i)
+        {
+            std::auto_ptr<Job> job(new ImageJob(
+                    *images[i], 
+                    i, 
+                    imagePrefetcher.get(), 
+                    workerPipelines_, 
+                    progress, 
+                    cancelled_));
+            workerPool.addJob(job);
+        }
+
+        // pass the messages of the workers on to the event handler and link
+        // the observations as soon as all preceding images are linked
+        std::vector<std::string> messages;
+        WorkerProgress::FrameVector finishedFrames;
+        int numberOfFinishedImages = 0;
+        int numberOfLinkedImages = 0;
+        unsigned int imageSeriesIndex = 0;
+        while (progress.waitForChange(messages, finishedFrames))
+        {
+            if (messages.empty() && finishedFrames.empty())
+            {
+                // a worker asked to keep the user interface responsive
+                notifyEventHandler( AnalyzerEvent() );
+                continue;
+            }
+
+            for (unsigned int i = 0; i < messages.size(); ++i)
+            {
+                notifyEventHandler( AnalyzerEvent(messages[i]) );
+            }
+            messages.clear();
+
+            if (finishedFrames.empty())
+                continue;
+
+            for (unsigned int i = 0; i < finishedFrames.size(); ++i)
+            {
+                const WorkerProgress::ExtractedImage& extractedImage = finishedFrames[i];
+                frames[extractedImage.imageIndex] = extractedImage.frame;
+                analysisImages[extractedImage.imageIndex] = extractedImage.analysisImage;
+            }
+            numberOfFinishedImages += finishedFrames.size();
+            finishedFrames.clear();
+
+            while (!cancelled_ && 
+                   numberOfLinkedImages < numberOfImages && 
+                   frames[numberOfLinkedImages] != 0)
+            {
+                FrameObservations* frame = frames[numberOfLinkedImages];
+
+                CellLinker::CellIdMap cellIdMap;
+                cellLinker.linkObservations(*analysis, frame->imageKey, frame->cellObservations, cellIdMap);
+
+                // fail at the same image as the serial analysis, the workers
+                // skip the remaining images while the pool waits for them
+                if (!analysis->hasEncodableCellIds())
+                {
+                    cancelled_ = true;
+                    std::stringstream message;
+                    message << "cell id " << analysis->getMaxCellId() << " exceeds the range of the analysis image format";
+                    throw InvalidArgumentException(message.str().c_str());
+                }
+
+                // writing must not wait for the remaining images, otherwise
+                // all analysis images are kept in memory and are written
+                // after the last image was processed
+                std::auto_ptr<Job> job(new AnalysisImageJob(
+                        analysisImages[numberOfLinkedImages], 
+                        cellIdMap, 
+                        analysisMetadata.getFilePath(frame->imageKey), 
+                        imageWriterQueue,
+                        cancelled_));
+                workerPool.addPriorityJob(job);
+
+                delete frame;
+                frames[numberOfLinkedImages] = 0;
+                analysisImages[numberOfLinkedImages] = 0;
+                ++numberOfLinkedImages;
+
+                // journal finished image series
+                if (imageSeriesIndex < imageSeriesEnds.size() && 
+                    numberOfLinkedImages == imageSeriesEnds[imageSeriesIndex])
+                {
+                    saveImageSeriesJournal(*analysis, imageSeries[imageSeriesIndex]);
+                    ++imageSeriesIndex;
+                }
+            }
+
+            float progressValue = numberOfFinishedImages / (float) numberOfImages;
+            notifyEventHandler( AnalyzerEvent(progressValue) );
+        }
+
+        // waits for the remaining relabeling jobs as well
+        workerPool.waitForJobs();
+
+        if (cancelled_)
+        {
+            throw itk::ProcessAborted(__FILE__, __LINE__);
+        }
+    }
+
+    imageWriterQueue.waitForImages();
+    addWritingStatistics(writingStatistics_, imageWriterQueue);
+}
+
+void WatershedAnalyzer::collectImages(
+        std::vector<const ImageMetadata*>& images,
+        std::vector<ImageSeries>& imageSeriesVector,
+        std::vector<int>& imageSeriesEnds)
+{
+    Analysis* analysis = filterPipeline_.analysis_.get();
+
+    // journals are only kept for analyses which are created from scratch,
+    // because restoring them relies on the cell ids following each other in
+    // the order of the image series
+    bool journalEnabled = analysis->getNumberOfImageSeries() == 0;
+
+    // image series can only be restored as long as all preceding ones were,
+    // otherwise the cell ids would differ
+    bool resuming = resumeEnabled_ && journalEnabled;
+
+    Scan::ImageSeriesConstIterator imageSeriesIt = scan_->getImageSeriesStart();
+    Scan::ImageSeriesConstIterator imageSeriesEnd = scan_->getImageSeriesEnd();
+    for (;imageSeriesIt != imageSeriesEnd; ++imageSeriesIt)
+    {
+        const ImageSeries& imageSeries = *imageSeriesIt;
+        const ImageLocation& location = imageSeries.location;
+        const ImageSeries::TimeRange& timeRange = imageSeries.timeRange;
+
+        // continue image series of a stored analysis
+        if (analysis->containsImageSeries(location))
+        {
+            const ImageSeries::TimeRange& storedTimeRange = analysis->getImageSeries(location).timeRange;
+            if (storedTimeRange.min != timeRange.min || storedTimeRange.max > timeRange.max)
+            {
+                std::stringstream message;
+                message << "image series w" << location.well
+                    << " p" << location.position
+                    << " s" << location.slide 
+                    << " of the scan does not extend the one of the stored analysis";
+                throw InvalidArgumentException(message.str().c_str());
+            }
+
+            for (short time = storedTimeRange.max + 1; time <= timeRange.max; ++time)
+            {
+                ImageKey imageKey = imageSeries.getImageKey(time);
+                images.push_back(&scan_->getImageMetadata(imageKey));
+            }
+
+            analysis->extendImageSeries(imageSeries);
+            continue;
+        }
+
+        if (resuming && loadImageSeriesJournal(*analysis, imageSeries))
+        {
+            std::stringstream message;
+            message << "restored image series w" << location.well
+                << " p" << location.position
+                << " s" << location.slide 
+                << " from journal" << std::endl;
+            notifyEventHandler( AnalyzerEvent(message.str()) );
+            continue;
+        }
+        resuming = false;
+
+        // a journal of a previous run must not be mistaken for one of this
+        // run if it is interrupted
+        removeImageSeriesJournal(*analysis, imageSeries);
+
+        analysis->addImageSeries(imageSeries);
+
+        for (short time = timeRange.min; time <= timeRange.max; ++time)
+        {
+            ImageKey imageKey = imageSeries.getImageKey(time);
+            images.push_back(&scan_->getImageMetadata(imageKey));
+        }
+
+        if (journalEnabled)
+        {
+            imageSeriesVector.push_back(imageSeries);
+            imageSeriesEnds.push_back(images.size());
+        }
+    }
+}
+
+bool WatershedAnalyzer::loadStoredAnalysis()
+{
+    Analysis* analysis = filterPipeline_.analysis_.get();
+    const AnalysisMetadata& analysisMetadata = analysis->getMetadata();
+
+    std::string filePath = analysisMetadata.baseDirectory + "analysis.xml";
+    if (! itksys::SystemTools::FileExists(filePath.c_str()))
+    {
+        return false;
+    }
+
+    std::auto_ptr<Analysis> storedAnalysis = loadAnalysis(filePath.c_str());
+    if (storedAnalysis->getMetadata().featureNames != analysisMetadata.featureNames)
+    {
+        throw InvalidArgumentException("the stored analysis has different features");
     }
+
+    // the cells are moved, so that the metadata of this analysis is kept
+    analysis->moveAnalysis(*storedAnalysis, 0);
+
+    return true;
+}
+
+void WatershedAnalyzer::deleteWorkerPipelines()
+{
+    std::vector<WatershedFilterPipeline*> pipelines;
+    pipelines.swap(workerPipelines_);
+
+    for (unsigned int i = 0; i < pipelines.size(); ++i)
+    {
+        addFilterStatistics(workerFilterStatistics_, pipelines[i]->getTotalStatistics());
+        delete pipelines[i];
+    }
+}
+
+FilterStatisticsVector WatershedAnalyzer::getFilterStatistics() const
+{
+    FilterStatisticsVector statistics = filterPipeline_.getTotalStatistics();
+    addFilterStatistics(statistics, workerFilterStatistics_);
+    for (unsigned int i = 0; i < workerPipelines_.size(); ++i)
+    {
+        addFilterStatistics(statistics, workerPipelines_[i]->getTotalStatistics());
+    }
+    statistics.push_back(writingStatistics_);
+    return statistics;
+}
+
+void WatershedAnalyzer::notifyFilterStatistics()
+{
+    FilterStatisticsVector statistics = getFilterStatistics();
+
+    std::stringstream message;
+    message << "filter statistics:" << std::endl;
+    message.setf(std::ios::fixed);
+    message.precision(1);
+    for (unsigned int i = 0; i < statistics.size(); ++i)
+    {
+        const FilterStatistics& filterStatistics = statistics[i];
+        if (filterStatistics.numberOfExecutions == 0)
+            continue;
+
+        message << "  " << filterStatistics.filterName << ": "
+            << filterStatistics.numberOfExecutions << " executions, "
+            << filterStatistics.wallTime << " s wall time, "
+            << filterStatistics.cpuTime << " s CPU time, "
+            << filterStatistics.getPixelsPerSecond() / 1e6 << " Mpixels/s, "
+            << filterStatistics.outputBufferSize / (1024.0 * 1024.0) << " MB output" << std::endl;
+    }
+
+    double peakMemoryUsage = getPeakMemoryUsage();
+    if (peakMemoryUsage > 0.0)
+    {
+        message << "peak memory usage: " << peakMemoryUsage / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+    notifyEventHandler( AnalyzerEvent(message.str()) );
+}
+
+void WatershedAnalyzer::cancel()
+{
+    cancelled_ = true;
+
+    filterPipeline_.cancel();
+    for (unsigned int i = 0; i < workerPipelines_.size(); ++i)
+    {
+        workerPipelines_[i]->cancel();
+    }
+}
+
+void WatershedAnalyzer::setNumberOfThreads(int numberOfThreads)
+{
+    assert(numberOfThreads > 0);
+
+    numberOfThreads_ = numberOfThreads;
+    filterPipeline_.setNumberOfThreads(numberOfThreads);
+}
+
+void WatershedAnalyzer::setNumberOfPrefetchedImages(int numberOfPrefetchedImages)
+{
+    assert(numberOfPrefetchedImages >= 0);
+
+    numberOfPrefetchedImages_ = numberOfPrefetchedImages;
+}
+
+void WatershedAnalyzer::setResumeEnabled(bool resumeEnabled)
+{
+    resumeEnabled_ = resumeEnabled;
+}
+
+void WatershedAnalyzer::setIncrementalEnabled(bool incrementalEnabled)
+{
+    incrementalEnabled_ = incrementalEnabled;
+}
+
+void WatershedAnalyzer::setLowMemoryEnabled(bool lowMemoryEnabled)
+{
+    lowMemoryEnabled_ = lowMemoryEnabled;
+    filterPipeline_.setReleaseDataEnabled(lowMemoryEnabled);
+}
+
+void WatershedAnalyzer::setSaveInterval(double saveInterval)
+{
+    assert(saveInterval >= 0.0);
+
+    saveInterval_ = saveInterval;
 }
 
 const std::string& WatershedAnalyzer::getName()
@@ -161,6 +1089,12 @@ std::auto_ptr<Assay> WatershedAnalyzer::createAssay()
         2.0, 0.1, 10.0);
     vec.push_back(diffusionConductanceParam);
 
+    Parameter fastDiffusionParam(
+        PARAMETER_FAST_DIFFUSION,
+        "Performs the anisotropic diffusion with vectorized row kernels on all processors.  The result differs from the reference implementation only by rounding errors, less than 1E-6 of the intensity range.",
+        true);
+    vec.push_back(fastDiffusionParam);
+
     Parameter sigmoidGradientAlphaParam(
         PARAMETER_SIGMOID_GRADIENT_ALPHA,
         "Controls the steepness of the sigmoid function.  Lower values act like a threshold while higher values cause a nearly linear mapping.  Thus, the alpha parameter determines the strength of the effect the sigmoid filter has on the image."
@@ -205,10 +1139,16 @@ std::auto_ptr<Assay> WatershedAnalyzer::createAssay()
 
     Parameter ringWidth2Param(
         PARAMETER_RING_WIDTH_2,
-        "The width of the second ring, measured in pixels",
+        "The width of the second ring and every further ring, measured in pixels",
         4, 0, 50);
     vec.push_back(ringWidth2Param);
 
+    Parameter numberOfRingsParam(
+        PARAMETER_NUMBER_OF_RINGS,
+        "The number of rings the cells are divided into, counted from the outside.  The mean intensity, the standard deviation and the area are measured for every ring and the remaining center of a cell.",
+        DEFAULT_NUMBER_OF_RINGS, 1, MAX_NUMBER_OF_RINGS);
+    vec.push_back(numberOfRingsParam);
+
     Parameter maximumMatchingOffsetParam(
         PARAMETER_MAX_MATCHING_OFFSET,
         "The maximum offset between two successive cell observations to be identified as one cell, measured in pixels.",
@@ -227,7 +1167,12 @@ std::auto_ptr<Assay> WatershedAnalyzer::createAssay()
 
 void WatershedAnalyzer::handleEvent(const FilterProgressEvent &event)
 {
-    notifyEventHandler(AnalyzerEvent());
+    double time = itksys::SystemTools::GetTime();
+    if (time - lastGuiCheckTime_ >= GUI_CHECK_INTERVAL)
+    {
+        lastGuiCheckTime_ = time;
+        notifyEventHandler(AnalyzerEvent());
+    }
 }
 
 }
@@ -44,12 +44,25 @@ public:
             const Scan* scan, 
             const std::string& analysisDirectory);
 
+    ~WatershedAnalyzer();
+
     virtual void process();
 
-    virtual void cancel()
-    {
-        filterPipeline_.cancel();
-    }
+    virtual void cancel();
+
+    virtual void setNumberOfThreads(int numberOfThreads);
+
+    virtual void setNumberOfPrefetchedImages(int numberOfPrefetchedImages);
+
+    virtual void setResumeEnabled(bool resumeEnabled);
+
+    virtual void setIncrementalEnabled(bool incrementalEnabled);
+
+    virtual void setLowMemoryEnabled(bool lowMemoryEnabled);
+
+    virtual void setSaveInterval(double saveInterval);
+
+    virtual void flushAnalysis();
 
     static const std::string& getName();
 
@@ -57,12 +70,113 @@ public:
 
     virtual void handleEvent(const FilterProgressEvent &event);
 
+    /**
+     * Returns the time and throughput of the filters summed over all images
+     * processed so far, including those processed by the workers, followed
+     * by the writing of the analysis images.  The times of workers running
+     * at the same time add up.
+     */
+    FilterStatisticsVector getFilterStatistics() const;
+
 private:
 
+    /**
+     * Processes the image series one after another using a single filter
+     * pipeline.
+     */
+    void processImageSeries();
+
+    /**
+     * Processes the images in parallel.  Every worker has a filter pipeline
+     * of its own, which only extracts the cell observations of an image.
+     * The observations are linked with the analysis in the order of the
+     * images as soon as they are available, so that the cell ids equal those
+     * of processImageSeries().
+     */
+    void processImageSeriesInParallel();
+
+    /**
+     * Loads the analysis stored in the analysis directory, if there is one,
+     * so that it is continued.  Returns false if there is no analysis.
+     */
+    bool loadStoredAnalysis();
+
+    /**
+     * Adds the image series of the scan to the analysis and collects their
+     * images in the order of processing.  If resuming is enabled, the
+     * leading image series which have a valid journal are restored from it
+     * instead.  Image series contained in a stored analysis are extended and
+     * only their new images are collected.  imageSeries and imageSeriesEnds
+     * receive the image series which are journaled when finished and the
+     * index following their last image.
+     */
+    void collectImages(
+            std::vector<const ImageMetadata*>& images,
+            std::vector<ImageSeries>& imageSeries,
+            std::vector<int>& imageSeriesEnds);
+
+    /**
+     * Saves the analysis and removes the journals of its image series.
+     */
+    void storeAnalysis();
+
+    /**
+     * Replaces the analysis by an empty one after a failed or cancelled
+     * call of process(), as it might only contain a part of the images.
+     * Analysis results which were not saved yet are lost.
+     */
+    void discardAnalysis();
+
+    /**
+     * Deletes the filter pipelines of the workers and keeps their filter
+     * statistics.
+     */
+    void deleteWorkerPipelines();
+
+    void notifyFilterStatistics();
+
+    Assay assay_;
+
     const Scan* scan_; 
 
+    int numberOfThreads_;
+
+    int numberOfPrefetchedImages_;
+
+    bool resumeEnabled_;
+
+    bool incrementalEnabled_;
+
+    bool lowMemoryEnabled_;
+
+    volatile bool cancelled_;
+
+    // the time of the last CHECK_GUI event in seconds
+    double lastGuiCheckTime_;
+
+    // provides the buffers of the analysis images, declared before the
+    // pipelines using it
+    ImageBufferPool<RGBAImage> analysisImagePool_;
+
     WatershedFilterPipeline filterPipeline_;
 
+    std::vector<WatershedFilterPipeline*> workerPipelines_;
+
+    FilterStatisticsVector workerFilterStatistics_;
+
+    // the analysis images are written by an ImageWriterQueue instead of
+    // the file writers of the pipelines
+    FilterStatistics writingStatistics_;
+
+    // in seconds
+    double saveInterval_;
+
+    // the time of the last saving of the analysis in seconds
+    double lastSaveTime_;
+
+    // whether the analysis contains images which were not saved yet
+    bool unsavedAnalysis_;
+
 };
 
 }
@@ -29,51 +29,80 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include <itkCommand.h>
+#include <itksys/SystemTools.hxx>
+
+#include <WorkerPool.h>
 
 namespace PT 
 {
 
-std::string FEATURE_NAME_ARRAY[FEATURE_NUMBER] = 
+int getNumberOfRings(const Assay& assay)
 {
-"Ring 1 Mean Intensity",
-"Ring 2 Mean Intensity",
-"Center Mean Intensity",
-"Ring 1 Intensity Standard Deviation",
-"Ring 2 Intensity Standard Deviation",
-"Center Intensity Standard Deviation",
-"Ring 1 / Center Mean Intensity Ratio",
-"Ring 2 / Center Mean Intensity Ratio",
-"Ring 1 / Ring 2 Mean Intensity Ratio",
-"Ring 1 Area",
-"Ring 2 Area",
-"Center Area",
-"Cell Mean Intensity",
-"Cell Area"
-};
-const std::vector<std::string> FEATURE_NAMES(FEATURE_NAME_ARRAY, FEATURE_NAME_ARRAY + FEATURE_NUMBER);
+    return assay.getParameter(PARAMETER_NUMBER_OF_RINGS).getIntValue();
+}
 
-std::string SUBREGION_NAME_ARRAY[SUBREGION_NUMBER] = 
-{ 
-    "Ring 1", 
-    "Ring 2", 
-    "Center" 
-};
-const std::vector<std::string> SUBREGION_NAMES(SUBREGION_NAME_ARRAY, SUBREGION_NAME_ARRAY + SUBREGION_NUMBER);
+WatershedFeatures::WatershedFeatures(int numberOfRings) :
+    numberOfRings_(numberOfRings)
+{
+    assert(numberOfRings > 0 && numberOfRings <= MAX_NUMBER_OF_RINGS);
+}
+
+std::vector<std::string> WatershedFeatures::getFeatureNames() const
+{
+    std::vector<std::string> subregionNames = getSubregionNames();
+    std::vector<std::string> featureNames(getNumberOfFeatures());
+
+    for (int subregion = 0; subregion < getNumberOfSubregions(); ++subregion)
+    {
+        const std::string& subregionName = subregionNames[subregion];
+        featureNames[getMeanIntensity(subregion)] = subregionName + " Mean Intensity";
+        featureNames[getIntensityStandardDeviation(subregion)] = subregionName + " Intensity Standard Deviation";
+        featureNames[getArea(subregion)] = subregionName + " Area";
+    }
+
+    for (int ring = 0; ring < numberOfRings_; ++ring)
+    {
+        featureNames[getCenterMeanIntensityRatio(ring)] = 
+            subregionNames[ring] + " / " + subregionNames[getCenterSubregion()] + " Mean Intensity Ratio";
+    }
+
+    if (getRing1Ring2MeanIntensityRatio() >= 0)
+    {
+        featureNames[getRing1Ring2MeanIntensityRatio()] = 
+            subregionNames[0] + " / " + subregionNames[1] + " Mean Intensity Ratio";
+    }
+
+    featureNames[getCellMeanIntensity()] = "Cell Mean Intensity";
+    featureNames[getCellArea()] = "Cell Area";
+
+    return featureNames;
+}
+
+std::vector<std::string> WatershedFeatures::getSubregionNames() const
+{
+    std::vector<std::string> subregionNames;
+    for (int ring = 0; ring < numberOfRings_; ++ring)
+    {
+        std::stringstream subregionName;
+        subregionName << "Ring " << (ring + 1);
+        subregionNames.push_back(subregionName.str());
+    }
+    subregionNames.push_back("Center");
+    return subregionNames;
+}
 
 CellObservation* WatershedFilterPipeline::AnalysisFilter::createCellObservation(short time)
 {
-    CellObservation* cellObservation = new CellObservation(time, FEATURE_NUMBER);
+    CellObservation* cellObservation = new CellObservation(time, features_.getNumberOfFeatures());
     
-    cellObservation->setFeature(FEATURE_RING_1_AREA, 0);
-    cellObservation->setFeature(FEATURE_RING_2_AREA, 0);
-    cellObservation->setFeature(FEATURE_CENTER_AREA, 0);
-
-    cellObservation->setFeature(FEATURE_RING_1_MEAN_INTENSITY, 0);
-    cellObservation->setFeature(FEATURE_RING_2_MEAN_INTENSITY, 0);
-    cellObservation->setFeature(FEATURE_CENTER_MEAN_INTENSITY, 0);
+    for (int subregion = 0; subregion < features_.getNumberOfSubregions(); ++subregion)
+    {
+        cellObservation->setFeature(features_.getArea(subregion), 0);
+        cellObservation->setFeature(features_.getMeanIntensity(subregion), 0);
+    }
 
-    cellObservation->setFeature(FEATURE_CELL_AREA, 0);
-    cellObservation->setFeature(FEATURE_CELL_MEAN_INTENSITY, 0);
+    cellObservation->setFeature(features_.getCellArea(), 0);
+    cellObservation->setFeature(features_.getCellMeanIntensity(), 0);
 
     return cellObservation;
 }
@@ -84,72 +113,62 @@ void WatershedFilterPipeline::AnalysisFilter::computeSubregionFeatures(
         CellObservation* cellObservation)
 {
     float area = segmentStatistics.pixelCount;
-    float sum = segmentStatistics.intensitySum;
-    float sumOfSquares = segmentStatistics.intensitySumOfSquares;
+    double sum = segmentStatistics.intensitySum;
+    double sumOfSquares = segmentStatistics.intensitySumOfSquares;
 
     assert(area > 0);
 
     float mean = sum / area;
-    float standardDeviation = sqrt((sumOfSquares - (sum * sum) / area) / area);
 
-    switch (segmentKey.subId)
+    // rounding may leave a tiny negative variance for uniform segments
+    double variance = (sumOfSquares - (sum * sum) / area) / area;
+    float standardDeviation = variance > 0 ? sqrt(variance) : 0;
+
+    int subregion = segmentKey.subId;
+    if (subregion >= 0 && subregion < features_.getNumberOfSubregions())
     {
-        case SUBREGION_RING_1:
-        {
-            cellObservation->setFeature(FEATURE_RING_1_MEAN_INTENSITY, mean); 
-            cellObservation->setFeature(FEATURE_RING_1_INTENSITY_STANDARD_DEVIATION,
-                    standardDeviation); 
-            cellObservation->setFeature(FEATURE_RING_1_AREA, area); 
-            break;
-        }
-        case SUBREGION_RING_2:
-        {
-            cellObservation->setFeature(FEATURE_RING_2_MEAN_INTENSITY, mean); 
-            cellObservation->setFeature(FEATURE_RING_2_INTENSITY_STANDARD_DEVIATION,
-                    standardDeviation); 
-            cellObservation->setFeature(FEATURE_RING_2_AREA, area); 
-            break;
-        }
-        case SUBREGION_CENTER:
-        {
-            cellObservation->setFeature(FEATURE_CENTER_MEAN_INTENSITY, mean); 
-            cellObservation->setFeature(FEATURE_CENTER_INTENSITY_STANDARD_DEVIATION,
-                    standardDeviation); 
-            cellObservation->setFeature(FEATURE_CENTER_AREA, area); 
-            break;
-        }
+        cellObservation->setFeature(features_.getMeanIntensity(subregion), mean); 
+        cellObservation->setFeature(features_.getIntensityStandardDeviation(subregion),
+                standardDeviation); 
+        cellObservation->setFeature(features_.getArea(subregion), area); 
     }
 
-    float cellArea = cellObservation->getFeature(FEATURE_CELL_AREA) + area;
-    cellObservation->setFeature(FEATURE_CELL_AREA, cellArea); 
+    float cellArea = cellObservation->getFeature(features_.getCellArea()) + area;
+    cellObservation->setFeature(features_.getCellArea(), cellArea); 
 
-    float cellMean = cellObservation->getFeature(FEATURE_CELL_MEAN_INTENSITY) + sum;
-    cellObservation->setFeature(FEATURE_CELL_MEAN_INTENSITY, cellMean); 
+    float cellMean = cellObservation->getFeature(features_.getCellMeanIntensity()) + sum;
+    cellObservation->setFeature(features_.getCellMeanIntensity(), cellMean); 
 }
 
 void WatershedFilterPipeline::AnalysisFilter::computeCellFeatures(
         CellObservation* cellObservation)
 {
-    float cellArea = cellObservation->getFeature(FEATURE_CELL_AREA);
-    float cellMean = cellObservation->getFeature(FEATURE_CELL_MEAN_INTENSITY) / cellArea;
-    cellObservation->setFeature(FEATURE_CELL_MEAN_INTENSITY, cellMean); 
+    float cellArea = cellObservation->getFeature(features_.getCellArea());
+    float cellMean = cellObservation->getFeature(features_.getCellMeanIntensity()) / cellArea;
+    cellObservation->setFeature(features_.getCellMeanIntensity(), cellMean); 
 
-    float ring1Mean = cellObservation->getFeature(FEATURE_RING_1_MEAN_INTENSITY);
-    float ring2Mean = cellObservation->getFeature(FEATURE_RING_2_MEAN_INTENSITY);
-    float centerMean = cellObservation->getFeature(FEATURE_CENTER_MEAN_INTENSITY);
+    float centerMean = cellObservation->getFeature(
+            features_.getMeanIntensity(features_.getCenterSubregion()));
 
     if (centerMean > 0)
     {
-        cellObservation->setFeature(FEATURE_RING_1_CENTER_MEAN_INTENSITY_RATIO,
-                ring1Mean / centerMean);
-        cellObservation->setFeature(FEATURE_RING_2_CENTER_MEAN_INTENSITY_RATIO,
-                ring2Mean / centerMean);
+        for (int ring = 0; ring < features_.getNumberOfRings(); ++ring)
+        {
+            float ringMean = cellObservation->getFeature(features_.getMeanIntensity(ring));
+            cellObservation->setFeature(features_.getCenterMeanIntensityRatio(ring),
+                    ringMean / centerMean);
+        }
     }
 
-    if (ring2Mean > 0)
+    if (features_.getRing1Ring2MeanIntensityRatio() >= 0)
     {
-        cellObservation->setFeature(FEATURE_RING_1_RING_2_MEAN_INTENSITY_RATIO,
-                ring1Mean / ring2Mean);
+        float ring1Mean = cellObservation->getFeature(features_.getMeanIntensity(0));
+        float ring2Mean = cellObservation->getFeature(features_.getMeanIntensity(1));
+        if (ring2Mean > 0)
+        {
+            cellObservation->setFeature(features_.getRing1Ring2MeanIntensityRatio(),
+                    ring1Mean / ring2Mean);
+        }
     }
 }
 
@@ -161,24 +180,121 @@ void addObserver(WatershedFilterPipeline* filterPipeline, itk::ProcessObject* pr
     processObject->AddObserver(itk::ProgressEvent(), progressCommand);
 }
 
-WatershedFilterPipeline::WatershedFilterPipeline(const AnalysisMetadata& analysisMetadata)
+/**
+ * Measures the executions of a filter for the statistics of a pipeline.
+ * TImage is the type of the filter output or, for filters without output,
+ * of the filter input.
+ */
+template <class TImage>
+class FilterTimingCommand : public itk::Command
+{
+public:
+    typedef FilterTimingCommand Self;
+    typedef itk::Command Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+
+    itkNewMacro(Self);
+
+    void setFilter(WatershedFilterPipeline* filterPipeline, int filterIndex)
+    {
+        filterPipeline_ = filterPipeline;
+        filterIndex_ = filterIndex;
+    }
+
+    void Execute(itk::Object* caller, const itk::EventObject& event)
+    {
+        Execute((const itk::Object*) caller, event);
+    }
+
+    void Execute(const itk::Object* caller, const itk::EventObject& event)
+    {
+        if (itk::StartEvent().CheckEvent(&event))
+        {
+            filterPipeline_->startFilter(filterIndex_);
+        }
+        else if (itk::EndEvent().CheckEvent(&event))
+        {
+            itk::ProcessObject* processObject = 
+                const_cast<itk::ProcessObject*>(dynamic_cast<const itk::ProcessObject*>(caller));
+
+            const TImage* image = 0;
+            if (processObject->GetNumberOfOutputs() > 0)
+            {
+                image = dynamic_cast<const TImage*>(processObject->GetOutputs()[0].GetPointer());
+            }
+            else if (processObject->GetNumberOfInputs() > 0)
+            {
+                image = dynamic_cast<const TImage*>(processObject->GetInputs()[0].GetPointer());
+            }
+
+            unsigned long numberOfPixels = 0;
+            unsigned long outputBufferSize = 0;
+            if (image != 0)
+            {
+                numberOfPixels = image->GetBufferedRegion().GetNumberOfPixels();
+                if (processObject->GetNumberOfOutputs() > 0)
+                {
+                    outputBufferSize = numberOfPixels * sizeof(typename TImage::PixelType);
+                }
+            }
+
+            filterPipeline_->endFilter(filterIndex_, numberOfPixels, outputBufferSize);
+        }
+    }
+
+protected:
+
+    FilterTimingCommand() : filterPipeline_(0), filterIndex_(0) { }
+
+private:
+
+    WatershedFilterPipeline* filterPipeline_;
+
+    int filterIndex_;
+};
+
+void addFilterStatistics(FilterStatisticsVector& target, const FilterStatisticsVector& statistics)
+{
+    if (statistics.empty())
+    {
+        return;
+    }
+    else if (target.empty())
+    {
+        target = statistics;
+        return;
+    }
+
+    assert(target.size() == statistics.size());
+    for (unsigned int i = 0; i < statistics.size(); ++i)
+    {
+        target[i].add(statistics[i]);
+    }
+}
+
+WatershedFilterPipeline::WatershedFilterPipeline(const AnalysisMetadata& analysisMetadata) :
+    analysisImagePool_(0)
 {
     // create and initialize filters
     fileReader_ = FileReader::New();
 
-    shrinkFilter_ = ShrinkFilter::New();
-    shrinkFilter_->SetInput(fileReader_->GetOutput());
+    // the image is shrunk while it is read, so that the full-resolution
+    // image is not converted, and it is kept at its own precision until the
+    // diffusion filter converts it to float
+    shrinkingFileReader_ = ShrinkingFileReader::New();
 
     diffusionFilter_ = DiffusionFilter::New();
-    diffusionFilter_->SetInput(shrinkFilter_->GetOutput());
+    diffusionFilter_->SetInput(shrinkingFileReader_->GetOutput());
 
+    // the gradient magnitude is computed along with the sigmoid, the
+    // gradient filter only serves the visualization of the gradient
     gradientFilter_ = GradientFilter::New();
     gradientFilter_->SetInput(diffusionFilter_->GetOutput());
 
     sigmoidGradientFilter_ = SigmoidGradientFilter::New();
-    sigmoidGradientFilter_->SetOutputMinimum(0);
-    sigmoidGradientFilter_->SetOutputMaximum(1);
-    sigmoidGradientFilter_->SetInput(gradientFilter_->GetOutput());
+    sigmoidGradientFilter_->setOutputMinimum(0);
+    sigmoidGradientFilter_->setOutputMaximum(1);
+    sigmoidGradientFilter_->SetInput(diffusionFilter_->GetOutput());
 
     watershedFilter_ = WatershedFilter::New();
     watershedFilter_->SetInput(sigmoidGradientFilter_->GetOutput());
@@ -188,19 +304,33 @@ WatershedFilterPipeline::WatershedFilterPipeline(const AnalysisMetadata& analysi
     segmentSelectionAndMergingFilter_->SetInput(watershedFilter_->GetOutput());
 
     segmentRingsFilter_ = SegmentRingsFilter::New();
+    segmentRingsFilter_->setDistanceTransformEnabled(true);
     segmentRingsFilter_->SetInput(segmentSelectionAndMergingFilter_->GetOutput());
 
     analysisFilter_ = AnalysisFilter::New();
-    analysisFilter_->setIntensityInput(shrinkFilter_->GetOutput());
+    analysisFilter_->setIntensityInput(shrinkingFileReader_->GetOutput());
     analysisFilter_->setLabelInput(segmentRingsFilter_->GetOutput());
 
     fileWriter_ = FileWriter::New();
     fileWriter_->SetInput(analysisFilter_->GetOutput());
 
+    // keep the output buffers between images, so that they are only
+    // reallocated if an image is larger than the previous ones
+    {
+        fileReader_->SetReleaseDataBeforeUpdateFlag(false);
+        shrinkingFileReader_->SetReleaseDataBeforeUpdateFlag(false);
+        diffusionFilter_->SetReleaseDataBeforeUpdateFlag(false);
+        gradientFilter_->SetReleaseDataBeforeUpdateFlag(false);
+        sigmoidGradientFilter_->SetReleaseDataBeforeUpdateFlag(false);
+        segmentSelectionAndMergingFilter_->SetReleaseDataBeforeUpdateFlag(false);
+        segmentRingsFilter_->SetReleaseDataBeforeUpdateFlag(false);
+        analysisFilter_->SetReleaseDataBeforeUpdateFlag(false);
+    }
+
     // add observer to filters
     {
         addObserver(this, fileReader_);
-        addObserver(this, shrinkFilter_);
+        addObserver(this, shrinkingFileReader_);
         addObserver(this, diffusionFilter_);
         addObserver(this, gradientFilter_);
         addObserver(this, sigmoidGradientFilter_);
@@ -211,6 +341,17 @@ WatershedFilterPipeline::WatershedFilterPipeline(const AnalysisMetadata& analysi
         addObserver(this, fileWriter_);
     }
 
+    // measure filters
+    {
+        addTimingObserver<IntensityImage>(shrinkingFileReader_, "Reading");
+        addTimingObserver<FloatImage>(diffusionFilter_, "Diffusion");
+        addTimingObserver<FloatImage>(sigmoidGradientFilter_, "Gradient And Sigmoid");
+        addTimingObserver<ULongImage>(watershedFilter_, "Watershed");
+        addTimingObserver<ULongImage>(segmentSelectionAndMergingFilter_, "Selection And Merging");
+        addTimingObserver<ULongImage>(segmentRingsFilter_, "Rings");
+        addTimingObserver<RGBAImage>(analysisFilter_, "Analysis");
+    }
+
     // create analysis
     analysis_ = std::auto_ptr<Analysis>( new Analysis(analysisMetadata) );
     analysisFilter_->setAnalysis( analysis_.get() );
@@ -222,6 +363,7 @@ void WatershedFilterPipeline::setAssay(const Assay& assay)
     int shrinkFactor = assay.getParameter(PARAMETER_SHRINK_FACTOR).getIntValue();
     int diffusionNumberOfIterations = assay.getParameter(PARAMETER_NUMBER_OF_ITERATIONS).getIntValue();
     double diffusionConductance = assay.getParameter(PARAMETER_CONDUCTANCE).getDoubleValue();
+    bool fastDiffusionEnabled = assay.getParameter(PARAMETER_FAST_DIFFUSION).getBoolValue();
     double sigmoidAlpha = assay.getParameter(PARAMETER_SIGMOID_GRADIENT_ALPHA).getDoubleValue();
     double sigmoidBeta = assay.getParameter(PARAMETER_SIGMOID_GRADIENT_BETA).getDoubleValue();
     double threshold = assay.getParameter(PARAMETER_THRESHOLD).getDoubleValue();
@@ -230,20 +372,22 @@ void WatershedFilterPipeline::setAssay(const Assay& assay)
     int maximumCellArea = assay.getParameter(PARAMETER_MAXIMUM_CELL_AREA).getIntValue();
     int ringWidth1 = assay.getParameter(PARAMETER_RING_WIDTH_1).getIntValue();
     int ringWidth2 = assay.getParameter(PARAMETER_RING_WIDTH_2).getIntValue();
+    int numberOfRings = getNumberOfRings(assay);
     double maximumMatchingOffset = assay.getParameter(PARAMETER_MAX_MATCHING_OFFSET).getDoubleValue();
     int matchingPeriod = assay.getParameter(PARAMETER_MATCHING_PERIOD).getIntValue();
 
-    // update shrink filter
-    shrinkFilter_->SetShrinkFactors(shrinkFactor);
+    // update shrinking file reader
+    shrinkingFileReader_->setShrinkFactor(shrinkFactor);
 
     // update diffusion filter
     diffusionFilter_->SetNumberOfIterations(diffusionNumberOfIterations);
     diffusionFilter_->SetTimeStep(0.125); // standard value
     diffusionFilter_->SetConductanceParameter(diffusionConductance);
+    diffusionFilter_->setFastDiffusionEnabled(fastDiffusionEnabled);
 
     // update sigmoid gradient filter
-    sigmoidGradientFilter_->SetAlpha(sigmoidAlpha);
-    sigmoidGradientFilter_->SetBeta(sigmoidBeta);
+    sigmoidGradientFilter_->setAlpha(sigmoidAlpha);
+    sigmoidGradientFilter_->setBeta(sigmoidBeta);
 
     // update watershed filter
     watershedFilter_->SetThreshold(threshold);
@@ -253,18 +397,95 @@ void WatershedFilterPipeline::setAssay(const Assay& assay)
     segmentSelectionAndMergingFilter_->setMinimumSegmentSize(minimumCellArea);
     segmentSelectionAndMergingFilter_->setMaximumSegmentSize(maximumCellArea);
 
-    // update segment rings filter
-    segmentRingsFilter_->setRingWidth1(ringWidth1);
-    segmentRingsFilter_->setRingWidth2(ringWidth2);
+    // update segment rings filter, the rings following the first one share
+    // the second width
+    std::vector<int> ringWidths(numberOfRings, ringWidth2);
+    ringWidths[0] = ringWidth1;
+    segmentRingsFilter_->setRingWidths(ringWidths);
 
     // update analysis filter
     analysisFilter_->setMaxMatchingOffset((float)maximumMatchingOffset);
+    WatershedFeatures features(numberOfRings);
+    if (analysisFilter_->getFeatures().getNumberOfRings() != numberOfRings)
+    {
+        analysisFilter_->setFeatures(features);
+    }
+
+    // replace the analysis if its features do not match
+    std::vector<std::string> featureNames = features.getFeatureNames();
+    if (analysis_->getMetadata().featureNames != featureNames)
+    {
+        AnalysisMetadata analysisMetadata(
+                featureNames, 
+                features.getSubregionNames(), 
+                analysis_->getMetadata().baseDirectory);
+        analysis_ = std::auto_ptr<Analysis>( new Analysis(analysisMetadata) );
+        analysisFilter_->setAnalysis( analysis_.get() );
+    }
+}
+
+template <class TImage>
+void WatershedFilterPipeline::addTimingObserver(itk::ProcessObject* processObject, const std::string& filterName)
+{
+    typename FilterTimingCommand<TImage>::Pointer timingCommand = FilterTimingCommand<TImage>::New();
+    timingCommand->setFilter(this, imageStatistics_.size());
+    processObject->AddObserver(itk::StartEvent(), timingCommand);
+    processObject->AddObserver(itk::EndEvent(), timingCommand);
+
+    imageStatistics_.push_back(FilterStatistics(filterName));
+    totalStatistics_.push_back(FilterStatistics(filterName));
+    startWallTimes_.push_back(0.0);
+    startCpuTimes_.push_back(0.0);
+}
+
+void WatershedFilterPipeline::startFilter(int filterIndex)
+{
+    startWallTimes_[filterIndex] = itksys::SystemTools::GetTime();
+    startCpuTimes_[filterIndex] = getThreadCpuTime();
+}
+
+void WatershedFilterPipeline::endFilter(int filterIndex, unsigned long numberOfPixels, unsigned long outputBufferSize)
+{
+    FilterStatistics statistics(imageStatistics_[filterIndex].filterName);
+    statistics.numberOfExecutions = 1;
+    statistics.wallTime = itksys::SystemTools::GetTime() - startWallTimes_[filterIndex];
+    statistics.cpuTime = getThreadCpuTime() - startCpuTimes_[filterIndex];
+    statistics.numberOfPixels = numberOfPixels;
+    statistics.outputBufferSize = outputBufferSize;
+
+    imageStatistics_[filterIndex].add(statistics);
+    totalStatistics_[filterIndex].add(statistics);
+}
+
+void WatershedFilterPipeline::resetImageStatistics()
+{
+    for (unsigned int i = 0; i < imageStatistics_.size(); ++i)
+    {
+        imageStatistics_[i].reset();
+    }
 }
 
 void WatershedFilterPipeline::setImage(const ImageMetadata& imageMetadata)
 {
+    resetImageStatistics();
+
     const std::string& filepath = imageMetadata.filepath;
     fileReader_->SetFileName(filepath.c_str());
+    shrinkingFileReader_->setFileName(filepath);
+
+    analysisFilter_->setImage(imageMetadata.key);
+
+    std::string filePath = analysis_->getMetadata().getFilePath(imageMetadata.key);
+    fileWriter_->SetFileName(filePath);
+}
+
+void WatershedFilterPipeline::setImage(const ImageMetadata& imageMetadata, IntensityImage* image)
+{
+    assert(image != 0);
+
+    resetImageStatistics();
+
+    shrinkingFileReader_->setImage(image);
 
     analysisFilter_->setImage(imageMetadata.key);
 
@@ -272,6 +493,46 @@ void WatershedFilterPipeline::setImage(const ImageMetadata& imageMetadata)
     fileWriter_->SetFileName(filePath);
 }
 
+RGBAImage::Pointer WatershedFilterPipeline::generateAnalysisImage()
+{
+    if (analysisImagePool_ != 0)
+    {
+        analysisImagePool_->assignBuffer(analysisFilter_->GetOutput());
+    }
+    analysisFilter_->Update();
+
+    // the analysis filter creates a new output for the next update
+    RGBAImage::Pointer analysisImage = analysisFilter_->GetOutput();
+    analysisImage->DisconnectPipeline();
+    fileWriter_->SetInput(analysisFilter_->GetOutput());
+
+    return analysisImage;
+}
+
+void WatershedFilterPipeline::setNumberOfThreads(int numberOfThreads)
+{
+    assert(numberOfThreads > 0);
+
+    diffusionFilter_->SetNumberOfThreads(numberOfThreads);
+    gradientFilter_->SetNumberOfThreads(numberOfThreads);
+    sigmoidGradientFilter_->SetNumberOfThreads(numberOfThreads);
+    watershedFilter_->SetNumberOfThreads(numberOfThreads);
+    segmentSelectionAndMergingFilter_->SetNumberOfThreads(numberOfThreads);
+    segmentRingsFilter_->SetNumberOfThreads(numberOfThreads);
+    analysisFilter_->SetNumberOfThreads(numberOfThreads);
+}
+
+void WatershedFilterPipeline::setReleaseDataEnabled(bool releaseDataEnabled)
+{
+    fileReader_->GetOutput()->SetReleaseDataFlag(releaseDataEnabled);
+    diffusionFilter_->GetOutput()->SetReleaseDataFlag(releaseDataEnabled);
+    gradientFilter_->GetOutput()->SetReleaseDataFlag(releaseDataEnabled);
+    sigmoidGradientFilter_->GetOutput()->SetReleaseDataFlag(releaseDataEnabled);
+    watershedFilter_->GetOutput()->SetReleaseDataFlag(releaseDataEnabled);
+    segmentSelectionAndMergingFilter_->GetOutput()->SetReleaseDataFlag(releaseDataEnabled);
+    segmentRingsFilter_->GetOutput()->SetReleaseDataFlag(releaseDataEnabled);
+}
+
 void WatershedFilterPipeline::cancel()
 {
     fileWriter_->AbortGenerateDataOn();
@@ -282,10 +543,17 @@ void WatershedFilterPipeline::cancel()
     sigmoidGradientFilter_->AbortGenerateDataOn();
     gradientFilter_->AbortGenerateDataOn();
     diffusionFilter_->AbortGenerateDataOn();
-    shrinkFilter_->AbortGenerateDataOn();
+    shrinkingFileReader_->AbortGenerateDataOn();
     fileReader_->AbortGenerateDataOn();
 }
 
+void WatershedFilterPipeline::resetAnalysis()
+{
+    AnalysisMetadata analysisMetadata = analysis_->getMetadata();
+    analysis_ = std::auto_ptr<Analysis>( new Analysis(analysisMetadata) );
+    analysisFilter_->setAnalysis( analysis_.get() );
+}
+
 void WatershedFilterPipeline::handleProgressEvent(const itk::EventObject& eventObject)
 {
     notifyEventHandler(FilterProgressEvent());
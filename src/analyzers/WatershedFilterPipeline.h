@@ -28,58 +28,34 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <itkEventObject.h>
-#include <itkGradientAnisotropicDiffusionImageFilter.h>
 #include <itkGradientMagnitudeImageFilter.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkImageToImageFilter.h>
-#include <itkShrinkImageFilter.h>
-#include <itkSigmoidImageFilter.h>
 #include <itkWatershedImageFilter.h>
 
 #include <Analysis.h>
 #include <Analyzer.h>
+#include <ImageBufferPool.h>
 #include <Scan.h>
 #include <filters/AnalysisImageFilter.h>
+#include <filters/FastGradientAnisotropicDiffusionImageFilter.h>
+#include <filters/GradientMagnitudeSigmoidImageFilter.h>
 #include <filters/SegmentRingsImageFilter.h>
 #include <filters/SegmentSelectionAndMergingImageFilter.h>
 #include <images.h>
+#include <io/ShrinkingImageFileReader.h>
 
 namespace PT 
 {
 
-const int FEATURE_NUMBER = 14;
-
-const int FEATURE_RING_1_MEAN_INTENSITY = 0;
-const int FEATURE_RING_2_MEAN_INTENSITY = 1;
-const int FEATURE_CENTER_MEAN_INTENSITY = 2;
-const int FEATURE_RING_1_INTENSITY_STANDARD_DEVIATION = 3;
-const int FEATURE_RING_2_INTENSITY_STANDARD_DEVIATION = 4;
-const int FEATURE_CENTER_INTENSITY_STANDARD_DEVIATION = 5;
-const int FEATURE_RING_1_CENTER_MEAN_INTENSITY_RATIO = 6;
-const int FEATURE_RING_2_CENTER_MEAN_INTENSITY_RATIO = 7;
-const int FEATURE_RING_1_RING_2_MEAN_INTENSITY_RATIO = 8;
-const int FEATURE_RING_1_AREA = 9;
-const int FEATURE_RING_2_AREA = 10;
-const int FEATURE_CENTER_AREA = 11;
-const int FEATURE_CELL_MEAN_INTENSITY = 12;
-const int FEATURE_CELL_AREA = 13;
-
-extern const std::vector<std::string> FEATURE_NAMES;
-
-static const int SUBREGION_NUMBER = 3;
-
-static const int SUBREGION_RING_1 = 0;
-static const int SUBREGION_RING_2 = 1;
-static const int SUBREGION_CENTER = 2;
-
-extern const std::vector<std::string> SUBREGION_NAMES;
-
 static const std::string PARAMETER_SHRINK_FACTOR("Shrink Factor");
 static const std::string PARAMETER_NUMBER_OF_ITERATIONS("Number Of Iterations");
 static const std::string PARAMETER_CONDUCTANCE("Conductance");
+static const std::string PARAMETER_FAST_DIFFUSION("Fast Diffusion");
 static const std::string PARAMETER_SIGMOID_GRADIENT_ALPHA("Sigmoid Grad. Alpha");
 static const std::string PARAMETER_SIGMOID_GRADIENT_BETA("Sigmoid Grad. Beta");
 static const std::string PARAMETER_THRESHOLD("Threshold");
@@ -88,23 +64,232 @@ static const std::string PARAMETER_MINIMUM_CELL_AREA("Minimum Cell Area");
 static const std::string PARAMETER_MAXIMUM_CELL_AREA("Maximum Cell Area");
 static const std::string PARAMETER_RING_WIDTH_1("Ring Width 1");
 static const std::string PARAMETER_RING_WIDTH_2("Ring Width 2");
+static const std::string PARAMETER_NUMBER_OF_RINGS("Number Of Rings");
 static const std::string PARAMETER_MAX_MATCHING_OFFSET("Max. Matching Offset");
 static const std::string PARAMETER_MATCHING_PERIOD("Matching Period");
 
+static const int DEFAULT_NUMBER_OF_RINGS = 2;
+static const int MAX_NUMBER_OF_RINGS = 20;
+
+/**
+ * Returns the number of rings of the assay.
+ */
+int getNumberOfRings(const Assay& assay);
+
+/**
+ * The WatershedFeatures describe the features of the cells found by the
+ * watershed pipeline.  Every cell is divided into a number of rings and a
+ * center, which are the subregions of the analysis.  The features are grouped
+ * by kind, each group listing the rings from the outside to the inside
+ * followed by the center.  With two rings, the features are the same as the
+ * ones of analyses created before the number of rings could be chosen.
+ */
+class WatershedFeatures
+{
+public:
+
+    WatershedFeatures(int numberOfRings);
+
+    int getNumberOfRings() const
+    {
+        return numberOfRings_;
+    }
+
+    int getNumberOfSubregions() const
+    {
+        return numberOfRings_ + 1;
+    }
+
+    int getCenterSubregion() const
+    {
+        return numberOfRings_;
+    }
+
+    int getNumberOfFeatures() const
+    {
+        return getCellArea() + 1;
+    }
+
+    int getMeanIntensity(int subregion) const
+    {
+        return subregion;
+    }
+
+    int getIntensityStandardDeviation(int subregion) const
+    {
+        return getNumberOfSubregions() + subregion;
+    }
+
+    int getCenterMeanIntensityRatio(int ring) const
+    {
+        return 2 * getNumberOfSubregions() + ring;
+    }
+
+    /**
+     * Returns -1 if there are less than two rings.
+     */
+    int getRing1Ring2MeanIntensityRatio() const
+    {
+        return (numberOfRings_ < 2) ? -1 : 2 * getNumberOfSubregions() + numberOfRings_;
+    }
+
+    int getArea(int subregion) const
+    {
+        int numberOfRatios = numberOfRings_ + ((numberOfRings_ < 2) ? 0 : 1);
+        return 2 * getNumberOfSubregions() + numberOfRatios + subregion;
+    }
+
+    int getCellMeanIntensity() const
+    {
+        return getArea(getCenterSubregion()) + 1;
+    }
+
+    int getCellArea() const
+    {
+        return getCellMeanIntensity() + 1;
+    }
+
+    std::vector<std::string> getFeatureNames() const;
+
+    std::vector<std::string> getSubregionNames() const;
+
+private:
+
+    int numberOfRings_;
+};
+
 class FilterProgressEvent { };
 
+/**
+ * The time and throughput of a filter of the pipeline, summed over its
+ * executions.  The CPU time is the one of the thread executing the filter,
+ * see getThreadCpuTime(), so it does not include the additional threads of
+ * multithreaded filters.
+ */
+struct FilterStatistics
+{
+    std::string filterName;
+
+    int numberOfExecutions;
+
+    // in seconds
+    double wallTime;
+
+    // in seconds
+    double cpuTime;
+
+    // the number of pixels produced, or consumed by filters without output
+    double numberOfPixels;
+
+    // the largest output buffer in bytes
+    unsigned long outputBufferSize;
+
+    FilterStatistics(const std::string& filterName_) :
+        filterName(filterName_),
+        numberOfExecutions(0),
+        wallTime(0.0),
+        cpuTime(0.0),
+        numberOfPixels(0.0),
+        outputBufferSize(0)
+    {}
+
+    double getPixelsPerSecond() const
+    {
+        return wallTime > 0.0 ? numberOfPixels / wallTime : 0.0;
+    }
+
+    void add(const FilterStatistics& statistics)
+    {
+        numberOfExecutions += statistics.numberOfExecutions;
+        wallTime += statistics.wallTime;
+        cpuTime += statistics.cpuTime;
+        numberOfPixels += statistics.numberOfPixels;
+        if (statistics.outputBufferSize > outputBufferSize)
+            outputBufferSize = statistics.outputBufferSize;
+    }
+
+    void reset()
+    {
+        numberOfExecutions = 0;
+        wallTime = 0.0;
+        cpuTime = 0.0;
+        numberOfPixels = 0.0;
+        outputBufferSize = 0;
+    }
+};
+
+typedef std::vector<FilterStatistics> FilterStatisticsVector;
+
+/**
+ * Adds the statistics of every filter to those of the filter with the same
+ * index, e.g. to combine the statistics of several pipelines.  An empty
+ * target receives a copy.
+ */
+void addFilterStatistics(FilterStatisticsVector& target, const FilterStatisticsVector& statistics);
+
 class WatershedFilterPipeline : public EventGenerator<FilterProgressEvent>
 {
 public:
 
     WatershedFilterPipeline(const AnalysisMetadata& analysisMetadata);
     
+    /**
+     * Sets the parameters of the filters.  If the number of rings of the
+     * assay does not match the features of the analysis, the analysis is
+     * replaced by an empty one with the features of the assay.
+     */
     void setAssay(const Assay& assay);
 
     void setImage(const ImageMetadata& imageMetadata);
 
+    /**
+     * Sets an image which was already read and shrunk by the shrink factor
+     * of the assay, e.g. by an ImagePrefetcher.  The file reader of the
+     * pipeline is bypassed until the next call of
+     * setImage(const ImageMetadata&).
+     */
+    void setImage(const ImageMetadata& imageMetadata, IntensityImage* image);
+
+    /**
+     * Sets the number of threads used by each multithreaded filter of the
+     * pipeline.
+     */
+    void setNumberOfThreads(int numberOfThreads);
+
+    /**
+     * If enabled, the outputs of the filters are released as soon as the
+     * following filter has processed them.  The output of the shrink filter
+     * is kept, as it is read by the analysis filter as well.  Visualizers
+     * must not enable this, since they show the intermediate images.
+     */
+    void setReleaseDataEnabled(bool releaseDataEnabled);
+
+    /**
+     * Sets the pool providing the buffers of the analysis images returned by
+     * generateAnalysisImage().  The pool may be shared by several pipelines
+     * and must outlive them.  Without a pool, every analysis image allocates
+     * a buffer of its own.
+     */
+    void setAnalysisImagePool(ImageBufferPool<RGBAImage>* analysisImagePool)
+    {
+        analysisImagePool_ = analysisImagePool;
+    }
+
+    /**
+     * Updates the pipeline up to the analysis filter and returns its output
+     * disconnected from the pipeline, so that it can be written in the
+     * background while the next image is processed.
+     */
+    RGBAImage::Pointer generateAnalysisImage();
+
     void cancel();
 
+    /**
+     * Replaces the analysis by an empty one with the same metadata, e.g.
+     * because it was left incomplete by a failed analysis.
+     */
+    void resetAnalysis();
+
     Analysis* getAnalysis()
     {
         return analysis_.get();
@@ -112,30 +297,72 @@ public:
 
     void handleProgressEvent(const itk::EventObject& eventObject);
 
+    /**
+     * Returns the statistics of the filters for the current image, in the
+     * order of the pipeline.
+     */
+    const FilterStatisticsVector& getImageStatistics() const
+    {
+        return imageStatistics_;
+    }
+
+    /**
+     * Returns the statistics of the filters for all images processed so
+     * far, in the order of the pipeline.
+     */
+    const FilterStatisticsVector& getTotalStatistics() const
+    {
+        return totalStatistics_;
+    }
+
+    /**
+     * Called by the observers of the filters when the filter with the given
+     * index starts and ends generating its output.
+     */
+    void startFilter(int filterIndex);
+    void endFilter(int filterIndex, unsigned long numberOfPixels, unsigned long outputBufferSize);
+
     // filter type definitions
     typedef itk::ImageFileReader<FloatImage> FileReader;
-    typedef itk::ShrinkImageFilter<FloatImage, FloatImage> ShrinkFilter;
-    typedef itk::GradientAnisotropicDiffusionImageFilter<FloatImage, FloatImage> DiffusionFilter;
+    typedef ShrinkingImageFileReader<IntensityImage> ShrinkingFileReader;
+    typedef FastGradientAnisotropicDiffusionImageFilter<IntensityImage, FloatImage> DiffusionFilter;
     typedef itk::GradientMagnitudeImageFilter<FloatImage, FloatImage> GradientFilter;
-    typedef itk::SigmoidImageFilter<FloatImage, FloatImage> SigmoidGradientFilter;
+    typedef GradientMagnitudeSigmoidImageFilter<FloatImage> SigmoidGradientFilter;
     typedef itk::WatershedImageFilter<FloatImage> WatershedFilter;
     typedef SegmentSelectionAndMergingImageFilter<ULongImage> SegmentSelectionAndMergingFilter;
     typedef SegmentRingsImageFilter<ULongImage, SegmentSelectionAndMergingFilter::LabelToSegmentKeyFunctor> SegmentRingsFilter;
     typedef itk::ImageFileWriter<RGBAImage> FileWriter;
 
-    class AnalysisFilter : public AnalysisImageFilter<FloatImage, ULongImage, SegmentRingsFilter::LabelToSegmentKeyFunctor> 
+    class AnalysisFilter : public AnalysisImageFilter<IntensityImage, ULongImage, SegmentRingsFilter::LabelToSegmentKeyFunctor> 
     {
     public:
         typedef AnalysisFilter Self;
-        typedef AnalysisImageFilter<FloatImage, ULongImage, SegmentRingsFilter::LabelToSegmentKeyFunctor> Superclass;
+        typedef AnalysisImageFilter<IntensityImage, ULongImage, SegmentRingsFilter::LabelToSegmentKeyFunctor> Superclass;
         typedef itk::SmartPointer<Self> Pointer;
         typedef itk::SmartPointer<const Self> ConstPointer;
 
         itkNewMacro(Self);
         itkTypeMacro(AnalysisFilter, AnalysisImageFilter);
 
+        void setFeatures(const WatershedFeatures& features)
+        {
+            features_ = features;
+            this->setNumberOfSubregions(features_.getNumberOfSubregions());
+            this->Modified();
+        }
+
+        const WatershedFeatures& getFeatures() const
+        {
+            return features_;
+        }
+
     protected:
 
+        AnalysisFilter() : features_(DEFAULT_NUMBER_OF_RINGS)
+        {
+            this->setNumberOfSubregions(features_.getNumberOfSubregions());
+        }
+
         virtual CellObservation* createCellObservation(short time);
 
         virtual void computeSubregionFeatures(
@@ -145,10 +372,15 @@ public:
 
         virtual void computeCellFeatures(
                 CellObservation* cellObservation);
+
+    private:
+
+        WatershedFeatures features_;
     };
 
+    // the full-resolution image is only read for its visualization
     FileReader::Pointer fileReader_;
-    ShrinkFilter::Pointer shrinkFilter_;
+    ShrinkingFileReader::Pointer shrinkingFileReader_;
     DiffusionFilter::Pointer diffusionFilter_;
     GradientFilter::Pointer gradientFilter_;
     SigmoidGradientFilter::Pointer sigmoidGradientFilter_;
@@ -160,6 +392,23 @@ public:
 
     std::auto_ptr<Analysis> analysis_;
 
+private:
+
+    template <class TImage>
+    void addTimingObserver(itk::ProcessObject* processObject, const std::string& filterName);
+
+    void resetImageStatistics();
+
+    ImageBufferPool<RGBAImage>* analysisImagePool_;
+
+    FilterStatisticsVector imageStatistics_;
+
+    FilterStatisticsVector totalStatistics_;
+
+    std::vector<double> startWallTimes_;
+
+    std::vector<double> startCpuTimes_;
+
 };
 
 }
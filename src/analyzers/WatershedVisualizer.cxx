@@ -46,26 +46,30 @@ static const std::string VISUALIZATION_RINGS("Rings");
 static const std::string VISUALIZATION_ANALYSIS("Analysis");
 
 WatershedVisualizer::WatershedVisualizer() : filterPipeline_(
-        AnalysisMetadata( FEATURE_NAMES, SUBREGION_NAMES, "") ) 
+        AnalysisMetadata( 
+            WatershedFeatures(DEFAULT_NUMBER_OF_RINGS).getFeatureNames(), 
+            WatershedFeatures(DEFAULT_NUMBER_OF_RINGS).getSubregionNames(), 
+            "") ) 
 {
     rescaleIntensityRGBFilter_ = RescaleIntensityRGBImageFilter<FloatImage>::New();
 
     thresholdVisualizationFilter_ = ThresholdVisualizationImageFilter<FloatImage>::New();
     thresholdVisualizationFilter_->SetInput(filterPipeline_.sigmoidGradientFilter_->GetOutput());
+    thresholdVisualizationFilter_->setIntensityRangeSource(filterPipeline_.sigmoidGradientFilter_.GetPointer());
 
     watershedVisualizationFilter_ = WatershedVisualizationFilter::New();
     watershedVisualizationFilter_->SetInput(filterPipeline_.watershedFilter_->GetOutput());
 
     cellsVisualizationFilter_ = CellsVisualizationFilter::New();
-    cellsVisualizationFilter_->SetSourceInput(filterPipeline_.shrinkFilter_->GetOutput());
+    cellsVisualizationFilter_->SetSourceInput(filterPipeline_.shrinkingFileReader_->GetOutput());
     cellsVisualizationFilter_->SetLabelInput(filterPipeline_.segmentSelectionAndMergingFilter_->GetOutput());
 
     ringsVisualizationFilter_ = RingsVisualizationFilter::New();
-    ringsVisualizationFilter_->SetSourceInput(filterPipeline_.shrinkFilter_->GetOutput());
+    ringsVisualizationFilter_->SetSourceInput(filterPipeline_.shrinkingFileReader_->GetOutput());
     ringsVisualizationFilter_->SetLabelInput(filterPipeline_.segmentRingsFilter_->GetOutput());
 
     analysisVisualizationFilter_ = AnalysisVisualizationFilter::New();
-    analysisVisualizationFilter_->SetSourceInput(filterPipeline_.shrinkFilter_->GetOutput());
+    analysisVisualizationFilter_->SetSourceInput(filterPipeline_.shrinkingFileReader_->GetOutput());
     analysisVisualizationFilter_->SetLabelInput(filterPipeline_.analysisFilter_->GetOutput());
 }
 
@@ -151,10 +155,12 @@ public:
         RGBAImage::ConstPointer analysisImage, 
         RGBImage::ConstPointer visualizationImage, 
         const ImageKey& imageKey,
-        Analysis* analysis) :
+        Analysis* analysis,
+        const WatershedFeatures& features) :
             Visualization(visualizationImage, imageKey),
             analysisImage_(analysisImage),
-            analysis_(analysis)
+            analysis_(analysis),
+            features_(features)
     {
         assert(analysisImage->GetLargestPossibleRegion() == visualizationImage->GetLargestPossibleRegion());
     }
@@ -183,38 +189,15 @@ public:
 
                 Cell* cell = analysis_->getCell(cellId);
                 CellObservation* cellObservation = cell->getObservation(imageKey_.time);
-                switch (subregionIndex)
+                if (subregionIndex < features_.getNumberOfSubregions())
                 {
-                    case SUBREGION_RING_1:
-                        {
-                            text << "  -  " << metadata.featureNames[FEATURE_RING_1_AREA];
-                            text << ": " << cellObservation->getFeature(FEATURE_RING_1_AREA);
-
-                            text << "  -  " << metadata.featureNames[FEATURE_RING_1_MEAN_INTENSITY];
-                            text << ": " << cellObservation->getFeature(FEATURE_RING_1_MEAN_INTENSITY);
-
-                            break;
-                        }
-                    case SUBREGION_RING_2:
-                        {
-                            text << "  -  " << metadata.featureNames[FEATURE_RING_2_AREA];
-                            text << ": " << cellObservation->getFeature(FEATURE_RING_2_AREA);
-
-                            text << "  -  " << metadata.featureNames[FEATURE_RING_2_MEAN_INTENSITY];
-                            text << ": " << cellObservation->getFeature(FEATURE_RING_2_MEAN_INTENSITY);
+                    int areaFeature = features_.getArea(subregionIndex);
+                    text << "  -  " << metadata.featureNames[areaFeature];
+                    text << ": " << cellObservation->getFeature(areaFeature);
 
-                            break;
-                        }
-                    case SUBREGION_CENTER:
-                        {
-                            text << "  -  " << metadata.featureNames[FEATURE_CENTER_AREA];
-                            text << ": " << cellObservation->getFeature(FEATURE_CENTER_AREA);
-
-                            text << "  -  " << metadata.featureNames[FEATURE_CENTER_MEAN_INTENSITY];
-                            text << ": " << cellObservation->getFeature(FEATURE_CENTER_MEAN_INTENSITY);
-
-                            break;
-                        }
+                    int meanIntensityFeature = features_.getMeanIntensity(subregionIndex);
+                    text << "  -  " << metadata.featureNames[meanIntensityFeature];
+                    text << ": " << cellObservation->getFeature(meanIntensityFeature);
                 }
         }
         else
@@ -235,6 +218,8 @@ private:
     RGBAImage::ConstPointer analysisImage_;
 
     Analysis* analysis_;
+
+    WatershedFeatures features_;
 };
 
 std::auto_ptr<Visualization> WatershedVisualizer::createVisualization(
@@ -467,7 +452,8 @@ std::auto_ptr<Visualization> WatershedVisualizer::createVisualization(
                     analysisImage, 
                     visualizationImage, 
                     imageMetadata.key, 
-                    analysis));
+                    analysis,
+                    filterPipeline_.analysisFilter_->getFeatures()));
         }
         else
         {
@@ -55,9 +55,9 @@ public:
 private:
 
     typedef LabelVisualizationImageFilter<ULongImage> WatershedVisualizationFilter;
-    typedef SegmentVisualizationImageFilter<FloatImage, ULongImage, WatershedFilterPipeline::SegmentSelectionAndMergingFilter::LabelToSegmentKeyFunctor> CellsVisualizationFilter;
-    typedef SegmentVisualizationImageFilter<FloatImage, ULongImage, WatershedFilterPipeline::SegmentRingsFilter::LabelToSegmentKeyFunctor> RingsVisualizationFilter;
-    typedef SegmentVisualizationImageFilter<FloatImage, RGBAImage, WatershedFilterPipeline::AnalysisFilter::LabelToSegmentKeyFunctor> AnalysisVisualizationFilter;
+    typedef SegmentVisualizationImageFilter<IntensityImage, ULongImage, WatershedFilterPipeline::SegmentSelectionAndMergingFilter::LabelToSegmentKeyFunctor> CellsVisualizationFilter;
+    typedef SegmentVisualizationImageFilter<IntensityImage, ULongImage, WatershedFilterPipeline::SegmentRingsFilter::LabelToSegmentKeyFunctor> RingsVisualizationFilter;
+    typedef SegmentVisualizationImageFilter<IntensityImage, RGBAImage, WatershedFilterPipeline::AnalysisFilter::LabelToSegmentKeyFunctor> AnalysisVisualizationFilter;
 
     WatershedFilterPipeline filterPipeline_;
 
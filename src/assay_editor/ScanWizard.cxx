@@ -451,10 +451,12 @@ void ScanDialog::updateStatus(Fl_Widget *widget)
         static const char *IMAGE_FILE_PATTERN = "{*.tif|*.png}";
 
         const char *directory = directoryInput_->value();
-        int wellIndex = (int)wellCounter_->value();
-        int positionIndex = (int)positionCounter_->value();
-        int slideIndex = (int)slideCounter_->value();
-        int timeIndex = (int)timeCounter_->value();
+
+        PT::ImageFilenameFormat format;
+        format.wellIndex = (int)wellCounter_->value();
+        format.positionIndex = (int)positionCounter_->value();
+        format.slideIndex = (int)slideCounter_->value();
+        format.timeIndex = (int)timeCounter_->value();
 
         fileList_.clear();
 
@@ -502,55 +504,7 @@ void ScanDialog::updateStatus(Fl_Widget *widget)
             {
                 FileItem& fileItem = *it;
 
-                // parse tokens
-                vector<int> tokens;
-                {
-                    string token;
-                    string::const_iterator it = fileItem.filename.begin();
-                    string::const_iterator end = fileItem.filename.end();
-                    for(;it != end; it++)
-                    {
-                        char c = *it;
-                        if (c >= '0' && c <= '9') {
-                            token += *it;
-                        }
-                        else
-                        {
-                            if (token.size() > 0)
-                            {
-                                int value = atoi(token.c_str()); 
-                                tokens.push_back(value);
-                                token.clear();
-                            }
-                        }
-                    }
-                }
-
-                if (wellIndex == 0)
-                    fileItem.key.location.well = 0;
-                else if (wellIndex >= 1 && wellIndex <= tokens.size())
-                    fileItem.key.location.well = tokens[wellIndex-1];
-                else
-                    fileItem.valid = false;
-
-                if (positionIndex == 0)
-                    fileItem.key.location.position = 0;
-                else if (positionIndex >= 1 && positionIndex <= tokens.size())
-                    fileItem.key.location.position = tokens[positionIndex-1];
-                else
-                    fileItem.valid = false;
-
-                if (slideIndex == 0)
-                    fileItem.key.location.slide = 0;
-                else if (slideIndex >= 1 && slideIndex <= tokens.size())
-                    fileItem.key.location.slide = tokens[slideIndex-1];
-                else
-                    fileItem.valid = false;
-
-                if (timeIndex >= 1 && timeIndex <= tokens.size())
-                    fileItem.key.time = tokens[timeIndex-1];
-                else
-                    fileItem.valid = false;
+                fileItem.valid = PT::parseImageFilename(fileItem.filename, format, fileItem.key);
 
                 if (! fileItem.valid)
                     fileListStatus_ = STATUS_INVALID_INDEX;
@@ -195,7 +195,8 @@ AssayRunner::AssayRunner() : Fl_Double_Window(600, 500, "Protein Tracer:  Assay
 
 void AssayRunner::handleEvent(const PT::AnalyzerEvent &event)
 {
-    if (event.getId() == PT::AnalyzerEvent::MESSAGE)
+    if (event.getId() == PT::AnalyzerEvent::MESSAGE ||
+        event.getId() == PT::AnalyzerEvent::ERROR_MESSAGE)
     {
         logMessage(event.getMessage());
     }
@@ -0,0 +1,456 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <itkMultiThreader.h>
+#include <itksys/SystemTools.hxx>
+
+#include <Analyzer.h>
+#include <analyzers/AnalyzerRegistry.h>
+#include <common.h>
+#include <io/AssayIO.h>
+#include <io/ScanIO.h>
+#include <io/ScanWatcher.h>
+
+// set by the signal handler, which must not do anything else
+static volatile sig_atomic_t interrupted = 0;
+
+static void handleInterrupt(int signalNumber)
+{
+    interrupted = 1;
+}
+
+/**
+ * Prints the events of an analyzer to the console.  Error messages are
+ * remembered, so that the exit code can reflect the outcome of the analysis.
+ * The analyzer is cancelled with the first event after an interrupt.
+ */
+class ConsoleEventHandler : public PT::EventHandler<PT::AnalyzerEvent>
+{
+public:
+
+    ConsoleEventHandler() : analyzer_(0), lastPercentage_(-1), failed_(false) { }
+
+    /**
+     * Sets the analyzer which is cancelled on an interrupt.
+     */
+    void setAnalyzer(PT::Analyzer* analyzer)
+    {
+        analyzer_ = analyzer;
+    }
+
+    void handleEvent(const PT::AnalyzerEvent &event)
+    {
+        if (interrupted && analyzer_ != 0)
+        {
+            analyzer_->cancel();
+            analyzer_ = 0;
+        }
+
+        switch (event.getId())
+        {
+            case PT::AnalyzerEvent::MESSAGE:
+            {
+                std::cout << event.getMessage() << std::flush;
+                break;
+            }
+            case PT::AnalyzerEvent::ERROR_MESSAGE:
+            {
+                std::cerr << event.getMessage() << std::flush;
+                failed_ = true;
+                break;
+            }
+            case PT::AnalyzerEvent::PROGRESS:
+            {
+                int percentage = (int)(event.getProgress() * 100);
+                if (percentage != lastPercentage_)
+                {
+                    std::cout << "progress: " << percentage << "%" << std::endl;
+                    lastPercentage_ = percentage;
+                }
+                break;
+            }
+            default:
+            {
+                // there is no user interface to keep responsive
+                break;
+            }
+        }
+    }
+
+    bool hasFailed() const
+    {
+        return failed_;
+    }
+
+private:
+
+    PT::Analyzer* analyzer_;
+
+    int lastPercentage_;
+
+    bool failed_;
+};
+
+struct AnalyzerOptions
+{
+    int numberOfThreads;
+    int numberOfPrefetchedImages;
+    bool resumeEnabled;
+    bool incrementalEnabled;
+    bool lowMemoryEnabled;
+
+    AnalyzerOptions() : 
+        numberOfThreads(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()),
+        numberOfPrefetchedImages(-1),
+        resumeEnabled(false),
+        incrementalEnabled(false),
+        lowMemoryEnabled(false)
+    {}
+};
+
+// time after which the watching is interrupted to check for a cancellation
+static const int WATCH_TIMEOUT_MILLISECONDS = 1000;
+
+// minimum time between two savings of a watched analysis in seconds, as
+// saving takes longer the more images were acquired
+static const double WATCH_SAVE_INTERVAL = 60.0;
+
+static std::auto_ptr<PT::Analyzer> createAnalyzer(
+        const PT::Assay& assay, 
+        PT::Scan* scan, 
+        const std::string& analysisDirectory, 
+        const AnalyzerOptions& options, 
+        ConsoleEventHandler& eventHandler)
+{
+    std::auto_ptr<PT::Analyzer> analyzer = 
+        PT::AnalyzerRegistry::createAnalyzer(assay, scan, analysisDirectory);
+    analyzer->setEventHandler(&eventHandler);
+    analyzer->setNumberOfThreads(options.numberOfThreads);
+    if (options.numberOfPrefetchedImages >= 0)
+    {
+        analyzer->setNumberOfPrefetchedImages(options.numberOfPrefetchedImages);
+    }
+    analyzer->setResumeEnabled(options.resumeEnabled);
+    analyzer->setIncrementalEnabled(options.incrementalEnabled);
+    analyzer->setLowMemoryEnabled(options.lowMemoryEnabled);
+
+    return analyzer;
+}
+
+static void runAnalyzer(PT::Analyzer* analyzer, ConsoleEventHandler& eventHandler)
+{
+    eventHandler.setAnalyzer(analyzer);
+    analyzer->process();
+    eventHandler.setAnalyzer(0);
+}
+
+/**
+ * Analyzes the images written into the image directory as soon as they are
+ * complete, until the program is interrupted.  Each batch of new images is
+ * appended to the analysis and the scan of all images is saved to the scan
+ * file.  The analyzer keeps the analysis in memory between the batches and
+ * saves it at most every WATCH_SAVE_INTERVAL seconds and when the watching
+ * ends.  If a batch is cancelled, the batches after the last saving are
+ * analyzed again by the next incremental run.
+ */
+static int watchImageDirectory(
+        const std::string& imageDirectory, 
+        const PT::ImageFilenameFormat& filenameFormat,
+        short firstTime,
+        const std::string& scanFile,
+        const PT::Assay& assay, 
+        const std::string& analysisDirectory, 
+        AnalyzerOptions options)
+{
+    std::auto_ptr<PT::ScanWatcher> scanWatcher;
+    try
+    {
+        scanWatcher.reset(new PT::ScanWatcher(imageDirectory, filenameFormat, firstTime));
+    }
+    catch (PT::IOException& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    // the images are appended to the analysis, which might also have been
+    // created by a previous run
+    options.resumeEnabled = false;
+    options.incrementalEnabled = true;
+
+    std::cout << "watching " << imageDirectory << std::endl;
+
+    PT::Scan scan;
+    ConsoleEventHandler eventHandler;
+    std::auto_ptr<PT::Analyzer> analyzer = 
+        createAnalyzer(assay, &scan, analysisDirectory, options, eventHandler);
+    analyzer->setSaveInterval(WATCH_SAVE_INTERVAL);
+    while (! interrupted && ! eventHandler.hasFailed())
+    {
+        try
+        {
+            int numberOfNewImages = scanWatcher->waitForImages(scan, WATCH_TIMEOUT_MILLISECONDS);
+
+            std::vector<std::string> droppedFilenames = scanWatcher->takeDroppedFilenames();
+            for (unsigned int i = 0; i < droppedFilenames.size(); ++i)
+            {
+                std::cerr << "ignoring image completed too late: " << droppedFilenames[i] << std::endl;
+            }
+
+            if (numberOfNewImages == 0 || interrupted)
+            {
+                continue;
+            }
+
+            std::cout << "analyzing " << numberOfNewImages << " new images" << std::endl;
+
+            PT::saveScan(scan, scanFile.c_str());
+        }
+        catch (PT::IOException& ex)
+        {
+            std::cerr << ex.what() << std::endl;
+            return 1;
+        }
+
+        runAnalyzer(analyzer.get(), eventHandler);
+    }
+
+    analyzer->flushAnalysis();
+
+    return eventHandler.hasFailed() ? 1 : 0;
+}
+
+static void printUsage(const char* programName)
+{
+    std::cerr << "usage: " << programName 
+        << " [--threads <number>] [--prefetch <number>] [--resume] [--incremental] [--low-memory] [--shard <index>/<count>]"
+        << " [--watch <image directory> --filename-format <well>,<position>,<slide>,<time> [--first-time <number>]]"
+        << " <scan file> <assay file> <analysis directory>" 
+        << std::endl;
+}
+
+int main( int argc, char ** argv )
+{
+    AnalyzerOptions options;
+    std::string watchedDirectory;
+    PT::ImageFilenameFormat filenameFormat;
+    int shardIndex = 0;
+    int numberOfShards = 1;
+    short firstTime = 0;
+
+    // parse arguments
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument(argv[i]);
+        if (argument == "--threads" && i + 1 < argc)
+        {
+            options.numberOfThreads = atoi(argv[++i]);
+            if (options.numberOfThreads < 1)
+            {
+                std::cerr << "Invalid number of threads: " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (argument == "--prefetch" && i + 1 < argc)
+        {
+            options.numberOfPrefetchedImages = atoi(argv[++i]);
+            if (options.numberOfPrefetchedImages < 0)
+            {
+                std::cerr << "Invalid number of prefetched images: " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (argument == "--resume")
+        {
+            options.resumeEnabled = true;
+        }
+        else if (argument == "--incremental")
+        {
+            options.incrementalEnabled = true;
+        }
+        else if (argument == "--low-memory")
+        {
+            options.lowMemoryEnabled = true;
+        }
+        else if (argument == "--shard" && i + 1 < argc)
+        {
+            char separator, remainder;
+            if (sscanf(argv[++i], "%d%c%d%c", &shardIndex, &separator, &numberOfShards, &remainder) != 3 ||
+                separator != '/' || numberOfShards < 1 || shardIndex < 0 || shardIndex >= numberOfShards)
+            {
+                std::cerr << "Invalid shard: " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (argument == "--watch" && i + 1 < argc)
+        {
+            watchedDirectory = argv[++i];
+        }
+        else if (argument == "--filename-format" && i + 1 < argc)
+        {
+            // the indices of the numbers in the image filenames, as in the
+            // scan wizard of the assay editor
+            char separator1, separator2, separator3, remainder;
+            if (sscanf(argv[++i], "%d%c%d%c%d%c%d%c", 
+                    &filenameFormat.wellIndex, &separator1,
+                    &filenameFormat.positionIndex, &separator2,
+                    &filenameFormat.slideIndex, &separator3,
+                    &filenameFormat.timeIndex, &remainder) != 7 ||
+                separator1 != ',' || separator2 != ',' || separator3 != ',' ||
+                filenameFormat.wellIndex < 0 || filenameFormat.positionIndex < 0 || 
+                filenameFormat.slideIndex < 0 || filenameFormat.timeIndex < 1)
+            {
+                std::cerr << "Invalid filename format: " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (argument == "--first-time" && i + 1 < argc)
+        {
+            // the time point every image series of a watched directory
+            // starts with
+            char remainder;
+            if (sscanf(argv[++i], "%hd%c", &firstTime, &remainder) != 1 || firstTime < 0)
+            {
+                std::cerr << "Invalid first time point: " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (argument == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else
+        {
+            files.push_back(argument);
+        }
+    }
+
+    if (files.size() != 3 || files[2].empty())
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (numberOfShards > 1 && ! watchedDirectory.empty())
+    {
+        std::cerr << "A watched directory cannot be sharded" << std::endl;
+        return 2;
+    }
+
+    // load scan, unless it is created from the watched directory
+    std::auto_ptr<PT::Scan> scan;
+    if (watchedDirectory.empty())
+    {
+        try
+        {
+            scan = PT::loadScan(files[0].c_str());
+        }
+        catch (PT::IOException& ex)
+        {
+            std::cerr << "Cannot load scan:" << std::endl << ex.what() << std::endl;
+            return 1;
+        }
+
+        // the analyses of the shards are combined with merge_analyses
+        if (numberOfShards > 1)
+        {
+            scan = PT::createScanShard(*scan, shardIndex, numberOfShards);
+        }
+    }
+
+    // load assay
+    std::auto_ptr<PT::Assay> assay;
+    try
+    {
+        assay = PT::loadAssay(files[1].c_str());
+    }
+    catch (PT::IOException& ex)
+    {
+        std::cerr << "Cannot load assay:" << std::endl << ex.what() << std::endl;
+        return 1;
+    }
+
+    // check analysis directory and create it if necessary
+    std::string analysisDirectory = files[2];
+    {
+        // strip the trailing separator before checking the directory
+        std::string::size_type lastIndex = analysisDirectory.size() - 1;
+        if (! analysisDirectory.empty() && lastIndex > 0 && (analysisDirectory[lastIndex] == '/' || analysisDirectory[lastIndex] == '\\'))
+        {
+            analysisDirectory.erase(lastIndex);
+        }
+
+        if (! itksys::SystemTools::FileIsDirectory(analysisDirectory.c_str()) &&
+            ! itksys::SystemTools::MakeDirectory(analysisDirectory.c_str()))
+        {
+            std::cerr << "Invalid analysis directory: " << analysisDirectory << std::endl;
+            return 1;
+        }
+
+        // analysisDirectory is required to end with a separator
+        // so append it again
+#ifdef WIN32
+        analysisDirectory.append(1, '\\');
+#else
+        analysisDirectory.append(1, '/');
+#endif
+    }
+
+    // perform analysis
+    signal(SIGINT, handleInterrupt);
+    signal(SIGTERM, handleInterrupt);
+
+    int result;
+    if (! watchedDirectory.empty())
+    {
+        result = watchImageDirectory(
+            watchedDirectory, filenameFormat, firstTime, files[0], *assay, analysisDirectory, options);
+    }
+    else
+    {
+        ConsoleEventHandler eventHandler;
+        std::auto_ptr<PT::Analyzer> analyzer = 
+            createAnalyzer(*assay, scan.get(), analysisDirectory, options, eventHandler);
+        runAnalyzer(analyzer.get(), eventHandler);
+        result = eventHandler.hasFailed() ? 1 : 0;
+    }
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    return result;
+}
@@ -0,0 +1,213 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <itksys/SystemTools.hxx>
+
+#include <Analysis.h>
+#include <common.h>
+#include <io/AnalysisIO.h>
+
+/**
+ * An analysis of a scan shard, which was created by the command line assay
+ * runner with the --shard option.
+ */
+struct Shard
+{
+    std::string analysisDirectory;
+
+    PT::Analysis* analysis;
+
+    /**
+     * Orders shards by their first image series, so that the merged cell ids
+     * do not depend on the order of the arguments.  Empty shards come last.
+     */
+    bool operator<(const Shard& shard) const
+    {
+        if (analysis->getNumberOfImageSeries() == 0)
+            return false;
+        else if (shard.analysis->getNumberOfImageSeries() == 0)
+            return true;
+        else
+            return (*analysis->getImageSeriesStart()).location < (*shard.analysis->getImageSeriesStart()).location;
+    }
+};
+
+class ShardVector : public std::vector<Shard>
+{
+public:
+
+    ~ShardVector()
+    {
+        for (iterator it = begin(); it != end(); ++it)
+        {
+            delete (*it).analysis;
+        }
+    }
+};
+
+/**
+ * Appends a separator to the directory path, as required by the analysis
+ * metadata.
+ */
+static std::string appendSeparator(const std::string& directory)
+{
+    std::string result = directory;
+#ifdef WIN32
+    if (result.empty() || (result[result.size() - 1] != '\\' && result[result.size() - 1] != '/'))
+        result.append(1, '\\');
+#else
+    if (result.empty() || result[result.size() - 1] != '/')
+        result.append(1, '/');
+#endif
+    return result;
+}
+
+static void printUsage(const char* programName)
+{
+    std::cerr << "usage: " << programName 
+        << " <merged analysis directory> <shard analysis directory>..." 
+        << std::endl;
+}
+
+int main( int argc, char ** argv )
+{
+    if (argc < 3 || std::string(argv[1]) == "--help")
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::string mergedDirectory = appendSeparator(argv[1]);
+    if (! itksys::SystemTools::FileIsDirectory(mergedDirectory.c_str()) &&
+        ! itksys::SystemTools::MakeDirectory(mergedDirectory.c_str()))
+    {
+        std::cerr << "Invalid analysis directory: " << mergedDirectory << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        // load shards
+        ShardVector shards;
+        for (int i = 2; i < argc; ++i)
+        {
+            Shard shard;
+            shard.analysisDirectory = appendSeparator(argv[i]);
+            if (itksys::SystemTools::SameFile(shard.analysisDirectory.c_str(), mergedDirectory.c_str()))
+            {
+                std::cerr << "The merged analysis directory must differ from the shard directories" << std::endl;
+                return 2;
+            }
+
+            std::string filePath = shard.analysisDirectory + "analysis.xml";
+            shard.analysis = PT::loadAnalysis(filePath.c_str()).release();
+            shards.push_back(shard);
+        }
+
+        std::sort(shards.begin(), shards.end());
+
+        // the shifted cell ids have to fit into the analysis images, which is
+        // checked before any image is copied into the merged directory
+        long maxMergedCellId = 0;
+        for (ShardVector::iterator it = shards.begin(); it != shards.end(); ++it)
+        {
+            maxMergedCellId += (*it).analysis->getMaxCellId();
+        }
+        if (maxMergedCellId > PT::Analysis::MAX_ENCODABLE_CELL_ID)
+        {
+            std::cerr << "The merged analysis would contain cell id " << maxMergedCellId
+                << ", which exceeds the range of the analysis image format" << std::endl;
+            return 1;
+        }
+
+        const PT::AnalysisMetadata& shardMetadata = shards.front().analysis->getMetadata();
+        PT::Analysis mergedAnalysis(PT::AnalysisMetadata(
+            shardMetadata.featureNames, 
+            shardMetadata.subregionNames, 
+            mergedDirectory));
+        const PT::AnalysisMetadata& mergedMetadata = mergedAnalysis.getMetadata();
+
+        // merge shards
+        for (ShardVector::iterator it = shards.begin(); it != shards.end(); ++it)
+        {
+            PT::Analysis& analysis = *(*it).analysis;
+            const PT::AnalysisMetadata& metadata = analysis.getMetadata();
+
+            if (metadata.featureNames != mergedMetadata.featureNames ||
+                metadata.subregionNames != mergedMetadata.subregionNames)
+            {
+                std::cerr << "The shard " << (*it).analysisDirectory 
+                    << " was analyzed with a different analyzer" << std::endl;
+                return 1;
+            }
+
+            // the cell ids of the shard are placed after the merged ones, as
+            // if the image series had been analyzed together
+            int cellIdOffset = mergedAnalysis.getMaxCellId();
+            int numberOfCells = analysis.getNumberOfCells();
+
+            try
+            {
+                mergedAnalysis.moveAnalysis(analysis, cellIdOffset);
+            }
+            catch (PT::DuplicateElementException&)
+            {
+                std::cerr << "The shard " << (*it).analysisDirectory 
+                    << " overlaps with another shard" << std::endl;
+                return 1;
+            }
+
+            PT::Analysis::ImageSeriesConstIterator imageSeriesIt = analysis.getImageSeriesStart();
+            PT::Analysis::ImageSeriesConstIterator imageSeriesEnd = analysis.getImageSeriesEnd();
+            for (; imageSeriesIt != imageSeriesEnd; ++imageSeriesIt)
+            {
+                const PT::ImageSeries& imageSeries = *imageSeriesIt;
+                const PT::ImageSeries::TimeRange& timeRange = imageSeries.timeRange;
+                for (short time = timeRange.min; time <= timeRange.max; ++time)
+                {
+                    PT::copyAnalysisImage(metadata, mergedMetadata, imageSeries.getImageKey(time), cellIdOffset);
+                }
+            }
+
+            std::cout << "merged " << numberOfCells << " cells of " 
+                << (*it).analysisDirectory << std::endl;
+        }
+
+        PT::saveAnalysis(mergedAnalysis);
+    }
+    catch (PT::Exception& ex)
+    {
+        std::cerr << "Cannot merge analyses:" << std::endl << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
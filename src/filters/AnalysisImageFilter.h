@@ -26,10 +26,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef AnalysisImageFilter_h
 #define AnalysisImageFilter_h
 
+#include <algorithm>
+#include <vector>
+
 #include <itkImageToImageFilter.h>
-#include <itk_hash_map.h>
+#include <itkMultiThreader.h>
 
 #include <Analysis.h>
+#include <CellLinker.h>
 #include <Scan.h>
 #include <filters/SegmentKey.h>
 
@@ -64,6 +68,11 @@ public:
         SetNthInput(1, const_cast<TLabelImage*>(labelImage));
     }
 
+    float getMaxMatchingOffset() const
+    {
+        return maxMatchingOffset_;
+    }
+
     void setMaxMatchingOffset(float maxMatchingOffset)
     {
         if (maxMatchingOffset != maxMatchingOffset_)
@@ -72,6 +81,11 @@ public:
         }
     }
 
+    int getMatchingPeriod() const
+    {
+        return matchingPeriod_;
+    }
+
     void setMatchingPeriod(int matchingPeriod)
     {
         assert(matchingPeriod >= 0);
@@ -97,6 +111,43 @@ public:
         analysis_ = analysis;
     }
 
+    /**
+     * Sets the number of subregions per segment.  The subregion ids of the
+     * segment keys must lie between zero and the number of subregions.
+     */
+    void setNumberOfSubregions(int numberOfSubregions)
+    {
+        assert(numberOfSubregions > 0);
+
+        if (numberOfSubregions != numberOfSubregions_)
+        {
+            numberOfSubregions_ = numberOfSubregions;
+            this->Modified();
+        }
+    }
+
+    /**
+     * If linking is deferred, the cell observations are not assigned to the
+     * cells of the analysis.  Instead the output contains the frame-local
+     * cell ids and the observations can be taken with
+     * releaseFrameObservations() after an update.  This allows to process
+     * the images of an image series in any order and to link them later
+     * with a CellLinker.
+     */
+    void setLinkingDeferred(bool linkingDeferred)
+    {
+        if (linkingDeferred != linkingDeferred_)
+        {
+            linkingDeferred_ = linkingDeferred;
+            this->Modified();
+        }
+    }
+
+    std::auto_ptr<FrameObservations> releaseFrameObservations()
+    {
+        return frameObservations_;
+    }
+
 protected:
 
     class SegmentStatistics
@@ -107,8 +158,8 @@ protected:
             pixelCount(0),
             minIntensity(itk::NumericTraits<float>::max()), 
             maxIntensity(itk::NumericTraits<float>::min()),
-            intensitySum(itk::NumericTraits<float>::Zero),
-            intensitySumOfSquares(itk::NumericTraits<float>::Zero)
+            intensitySum(itk::NumericTraits<double>::Zero),
+            intensitySumOfSquares(itk::NumericTraits<double>::Zero)
         {
             regionMin[0] = itk::NumericTraits<ImageIndex::IndexValueType>::max();
             regionMin[1] = itk::NumericTraits<ImageIndex::IndexValueType>::max();
@@ -127,7 +178,7 @@ protected:
             if (intensityVal > maxIntensity) maxIntensity = intensityVal;
 
             intensitySum += intensityVal;
-            intensitySumOfSquares += intensityVal * intensityVal;
+            intensitySumOfSquares += (double)intensityVal * intensityVal;
 
             if (regionMin[0] > index[0]) regionMin[0] = index[0];
             if (regionMin[1] > index[1]) regionMin[1] = index[1];
@@ -136,30 +187,95 @@ protected:
             if (regionMax[1] < index[1]) regionMax[1] = index[1];
         }
 
+        void includeStatistics(const SegmentStatistics& other)
+        {
+            pixelCount += other.pixelCount;
+
+            if (other.minIntensity < minIntensity) minIntensity = other.minIntensity;
+            if (other.maxIntensity > maxIntensity) maxIntensity = other.maxIntensity;
+
+            intensitySum += other.intensitySum;
+            intensitySumOfSquares += other.intensitySumOfSquares;
+
+            if (regionMin[0] > other.regionMin[0]) regionMin[0] = other.regionMin[0];
+            if (regionMin[1] > other.regionMin[1]) regionMin[1] = other.regionMin[1];
+
+            if (regionMax[0] < other.regionMax[0]) regionMax[0] = other.regionMax[0];
+            if (regionMax[1] < other.regionMax[1]) regionMax[1] = other.regionMax[1];
+        }
+
         unsigned long pixelCount;
 
         float minIntensity;
         float maxIntensity;
 
-        float intensitySum;
-        float intensitySumOfSquares;
+        // the sums are accumulated in double precision, so that the standard
+        // deviation of large segments does not suffer from cancellation
+        double intensitySum;
+        double intensitySumOfSquares;
 
         ImageIndex regionMin;
         ImageIndex regionMax;
     };
 
-    typedef itk::hash_map<typename TLabelImage::PixelType, SegmentStatistics> SegmentStatisticsMap;
+    /**
+     * The statistics of the segments of a label image are kept in the order
+     * in which the labels were found.  The segment index of every label is
+     * looked up in a table by the label index, see getLabelIndex().
+     */
+    class SegmentStatisticsTable
+    {
+    public:
+        typedef typename TLabelImage::PixelType LabelType;
+
+        static const unsigned long NO_SEGMENT = ~0UL;
+
+        SegmentStatistics& getStatistics(unsigned long labelIndex, LabelType label)
+        {
+            if (labelIndex >= segmentIndexes.size())
+            {
+                segmentIndexes.resize(std::max(labelIndex + 1, (unsigned long)(2 * segmentIndexes.size())), NO_SEGMENT);
+            }
+
+            unsigned long& segmentIndex = segmentIndexes[labelIndex];
+            if (segmentIndex == NO_SEGMENT)
+            {
+                segmentIndex = labels.size();
+                labels.push_back(label);
+                statistics.push_back(SegmentStatistics());
+            }
+            return statistics[segmentIndex];
+        }
+
+        /**
+         * Removes all segments and releases the memory of the table.
+         */
+        void clear()
+        {
+            std::vector<unsigned long>().swap(segmentIndexes);
+            std::vector<LabelType>().swap(labels);
+            std::vector<SegmentStatistics>().swap(statistics);
+        }
 
-    typedef itk::hash_map<int, CellObservation*> CellObservationMap;
+        std::vector<unsigned long> segmentIndexes;
+        std::vector<LabelType> labels;
+        std::vector<SegmentStatistics> statistics;
+    };
 
-    typedef itk::hash_map<int, int> CellIdMap;
+    typedef CellLinker::CellObservationMap CellObservationMap;
+
+    typedef CellLinker::CellIdMap CellIdMap;
 
     AnalysisImageFilter() :
         maxMatchingOffset_(0),
         matchingPeriod_(2),
         analysis_(0),
+        linkingDeferred_(false),
+        numberOfSubregions_(1),
         minIntensity_( itk::NumericTraits< typename TIntensityImage::PixelType >::max() ),
-        maxIntensity_( itk::NumericTraits< typename TIntensityImage::PixelType >::min() )
+        maxIntensity_( itk::NumericTraits< typename TIntensityImage::PixelType >::min() ),
+        stage_(STAGE_MEASURE_STRIPES),
+        intensityScale_(0)
     {
     }
 
@@ -185,26 +301,69 @@ protected:
     virtual void computeCellFeatures(
             CellObservation* cellObservation) = 0;
 
-    float estimateAffinity(
-            const CellObservation* previousObservation, 
-            const CellObservation* currentObservation);
-
 private:
 
-    void computeStatistics(
-            const TIntensityImage* intensityImage,
-            const TLabelImage* labelImage,
-            SegmentStatisticsMap& segmentStatisticsMap, 
-            itk::ProgressReporter& progress);
+    /**
+     * The statistics are measured by the threads of the filter in horizontal
+     * stripes of the image and then reduced over ranges of labels.
+     */
+    struct Stripe
+    {
+        SegmentStatisticsTable segmentStatistics;
+        typename TIntensityImage::PixelType minIntensity;
+        typename TIntensityImage::PixelType maxIntensity;
+    };
+
+    enum Stage
+    {
+        STAGE_MEASURE_STRIPES,
+        STAGE_REDUCE_STATISTICS,
+        STAGE_WRITE_OUTPUT
+    };
+
+    void executeStage(Stage stage);
+    static ITK_THREAD_RETURN_TYPE executeStageCallback(void* threadInfo);
+
+    /**
+     * Returns the index of a label in the tables of the filter.  The labels
+     * of a segment and its subregions are numbered consecutively, so that
+     * the tables grow with the number of segments and subregions, not with
+     * the values of the labels.
+     */
+    unsigned long getLabelIndex(typename TLabelImage::PixelType label)
+    {
+        SegmentKey segmentKey = labelToSegmentKeyFunctor_(label);
+        assert(segmentKey.mainId >= 0);
+        assert(segmentKey.subId >= 0 && segmentKey.subId < numberOfSubregions_);
+        return static_cast<unsigned long>(segmentKey.mainId) * numberOfSubregions_ + segmentKey.subId;
+    }
+
+    void computeStatistics();
+
+    void measureStripe(int stripeIndex, int numberOfStripes);
+
+    void reduceStatistics(int threadIndex, int numberOfThreads);
+
+    /**
+     * The output pixels are composed from a table of the encoded cell id
+     * and subregion of every label and from the rescaled intensity.
+     */
+    void createOutputTables(const CellIdMap& cellIdMap);
+
+    void writeOutputStripe(int stripeIndex, int numberOfStripes);
 
     void createCellObservations(
-            const SegmentStatisticsMap& segmentStatisticsMap, 
+            const SegmentStatisticsTable& segmentStatisticsTable, 
             CellObservationMap& cellObservationMap);
 
     void integrateObservationsWithAnalysis(
             CellObservationMap& cellObservationMap,
             CellIdMap& cellIdMap);
 
+    void deferObservations(
+            CellObservationMap& cellObservationMap,
+            CellIdMap& cellIdMap);
+
     typename TIntensityImage::PixelType minIntensity_;
     typename TIntensityImage::PixelType maxIntensity_;
 
@@ -216,7 +375,24 @@ private:
 
     Analysis* analysis_;
 
+    bool linkingDeferred_;
+
+    std::auto_ptr<FrameObservations> frameObservations_;
+
     TLabelToSegmentKeyFunctor labelToSegmentKeyFunctor_;
+
+    int numberOfSubregions_;
+
+    Stage stage_;
+    std::vector<Stripe> stripes_;
+    SegmentStatisticsTable segmentStatisticsTable_;
+
+    // the output pixel of every label index
+    std::vector<RGBAPixel> labelPixels_;
+    // integer intensities of a moderate range are rescaled by table lookup,
+    // all others are multiplied with the scale
+    std::vector<unsigned char> intensityTable_;
+    float intensityScale_;
 };
 
 }
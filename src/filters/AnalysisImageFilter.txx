@@ -29,68 +29,182 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sstream>
 #include <vector>
 
-#include <itkImageRegionConstIterator.h>
-#include <itkImageRegionConstIteratorWithIndex.h>
-#include <itkImageRegionIterator.h>
 #include <itkProgressReporter.h>
 
 namespace PT 
 {
 
 template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
-void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::computeStatistics(
-        const TIntensityImage* intensityImage,
-        const TLabelImage* labelImage,
-        SegmentStatisticsMap& segmentStatisticsMap, 
-        itk::ProgressReporter& progressReporter)
+const unsigned long AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::SegmentStatisticsTable::NO_SEGMENT;
+
+template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
+void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::computeStatistics()
 {
-    ImageRegion intensityRegion = intensityImage->GetLargestPossibleRegion();
+    this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+    stripes_.resize(this->GetMultiThreader()->GetNumberOfThreads());
 
-    itk::ImageRegionConstIteratorWithIndex<TIntensityImage> intensityIt(intensityImage, intensityRegion);
-    itk::ImageRegionConstIterator<TLabelImage> labelIt(labelImage, intensityRegion);
-    while (!intensityIt.IsAtEnd())
+    executeStage(STAGE_MEASURE_STRIPES);
+
+    // number the segments in ascending order of their label indexes
+    segmentStatisticsTable_.clear();
     {
-        ImageIndex index = intensityIt.GetIndex();
-        typename TIntensityImage::PixelType intensity = intensityIt.Get();
-        typename TLabelImage::PixelType label = labelIt.Get();
+        unsigned long numberOfLabelValues = 0;
+        for (unsigned int i = 0; i < stripes_.size(); ++i)
+        {
+            numberOfLabelValues = std::max(numberOfLabelValues,
+                    (unsigned long)stripes_[i].segmentStatistics.segmentIndexes.size());
+        }
 
-        // if label not background
-        if (label != 0)
+        segmentStatisticsTable_.segmentIndexes.assign(numberOfLabelValues, SegmentStatisticsTable::NO_SEGMENT);
+        for (unsigned long labelIndex = 0; labelIndex < numberOfLabelValues; ++labelIndex)
         {
-            typename SegmentStatisticsMap::iterator labelMapIt = segmentStatisticsMap.find(label);
-            if (labelMapIt == segmentStatisticsMap.end())
+            for (unsigned int i = 0; i < stripes_.size(); ++i)
             {
-                typename SegmentStatisticsMap::value_type mapValue(label, SegmentStatistics());
-                labelMapIt = segmentStatisticsMap.insert(mapValue).first;
+                const std::vector<unsigned long>& segmentIndexes = stripes_[i].segmentStatistics.segmentIndexes;
+                if (labelIndex < segmentIndexes.size()
+                        && segmentIndexes[labelIndex] != SegmentStatisticsTable::NO_SEGMENT)
+                {
+                    const SegmentStatisticsTable& stripeTable = stripes_[i].segmentStatistics;
+                    segmentStatisticsTable_.segmentIndexes[labelIndex] = segmentStatisticsTable_.labels.size();
+                    segmentStatisticsTable_.labels.push_back(stripeTable.labels[segmentIndexes[labelIndex]]);
+                    break;
+                }
             }
-            SegmentStatistics& segmentStatistics = (*labelMapIt).second;
-
-            segmentStatistics.includePixel(index, intensity);
         }
+        segmentStatisticsTable_.statistics.resize(segmentStatisticsTable_.labels.size());
+    }
 
-        // update value range of intensity image
-        if (intensity < minIntensity_) minIntensity_ = intensity;
-        if (intensity > maxIntensity_) maxIntensity_ = intensity;
+    executeStage(STAGE_REDUCE_STATISTICS);
 
-        ++intensityIt;
-        ++labelIt;
+    // the intensity range is determined for every image anew, so that the
+    // output does not depend on the images processed before
+    minIntensity_ = itk::NumericTraits< typename TIntensityImage::PixelType >::max();
+    maxIntensity_ = itk::NumericTraits< typename TIntensityImage::PixelType >::min();
+    for (unsigned int i = 0; i < stripes_.size(); ++i)
+    {
+        if (stripes_[i].minIntensity < minIntensity_) minIntensity_ = stripes_[i].minIntensity;
+        if (stripes_[i].maxIntensity > maxIntensity_) maxIntensity_ = stripes_[i].maxIntensity;
 
-        progressReporter.CompletedPixel();
+        stripes_[i].segmentStatistics.clear();
+    }
+}
+
+template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
+void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::executeStage(Stage stage)
+{
+    stage_ = stage;
+
+    itk::MultiThreader* threader = this->GetMultiThreader();
+    threader->SetSingleMethod(&AnalysisImageFilter::executeStageCallback, this);
+    threader->SingleMethodExecute();
+}
+
+template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
+ITK_THREAD_RETURN_TYPE AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::executeStageCallback(void* threadInfo)
+{
+    itk::MultiThreader::ThreadInfoStruct* info = 
+        static_cast<itk::MultiThreader::ThreadInfoStruct*>(threadInfo);
+    AnalysisImageFilter* filter = static_cast<AnalysisImageFilter*>(info->UserData);
+
+    int threadIndex = info->ThreadID;
+    int numberOfThreads = info->NumberOfThreads;
+    switch (filter->stage_)
+    {
+        case STAGE_MEASURE_STRIPES:
+            filter->measureStripe(threadIndex, numberOfThreads);
+            break;
+        case STAGE_REDUCE_STATISTICS:
+            filter->reduceStatistics(threadIndex, numberOfThreads);
+            break;
+        case STAGE_WRITE_OUTPUT:
+            filter->writeOutputStripe(threadIndex, numberOfThreads);
+            break;
+    }
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
+void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::measureStripe(int stripeIndex, int numberOfStripes)
+{
+    const TIntensityImage* intensityImage = this->GetInput(0);
+    const TLabelImage* labelImage = static_cast<const TLabelImage*>(this->itk::ProcessObject::GetInput(1));
+
+    // both images are buffered entirely, see GenerateInputRequestedRegion()
+    ImageRegion intensityRegion = intensityImage->GetLargestPossibleRegion();
+    unsigned long width = intensityRegion.GetSize()[0];
+    unsigned long height = intensityRegion.GetSize()[1];
+    unsigned long beginY = stripeIndex * height / numberOfStripes;
+    unsigned long endY = (stripeIndex + 1) * height / numberOfStripes;
+
+    // the statistics make up the first half of the progress
+    itk::ProgressReporter progressReporter(this, stripeIndex, (endY - beginY) * width, 100, 0.0f, 0.5f);
+
+    Stripe& stripe = stripes_[stripeIndex];
+    stripe.segmentStatistics.clear();
+    stripe.minIntensity = itk::NumericTraits< typename TIntensityImage::PixelType >::max();
+    stripe.maxIntensity = itk::NumericTraits< typename TIntensityImage::PixelType >::min();
+
+    ImageIndex index;
+    for (unsigned long y = beginY; y < endY; ++y)
+    {
+        const typename TIntensityImage::PixelType* intensityRow = intensityImage->GetBufferPointer() + y * width;
+        const typename TLabelImage::PixelType* labelRow = labelImage->GetBufferPointer() + y * width;
+        index[1] = intensityRegion.GetIndex()[1] + y;
+        for (unsigned long x = 0; x < width; ++x)
+        {
+            typename TIntensityImage::PixelType intensity = intensityRow[x];
+            typename TLabelImage::PixelType label = labelRow[x];
+
+            // if label not background
+            if (label != 0)
+            {
+                index[0] = intensityRegion.GetIndex()[0] + x;
+                stripe.segmentStatistics.getStatistics(getLabelIndex(label), label).includePixel(index, intensity);
+            }
+
+            // update value range of intensity image
+            if (intensity < stripe.minIntensity) stripe.minIntensity = intensity;
+            if (intensity > stripe.maxIntensity) stripe.maxIntensity = intensity;
+
+            progressReporter.CompletedPixel();
+        }
+    }
+}
+
+template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
+void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::reduceStatistics(int threadIndex, int numberOfThreads)
+{
+    // every thread sums up its own range of segments over all stripes
+    unsigned long numberOfSegments = segmentStatisticsTable_.labels.size();
+    unsigned long beginSegment = threadIndex * numberOfSegments / numberOfThreads;
+    unsigned long endSegment = (threadIndex + 1) * numberOfSegments / numberOfThreads;
+    for (unsigned long s = beginSegment; s < endSegment; ++s)
+    {
+        unsigned long labelIndex = getLabelIndex(segmentStatisticsTable_.labels[s]);
+        SegmentStatistics& segmentStatistics = segmentStatisticsTable_.statistics[s];
+        for (unsigned int i = 0; i < stripes_.size(); ++i)
+        {
+            const SegmentStatisticsTable& stripeTable = stripes_[i].segmentStatistics;
+            if (labelIndex < stripeTable.segmentIndexes.size()
+                    && stripeTable.segmentIndexes[labelIndex] != SegmentStatisticsTable::NO_SEGMENT)
+            {
+                segmentStatistics.includeStatistics(stripeTable.statistics[stripeTable.segmentIndexes[labelIndex]]);
+            }
+        }
     }
 }
 
 template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
 void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::createCellObservations(
-        const SegmentStatisticsMap& segmentStatisticsMap,
+        const SegmentStatisticsTable& segmentStatisticsTable,
         CellObservationMap& cellObservationMap)
 {
     // create and initialize CellObservation objects from labels
-    typename SegmentStatisticsMap::const_iterator segmentStatisticsIt = segmentStatisticsMap.begin();
-    typename SegmentStatisticsMap::const_iterator segmentStatisticsEnd = segmentStatisticsMap.end();
-    for (;segmentStatisticsIt != segmentStatisticsEnd; ++segmentStatisticsIt)
+    for (unsigned long s = 0; s < segmentStatisticsTable.labels.size(); ++s)
     {
-        typename TLabelImage::PixelType label = (*segmentStatisticsIt).first;
-        const SegmentStatistics& segmentStatistics = (*segmentStatisticsIt).second;
+        typename TLabelImage::PixelType label = segmentStatisticsTable.labels[s];
+        const SegmentStatistics& segmentStatistics = segmentStatisticsTable.statistics[s];
 
         SegmentKey segmentKey = labelToSegmentKeyFunctor_(label);
         int cellId = segmentKey.mainId;
@@ -161,151 +275,43 @@ void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor
 }
 
 template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
-float AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::estimateAffinity(
-        const CellObservation* previousObservation,
-        const CellObservation* currentObservation)
+void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::integrateObservationsWithAnalysis(
+        CellObservationMap& cellObservationMap,
+        CellIdMap& cellIdMap)
 {
-    typedef itk::Vector<float, 2> FloatVec2D;
-
-    const ImageRegion& prevRegion = previousObservation->getRegion();
-    const ImageRegion& curRegion = currentObservation->getRegion();
-
-    FloatVec2D prevCenter;
-    prevCenter[0] = prevRegion.GetIndex()[0] + (prevRegion.GetSize()[0] / 2.0);
-    prevCenter[1] = prevRegion.GetIndex()[1] + (prevRegion.GetSize()[1] / 2.0);
-
-    FloatVec2D curCenter;
-    curCenter[0] = curRegion.GetIndex()[0] + (curRegion.GetSize()[0] / 2.0);
-    curCenter[1] = curRegion.GetIndex()[1] + (curRegion.GetSize()[1] / 2.0);
-
-    float distance = (curCenter - prevCenter).GetNorm();
-    if (distance > maxMatchingOffset_)
-        return 0;
-    else
-        return (maxMatchingOffset_ - distance) / maxMatchingOffset_;
-}
+    assert(analysis_ != 0);
 
-class AffinityVectorEntry 
-{
-public:
-    float affinity;
-    int oldCellId;
-    Cell* cell;
-
-    AffinityVectorEntry(float affinityParam, int oldCellIdParam, Cell* cellParam) :
-        affinity(affinityParam),
-        oldCellId(oldCellIdParam),
-        cell(cellParam)
-    {
-    }
+    CellLinker cellLinker(maxMatchingOffset_, matchingPeriod_);
+    cellLinker.linkObservations(*analysis_, imageKey_, cellObservationMap, cellIdMap);
 
-    bool operator<(const AffinityVectorEntry& entry) const
+    if (!analysis_->hasEncodableCellIds())
     {
-        return affinity < entry.affinity;
+        itkExceptionMacro(<< "cell id " << analysis_->getMaxCellId() << " exceeds the range of the analysis image format");
     }
-}; 
+}
 
 template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
-void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::integrateObservationsWithAnalysis(
+void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::deferObservations(
         CellObservationMap& cellObservationMap,
         CellIdMap& cellIdMap)
 {
-    assert(analysis_ != 0);
-
-    // iterate over previous time steps and try to find matching cells
-    ImageKey prevImageKey = imageKey_;
-    for (int timeStep = 1; timeStep <= matchingPeriod_; ++timeStep)
+    // the frame-local cell ids are written to the output
+    typename CellObservationMap::const_iterator cellObservationIt = cellObservationMap.begin();
+    typename CellObservationMap::const_iterator cellObservationItEnd = cellObservationMap.end();
+    for (;cellObservationIt != cellObservationItEnd; ++cellObservationIt)
     {
-        prevImageKey = prevImageKey.previous();
-
-        // check whether we are still in the valid time range
-        if (! prevImageKey.isValid())
-            break;
-
-        std::auto_ptr<CellSelection> cellsInPrevImage = analysis_->selectCellsInImage(prevImageKey);
-
-        // initialize affinity vector
-        std::vector<AffinityVectorEntry> affinityVector;
-        {
-            typename CellObservationMap::const_iterator cellObservationIt = cellObservationMap.begin();
-            typename CellObservationMap::const_iterator cellObservationItEnd = cellObservationMap.end();
-            for (;cellObservationIt != cellObservationItEnd; ++cellObservationIt)
-            {
-                int oldCellId = (*cellObservationIt).first;
-                const CellObservation* cellObservation = (*cellObservationIt).second;
-
-                CellSelection::CellIterator cellIt = cellsInPrevImage->getCellStart();
-                CellSelection::CellIterator cellItEnd = cellsInPrevImage->getCellEnd();
-                for (;cellIt != cellItEnd; ++cellIt)
-                {
-                    Cell* cell = *cellIt;
-
-                    CellObservation* prevObservation = cell->getObservation(prevImageKey.time);
-                    assert(prevObservation != 0);
-
-                    float affinity = estimateAffinity(prevObservation, cellObservation);
-                    if (affinity > 0)
-                    {
-                        AffinityVectorEntry entry(affinity, oldCellId, cell);
-                        affinityVector.push_back(entry);
-                    }
-                }
-            }
-        }
-
-        // sort affinity vector ascendingly by affinity
-        sort(affinityVector.begin(), affinityVector.end());
-
-        // assing CellObservation objects to Cell objects with the highest affinity
-        // affinityVector is sorted ascendingly, so iterate in reverse direction
-        std::vector<AffinityVectorEntry>::reverse_iterator affinityVectorIt = affinityVector.rbegin();
-        std::vector<AffinityVectorEntry>::reverse_iterator affinityVectorItEnd = affinityVector.rend();
-        for (; affinityVectorIt != affinityVectorItEnd; ++affinityVectorIt)
+        int cellId = (*cellObservationIt).first;
+        if (cellId > Analysis::MAX_ENCODABLE_CELL_ID)
         {
-            const AffinityVectorEntry& entry = *affinityVectorIt;
-            int oldCellId = entry.oldCellId;
-            Cell* cell = entry.cell;
-
-            if (! cell->isObservedInImage(imageKey_))
-            {
-                CellObservationMap::iterator cellObservationIt = cellObservationMap.find(oldCellId);
-
-                // check if CellObservation is still available, i. e. is not already assigned
-                if (cellObservationIt != cellObservationMap.end())
-                {
-                    CellObservation* cellObservation = (*cellObservationIt).second;
-
-                    cell->addObservation( std::auto_ptr<CellObservation>(cellObservation) );
-                    cellIdMap.insert( typename CellIdMap::value_type(oldCellId, cell->getId()));
-
-                    cellObservationMap.erase(cellObservationIt);
-                }
-            }
+            itkExceptionMacro(<< "cell id " << cellId << " exceeds the range of the analysis image format");
         }
+        cellIdMap.insert( typename CellIdMap::value_type(cellId, cellId) );
     }
 
-    // create new cells for observations that could not be assigned to any
-    // existing cell
-    typename CellObservationMap::iterator cellObservationIt = cellObservationMap.begin();
-    typename CellObservationMap::iterator cellObservationItEnd = cellObservationMap.end();
-    while (cellObservationIt != cellObservationItEnd)
-    {
-        int oldCellId = (*cellObservationIt).first;
-        CellObservation* cellObservation = (*cellObservationIt).second;
-
-        int newCellId = analysis_->getNumberOfCells() + 1;
-        Cell* cell =  new Cell(newCellId, imageKey_.location);
-        analysis_->addCell( std::auto_ptr<Cell>(cell) );
-
-        cell->addObservation( std::auto_ptr<CellObservation>(cellObservation) );
-
-        cellIdMap.insert( typename CellIdMap::value_type( oldCellId, newCellId ) );
-
-        // it is important to increment the iterator before erasing the element
-        ++cellObservationIt;
-
-        cellObservationMap.erase(oldCellId);
-    }
+    // swapping preserves the iteration order of the map, so linking the
+    // observations later yields the same cell ids as linking them now
+    frameObservations_.reset( new FrameObservations(imageKey_) );
+    frameObservations_->cellObservations.swap(cellObservationMap);
 }
 
 template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
@@ -318,51 +324,56 @@ void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor
     ImageRegion intensityRegion = intensityImage->GetLargestPossibleRegion();
     assert(intensityRegion == labelImage->GetLargestPossibleRegion());
 
-    // set up progress reporter
-    // the number of pixels is multiplied by two, because we iterate two times
-    // over the intensity image
-    itk::ProgressReporter progressReporter(this, 0, intensityRegion.GetNumberOfPixels() * 2);
+    // observations of a previous update which were not taken are discarded
+    frameObservations_.reset();
 
-    // measure statistics for every label
-    SegmentStatisticsMap segmentStatisticsMap;
-    computeStatistics(intensityImage, labelImage, segmentStatisticsMap, progressReporter);
+    // measure statistics for every label, this makes up the first half of
+    // the progress
+    computeStatistics();
 
     // create and initialize CellObservation objects
     CellObservationMap cellObservationMap;
-    createCellObservations(segmentStatisticsMap, cellObservationMap);
+    createCellObservations(segmentStatisticsTable_, cellObservationMap);
 
     // integrate CellObservation objects with analysis
     CellIdMap cellIdMap;
-    integrateObservationsWithAnalysis(cellObservationMap, cellIdMap);
-
-    // write output
+    if (linkingDeferred_)
     {
-        this->AllocateOutputs();
-        RGBAImage::Pointer outputImage = this->GetOutput();
-
-        itk::ImageRegionConstIterator<TIntensityImage> intensityIt;
-        intensityIt = itk::ImageRegionConstIterator<TIntensityImage>(intensityImage, outputImage->GetRequestedRegion());
+        deferObservations(cellObservationMap, cellIdMap);
+    }
+    else
+    {
+        integrateObservationsWithAnalysis(cellObservationMap, cellIdMap);
+    }
 
-        itk::ImageRegionConstIterator<TLabelImage> labelIt;
-        labelIt = itk::ImageRegionConstIterator<TLabelImage>(labelImage, outputImage->GetRequestedRegion());
+    // write output, this makes up the second half of the progress
+    createOutputTables(cellIdMap);
+    segmentStatisticsTable_.clear();
 
-        itk::ImageRegionIterator<RGBAImage> outputIt;
-        outputIt = itk::ImageRegionIterator<RGBAImage>(outputImage, outputImage->GetRequestedRegion());
+    this->AllocateOutputs();
+    executeStage(STAGE_WRITE_OUTPUT);
 
-        float intensityRange = (float)(maxIntensity_ - minIntensity_);
+    std::vector<RGBAPixel>().swap(labelPixels_);
+}
 
-        intensityIt.GoToBegin();
-        labelIt.GoToBegin();
-        outputIt.GoToBegin();
-        while ( !outputIt.IsAtEnd() )
-        {
-            typename TIntensityImage::PixelType intensity = intensityIt.Get();
-            typename TLabelImage::PixelType label = labelIt.Get();
+template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
+void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::createOutputTables(
+        const CellIdMap& cellIdMap)
+{
+    // every label found in the image and the background label are encoded
+    // once, other labels do not occur in the image
+    {
+        const std::vector<typename TLabelImage::PixelType>& labels = segmentStatisticsTable_.labels;
 
-            float relativeIntensity = ((intensity - minIntensity_) / intensityRange);
-            unsigned char rescaledIntensity = (unsigned char)(relativeIntensity * 255);
+        RGBAPixel backgroundPixel;
+        backgroundPixel.Fill(0);
+        backgroundPixel[2] = 0xff & labelToSegmentKeyFunctor_(0).subId;
 
-            SegmentKey segmentKey = labelToSegmentKeyFunctor_(label);
+        labelPixels_.assign(std::max((unsigned long)segmentStatisticsTable_.segmentIndexes.size(), 1UL),
+                backgroundPixel);
+        for (unsigned long s = 0; s < labels.size(); ++s)
+        {
+            SegmentKey segmentKey = labelToSegmentKeyFunctor_(labels[s]);
 
             int newCellId;
             if ( segmentKey.isBackground() )
@@ -371,26 +382,80 @@ void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor
             }
             else
             {
-                CellIdMap::iterator cellIdIt = cellIdMap.find(segmentKey.mainId);
+                CellIdMap::const_iterator cellIdIt = cellIdMap.find(segmentKey.mainId);
                 assert(cellIdIt != cellIdMap.end());
                 newCellId = (*cellIdIt).second;
             }
 
-            RGBAImage::PixelType outputValue;
-            outputValue[0] = 0xff & newCellId;
-            outputValue[1] = (0xff00 & newCellId) >> 8;
-            outputValue[2] = 0xff & segmentKey.subId;
-            outputValue[3] = 0xff & rescaledIntensity;
+            RGBAPixel& labelPixel = labelPixels_[getLabelIndex(labels[s])];
+            Analysis::encodeCellId(newCellId, labelPixel);
+            labelPixel[2] = 0xff & segmentKey.subId;
+            labelPixel[3] = 0;
+        }
+    }
 
-            outputIt.Set( outputValue );
+    float intensityRange = (float)(maxIntensity_ - minIntensity_);
+    intensityScale_ = intensityRange > 0 ? 255 / intensityRange : 0;
 
-            progressReporter.CompletedPixel();
+    intensityTable_.clear();
+    if (itk::NumericTraits< typename TIntensityImage::PixelType >::is_integer
+            && intensityRange >= 0 && intensityRange < 65536)
+    {
+        intensityTable_.resize((unsigned long)intensityRange + 1);
+        for (unsigned long i = 0; i < intensityTable_.size(); ++i)
+        {
+            float relativeIntensity = intensityRange > 0 ? i / intensityRange : 0;
+            intensityTable_[i] = (unsigned char)(relativeIntensity * 255);
+        }
+    }
+}
+
+template <class TIntensityImage, class TLabelImage, class TLabelToSegmentKeyFunctor>
+void AnalysisImageFilter<TIntensityImage, TLabelImage, TLabelToSegmentKeyFunctor>::writeOutputStripe(int stripeIndex, int numberOfStripes)
+{
+    const TIntensityImage* intensityImage = this->GetInput(0);
+    const TLabelImage* labelImage = static_cast<const TLabelImage*>(this->itk::ProcessObject::GetInput(1));
+    RGBAImage* outputImage = this->GetOutput();
+
+    ImageRegion outputRegion = outputImage->GetRequestedRegion();
+    unsigned long width = outputRegion.GetSize()[0];
+    unsigned long height = outputRegion.GetSize()[1];
+    unsigned long beginY = stripeIndex * height / numberOfStripes;
+    unsigned long endY = (stripeIndex + 1) * height / numberOfStripes;
+
+    // progress is reported per row to keep the inner loop lean
+    itk::ProgressReporter progressReporter(this, stripeIndex, endY - beginY, 100, 0.5f, 0.5f);
+
+    const RGBAPixel* labelPixels = &labelPixels_[0];
+    const unsigned char* intensityTable = intensityTable_.empty() ? 0 : &intensityTable_[0];
+    typename TIntensityImage::PixelType minIntensity = minIntensity_;
+    float intensityScale = intensityScale_;
 
-            // increment the iterators
-            ++intensityIt;
-            ++labelIt;
-            ++outputIt;
+    ImageIndex rowIndex = outputRegion.GetIndex();
+    for (unsigned long y = beginY; y < endY; ++y)
+    {
+        rowIndex[1] = outputRegion.GetIndex()[1] + y;
+        const typename TIntensityImage::PixelType* intensityRow = 
+            intensityImage->GetBufferPointer() + intensityImage->ComputeOffset(rowIndex);
+        const typename TLabelImage::PixelType* labelRow = 
+            labelImage->GetBufferPointer() + labelImage->ComputeOffset(rowIndex);
+        RGBAPixel* outputRow = outputImage->GetBufferPointer() + outputImage->ComputeOffset(rowIndex);
+
+        for (unsigned long x = 0; x < width; ++x)
+        {
+            RGBAPixel outputValue = labelPixels[getLabelIndex(labelRow[x])];
+            if (intensityTable)
+            {
+                outputValue[3] = intensityTable[static_cast<unsigned long>(intensityRow[x] - minIntensity)];
+            }
+            else
+            {
+                outputValue[3] = (unsigned char)((intensityRow[x] - minIntensity) * intensityScale);
+            }
+            outputRow[x] = outputValue;
         }
+
+        progressReporter.CompletedPixel();
     }
 }
 
@@ -0,0 +1,209 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef DiffusionRowKernels_h
+#define DiffusionRowKernels_h
+
+#include <cmath>
+
+#include <filters/VectorMath.h>
+
+namespace PT
+{
+
+/**
+ * The row kernels of the FastGradientAnisotropicDiffusionImageFilter.  They
+ * work on float images with a border of one pixel, which repeats the nearest
+ * pixel of the image, so that no boundary checks are needed.  Every row
+ * pointer points at the first pixel of a row inside of the border and the
+ * stride is the distance between two rows.
+ *
+ * The diffusion flux across the edge between two neighboring pixels is the
+ * difference of the pixels weighted with the conductance
+ * exp((d^2 + g^2) / k), where d is the difference and g is the mean of the
+ * central differences in the other direction at the two pixels.  This is the
+ * same term as in itk::GradientNDAnisotropicDiffusionFunction, which
+ * computes it twice for every edge though.
+ *
+ * With SSE2, four pixels are processed at once and the exponential is
+ * approximated by VectorMath::exp4().
+ */
+namespace DiffusionRowKernels
+{
+
+/**
+ * Returns the sum of the squared central differences of the pixels of a row
+ * in both directions.
+ */
+inline double sumSquaredGradients(const float* row, long stride, long width)
+{
+    double sum = 0;
+    long x = 0;
+#ifdef PT_SSE2
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 vectorSum = _mm_setzero_ps();
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x + 1), _mm_loadu_ps(row + x - 1)), half);
+        __m128 dy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x + stride), _mm_loadu_ps(row + x - stride)), half);
+        vectorSum = _mm_add_ps(vectorSum, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+    }
+    float sums[4];
+    _mm_storeu_ps(sums, vectorSum);
+    sum = (double)sums[0] + sums[1] + sums[2] + sums[3];
+#endif
+    for (; x < width; ++x)
+    {
+        float dx = (row[x + 1] - row[x - 1]) * 0.5f;
+        float dy = (row[x + stride] - row[x - stride]) * 0.5f;
+        sum += dx * dx + dy * dy;
+    }
+    return sum;
+}
+
+/**
+ * Computes the fluxes across the edges between the pixels of a row and their
+ * right neighbors, starting with the edge between the left border and the
+ * first pixel.  Thus width + 1 fluxes are written.  A k of zero disables the
+ * diffusion.
+ */
+inline void computeHorizontalFluxes(const float* row, long stride, long width, float k, float* fluxes)
+{
+    if (k == 0)
+    {
+        for (long x = 0; x <= width; ++x)
+        {
+            fluxes[x] = 0;
+        }
+        return;
+    }
+
+    const float* left = row - 1;
+    long x = 0;
+#ifdef PT_SSE2
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 quarter = _mm_set1_ps(0.25f);
+    __m128 vectorK = _mm_set1_ps(k);
+    for (; x + 4 <= width + 1; x += 4)
+    {
+        const float* pixel = left + x;
+        __m128 difference = _mm_sub_ps(_mm_loadu_ps(pixel + 1), _mm_loadu_ps(pixel));
+        __m128 dy0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pixel + stride), _mm_loadu_ps(pixel - stride)), half);
+        __m128 dy1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pixel + 1 + stride), _mm_loadu_ps(pixel + 1 - stride)), half);
+        __m128 dy = _mm_add_ps(dy0, dy1);
+        __m128 magnitude = _mm_add_ps(_mm_mul_ps(difference, difference), _mm_mul_ps(quarter, _mm_mul_ps(dy, dy)));
+        __m128 conductance = VectorMath::exp4(_mm_div_ps(magnitude, vectorK));
+        _mm_storeu_ps(fluxes + x, _mm_mul_ps(difference, conductance));
+    }
+#endif
+    for (; x <= width; ++x)
+    {
+        const float* pixel = left + x;
+        float difference = pixel[1] - pixel[0];
+        float dy0 = (pixel[stride] - pixel[-stride]) * 0.5f;
+        float dy1 = (pixel[1 + stride] - pixel[1 - stride]) * 0.5f;
+        float dy = dy0 + dy1;
+        float magnitude = difference * difference + 0.25f * (dy * dy);
+        fluxes[x] = difference * std::exp(magnitude / k);
+    }
+}
+
+/**
+ * Computes the fluxes across the edges between the pixels of a row and their
+ * lower neighbors.  A k of zero disables the diffusion.
+ */
+inline void computeVerticalFluxes(const float* row, long stride, long width, float k, float* fluxes)
+{
+    if (k == 0)
+    {
+        for (long x = 0; x < width; ++x)
+        {
+            fluxes[x] = 0;
+        }
+        return;
+    }
+
+    const float* lowerRow = row + stride;
+    long x = 0;
+#ifdef PT_SSE2
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 quarter = _mm_set1_ps(0.25f);
+    __m128 vectorK = _mm_set1_ps(k);
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 difference = _mm_sub_ps(_mm_loadu_ps(lowerRow + x), _mm_loadu_ps(row + x));
+        __m128 dx0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x + 1), _mm_loadu_ps(row + x - 1)), half);
+        __m128 dx1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(lowerRow + x + 1), _mm_loadu_ps(lowerRow + x - 1)), half);
+        __m128 dx = _mm_add_ps(dx0, dx1);
+        __m128 magnitude = _mm_add_ps(_mm_mul_ps(difference, difference), _mm_mul_ps(quarter, _mm_mul_ps(dx, dx)));
+        __m128 conductance = VectorMath::exp4(_mm_div_ps(magnitude, vectorK));
+        _mm_storeu_ps(fluxes + x, _mm_mul_ps(difference, conductance));
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        float difference = lowerRow[x] - row[x];
+        float dx0 = (row[x + 1] - row[x - 1]) * 0.5f;
+        float dx1 = (lowerRow[x + 1] - lowerRow[x - 1]) * 0.5f;
+        float dx = dx0 + dx1;
+        float magnitude = difference * difference + 0.25f * (dx * dx);
+        fluxes[x] = difference * std::exp(magnitude / k);
+    }
+}
+
+/**
+ * Adds the divergence of the fluxes around every pixel of a row multiplied
+ * with the time step to the pixel and writes the result to the output row.
+ * The horizontal fluxes are the ones of computeHorizontalFluxes(), the upper
+ * and lower fluxes are the vertical fluxes of the previous and of this row.
+ */
+inline void applyFluxes(const float* row, const float* horizontalFluxes, 
+        const float* upperFluxes, const float* lowerFluxes, 
+        long width, float timeStep, float* outputRow)
+{
+    long x = 0;
+#ifdef PT_SSE2
+    __m128 vectorTimeStep = _mm_set1_ps(timeStep);
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 horizontal = _mm_sub_ps(_mm_loadu_ps(horizontalFluxes + x + 1), _mm_loadu_ps(horizontalFluxes + x));
+        __m128 vertical = _mm_sub_ps(_mm_loadu_ps(lowerFluxes + x), _mm_loadu_ps(upperFluxes + x));
+        __m128 update = _mm_mul_ps(_mm_add_ps(horizontal, vertical), vectorTimeStep);
+        _mm_storeu_ps(outputRow + x, _mm_add_ps(_mm_loadu_ps(row + x), update));
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        float horizontal = horizontalFluxes[x + 1] - horizontalFluxes[x];
+        float vertical = lowerFluxes[x] - upperFluxes[x];
+        outputRow[x] = row[x] + (horizontal + vertical) * timeStep;
+    }
+}
+
+}
+
+}
+
+#endif
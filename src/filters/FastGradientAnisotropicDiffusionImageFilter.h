@@ -0,0 +1,162 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef FastGradientAnisotropicDiffusionImageFilter_h
+#define FastGradientAnisotropicDiffusionImageFilter_h
+
+#include <vector>
+
+#include <itkGradientAnisotropicDiffusionImageFilter.h>
+#include <itkMultiThreader.h>
+
+namespace PT
+{
+
+/**
+ * The FastGradientAnisotropicDiffusionImageFilter is a drop-in replacement
+ * for itk::GradientAnisotropicDiffusionImageFilter on two-dimensional images
+ * with a float output.  It takes the same parameters, but diffuses the image
+ * with the row kernels of DiffusionRowKernels.h in a pair of float buffers
+ * with a border of one pixel.  The rows are processed in parallel by the
+ * threads of the filter.  The input may be of an integer type, e.g. 16-bit
+ * intensities, which are converted while they are copied into the buffers.
+ *
+ * The result differs from the ITK implementation by less than 1e-6 of the
+ * intensity range of the image for up to ten iterations, since only the
+ * rounding of the float arithmetic and of the approximated exponential
+ * differs.  FastDiffusionTest.cxx checks this over the range of the assay
+ * parameters.  If the fast diffusion is disabled, the image spacing is
+ * used, the conductance is not rescaled every iteration or only part of the
+ * image is requested, the ITK implementation is run instead.
+ */
+template <class TInputImage, class TOutputImage = TInputImage>
+class FastGradientAnisotropicDiffusionImageFilter : 
+    public itk::GradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>
+{
+public:
+    typedef FastGradientAnisotropicDiffusionImageFilter Self;
+    typedef itk::GradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(FastGradientAnisotropicDiffusionImageFilter, itk::GradientAnisotropicDiffusionImageFilter);
+
+    bool isFastDiffusionEnabled() const
+    {
+        return fastDiffusionEnabled_;
+    }
+
+    void setFastDiffusionEnabled(bool fastDiffusionEnabled)
+    {
+        if (fastDiffusionEnabled != fastDiffusionEnabled_)
+        {
+            fastDiffusionEnabled_ = fastDiffusionEnabled;
+            this->Modified();
+        }
+    }
+
+protected:
+
+    FastGradientAnisotropicDiffusionImageFilter() :
+        fastDiffusionEnabled_(true),
+        stage_(STAGE_SUM_GRADIENTS),
+        width_(0),
+        height_(0),
+        stride_(0),
+        sourceBuffer_(0),
+        k_(0),
+        iteration_(0)
+    {
+    }
+
+    void GenerateData();
+
+private:
+
+    /**
+     * Every thread diffuses a horizontal stripe of the image and keeps the
+     * fluxes of the row it is working on.
+     */
+    struct Stripe
+    {
+        double gradientSum;
+        std::vector<float> horizontalFluxes;
+        std::vector<float> upperFluxes;
+        std::vector<float> lowerFluxes;
+    };
+
+    enum Stage
+    {
+        STAGE_SUM_GRADIENTS,
+        STAGE_DIFFUSE
+    };
+
+    bool isFastDiffusionApplicable();
+
+    void executeStage(Stage stage);
+    static ITK_THREAD_RETURN_TYPE executeStageCallback(void* threadInfo);
+
+    void sumGradients(int stripeIndex, int numberOfStripes);
+    void diffuseStripe(int stripeIndex, int numberOfStripes);
+
+    float* getRow(int buffer, long y)
+    {
+        return &buffers_[buffer][(y + 1) * stride_ + 1];
+    }
+
+    /**
+     * Repeats the outer pixels of the rows in the border.
+     */
+    void fillBorder(int buffer, long beginY, long endY);
+
+    /**
+     * Repeats the first and the last row in the border.
+     */
+    void fillBorderRows(int buffer);
+
+    bool fastDiffusionEnabled_;
+
+    Stage stage_;
+    std::vector<Stripe> stripes_;
+
+    long width_;
+    long height_;
+    long stride_;
+
+    // the iterations alternate between the two buffers
+    std::vector<float> buffers_[2];
+    int sourceBuffer_;
+
+    float k_;
+    unsigned int iteration_;
+};
+
+}
+
+// include template implementation
+#include "FastGradientAnisotropicDiffusionImageFilter.txx"
+
+#endif
@@ -0,0 +1,241 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef FastGradientAnisotropicDiffusionImageFilter_txx
+#define FastGradientAnisotropicDiffusionImageFilter_txx
+
+#include <algorithm>
+
+#include <itkProgressReporter.h>
+
+#include <filters/DiffusionRowKernels.h>
+
+namespace PT
+{
+
+template <class TInputImage, class TOutputImage>
+void FastGradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>::GenerateData()
+{
+    if (!isFastDiffusionApplicable())
+    {
+        Superclass::GenerateData();
+        return;
+    }
+
+    this->AllocateOutputs();
+
+    const TInputImage* input = this->GetInput();
+    TOutputImage* output = this->GetOutput();
+
+    // copy the input into the first buffer, converting it to float
+    width_ = input->GetBufferedRegion().GetSize()[0];
+    height_ = input->GetBufferedRegion().GetSize()[1];
+    stride_ = width_ + 2;
+    for (int i = 0; i < 2; ++i)
+    {
+        buffers_[i].resize(stride_ * (height_ + 2));
+    }
+    sourceBuffer_ = 0;
+    for (long y = 0; y < height_; ++y)
+    {
+        std::copy(input->GetBufferPointer() + y * width_, 
+                input->GetBufferPointer() + (y + 1) * width_, 
+                getRow(sourceBuffer_, y));
+    }
+    fillBorder(sourceBuffer_, 0, height_);
+    fillBorderRows(sourceBuffer_);
+
+    this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+    stripes_.resize(this->GetMultiThreader()->GetNumberOfThreads());
+
+    for (iteration_ = 0; iteration_ < this->GetNumberOfIterations(); ++iteration_)
+    {
+        // the conductance is scaled by the average squared gradient magnitude
+        // like in itk::GradientNDAnisotropicDiffusionFunction
+        executeStage(STAGE_SUM_GRADIENTS);
+        double gradientSum = 0;
+        for (unsigned int i = 0; i < stripes_.size(); ++i)
+        {
+            gradientSum += stripes_[i].gradientSum;
+        }
+        double averageGradientMagnitudeSquared = gradientSum / (width_ * height_);
+        double conductance = this->GetConductanceParameter();
+        k_ = static_cast<float>(averageGradientMagnitudeSquared * conductance * conductance * -2.0);
+
+        executeStage(STAGE_DIFFUSE);
+        sourceBuffer_ = 1 - sourceBuffer_;
+
+        // the rows of the border are left out by the threads
+        fillBorderRows(sourceBuffer_);
+    }
+
+    for (long y = 0; y < height_; ++y)
+    {
+        std::copy(getRow(sourceBuffer_, y), getRow(sourceBuffer_, y) + width_, 
+                output->GetBufferPointer() + y * width_);
+    }
+
+    // the buffers are kept for the next update, unless the memory is to be
+    // released along with the output
+    if (output->GetReleaseDataFlag())
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            std::vector<float>().swap(buffers_[i]);
+        }
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+bool FastGradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>::isFastDiffusionApplicable()
+{
+    if (!fastDiffusionEnabled_)
+    {
+        return false;
+    }
+
+    if (this->GetUseImageSpacing() || this->GetConductanceScalingUpdateInterval() != 1)
+    {
+        return false;
+    }
+
+    // the whole image must be processed
+    const TInputImage* input = this->GetInput();
+    const TOutputImage* output = this->GetOutput();
+    return input->GetBufferedRegion() == input->GetLargestPossibleRegion()
+        && output->GetRequestedRegion() == input->GetLargestPossibleRegion()
+        && input->GetLargestPossibleRegion().GetNumberOfPixels() > 0;
+}
+
+template <class TInputImage, class TOutputImage>
+void FastGradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>::executeStage(Stage stage)
+{
+    stage_ = stage;
+
+    itk::MultiThreader* threader = this->GetMultiThreader();
+    threader->SetSingleMethod(&Self::executeStageCallback, this);
+    threader->SingleMethodExecute();
+}
+
+template <class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE FastGradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>::executeStageCallback(void* threadInfo)
+{
+    itk::MultiThreader::ThreadInfoStruct* info = 
+        static_cast<itk::MultiThreader::ThreadInfoStruct*>(threadInfo);
+    Self* filter = static_cast<Self*>(info->UserData);
+
+    int threadIndex = info->ThreadID;
+    int numberOfThreads = info->NumberOfThreads;
+    switch (filter->stage_)
+    {
+        case STAGE_SUM_GRADIENTS:
+            filter->sumGradients(threadIndex, numberOfThreads);
+            break;
+        case STAGE_DIFFUSE:
+            filter->diffuseStripe(threadIndex, numberOfThreads);
+            break;
+    }
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage>
+void FastGradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>::sumGradients(int stripeIndex, int numberOfStripes)
+{
+    long beginY = stripeIndex * height_ / numberOfStripes;
+    long endY = (stripeIndex + 1) * height_ / numberOfStripes;
+
+    double gradientSum = 0;
+    for (long y = beginY; y < endY; ++y)
+    {
+        gradientSum += DiffusionRowKernels::sumSquaredGradients(getRow(sourceBuffer_, y), stride_, width_);
+    }
+    stripes_[stripeIndex].gradientSum = gradientSum;
+}
+
+template <class TInputImage, class TOutputImage>
+void FastGradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>::diffuseStripe(int stripeIndex, int numberOfStripes)
+{
+    long beginY = stripeIndex * height_ / numberOfStripes;
+    long endY = (stripeIndex + 1) * height_ / numberOfStripes;
+
+    // every iteration makes up an equal part of the progress
+    float iterationWeight = 1.0f / this->GetNumberOfIterations();
+    itk::ProgressReporter progress(this, stripeIndex, endY - beginY, 100, 
+            iteration_ * iterationWeight, iterationWeight);
+
+    Stripe& stripe = stripes_[stripeIndex];
+    stripe.horizontalFluxes.resize(width_ + 1);
+    stripe.upperFluxes.resize(width_);
+    stripe.lowerFluxes.resize(width_);
+
+    int targetBuffer = 1 - sourceBuffer_;
+    float timeStep = static_cast<float>(this->GetTimeStep());
+
+    // the fluxes across the upper edge of the stripe are computed once more
+    // by the thread of the stripe above
+    if (beginY < endY)
+    {
+        DiffusionRowKernels::computeVerticalFluxes(getRow(sourceBuffer_, beginY - 1), stride_, width_, k_, 
+                &stripe.upperFluxes[0]);
+    }
+    for (long y = beginY; y < endY; ++y)
+    {
+        const float* row = getRow(sourceBuffer_, y);
+        DiffusionRowKernels::computeHorizontalFluxes(row, stride_, width_, k_, &stripe.horizontalFluxes[0]);
+        DiffusionRowKernels::computeVerticalFluxes(row, stride_, width_, k_, &stripe.lowerFluxes[0]);
+        DiffusionRowKernels::applyFluxes(row, &stripe.horizontalFluxes[0], 
+                &stripe.upperFluxes[0], &stripe.lowerFluxes[0], 
+                width_, timeStep, getRow(targetBuffer, y));
+        stripe.upperFluxes.swap(stripe.lowerFluxes);
+
+        progress.CompletedPixel();
+    }
+    fillBorder(targetBuffer, beginY, endY);
+}
+
+template <class TInputImage, class TOutputImage>
+void FastGradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>::fillBorder(int buffer, long beginY, long endY)
+{
+    for (long y = beginY; y < endY; ++y)
+    {
+        float* row = getRow(buffer, y);
+        row[-1] = row[0];
+        row[width_] = row[width_ - 1];
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void FastGradientAnisotropicDiffusionImageFilter<TInputImage, TOutputImage>::fillBorderRows(int buffer)
+{
+    // the corners are copied along with the rows
+    std::copy(getRow(buffer, 0) - 1, getRow(buffer, 0) + width_ + 1, getRow(buffer, -1) - 1);
+    std::copy(getRow(buffer, height_ - 1) - 1, getRow(buffer, height_ - 1) + width_ + 1, 
+            getRow(buffer, height_) - 1);
+}
+
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef GradientMagnitudeSigmoidImageFilter_h
+#define GradientMagnitudeSigmoidImageFilter_h
+
+#include <vector>
+
+#include <itkImageToImageFilter.h>
+
+#include <filters/IntensityRangeSource.h>
+
+namespace PT
+{
+
+/**
+ * The GradientMagnitudeSigmoidImageFilter computes the gradient magnitude of
+ * a two-dimensional float image and maps it with a sigmoid function to the
+ * output range in a single pass.  It produces the same output as an
+ * itk::GradientMagnitudeImageFilter followed by an itk::SigmoidImageFilter,
+ * apart from rounding, but needs no intermediate image.
+ *
+ * The gradient is computed from central differences divided by the image
+ * spacing, with the border pixels repeated outside of the image.  The
+ * sigmoid is
+ *
+ *   (outputMaximum - outputMinimum) / (1 + exp(-(g - beta) / alpha)) + outputMinimum.
+ *
+ * The minimum and maximum of the output are determined along the way.
+ */
+template <class TImage>
+class GradientMagnitudeSigmoidImageFilter : 
+    public itk::ImageToImageFilter<TImage, TImage>,
+    public IntensityRangeSource<typename TImage::PixelType>
+{
+public:
+    typedef GradientMagnitudeSigmoidImageFilter Self;
+    typedef itk::ImageToImageFilter<TImage, TImage> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    typedef typename TImage::PixelType PixelType;
+
+    itkNewMacro(Self);
+    itkTypeMacro(GradientMagnitudeSigmoidImageFilter, itk::ImageToImageFilter);
+
+    void setAlpha(double alpha)
+    {
+        if (alpha != alpha_)
+        {
+            alpha_ = alpha;
+            this->Modified();
+        }
+    }
+
+    void setBeta(double beta)
+    {
+        if (beta != beta_)
+        {
+            beta_ = beta;
+            this->Modified();
+        }
+    }
+
+    void setOutputMinimum(PixelType outputMinimum)
+    {
+        if (outputMinimum != outputMinimum_)
+        {
+            outputMinimum_ = outputMinimum;
+            this->Modified();
+        }
+    }
+
+    void setOutputMaximum(PixelType outputMaximum)
+    {
+        if (outputMaximum != outputMaximum_)
+        {
+            outputMaximum_ = outputMaximum;
+            this->Modified();
+        }
+    }
+
+    PixelType getMinimumIntensity() const
+    {
+        return minimumIntensity_;
+    }
+
+    PixelType getMaximumIntensity() const
+    {
+        return maximumIntensity_;
+    }
+
+protected:
+
+    GradientMagnitudeSigmoidImageFilter() :
+        alpha_(1),
+        beta_(0),
+        outputMinimum_(itk::NumericTraits<PixelType>::NonpositiveMin()),
+        outputMaximum_(itk::NumericTraits<PixelType>::max()),
+        scaleX_(0.5f),
+        scaleY_(0.5f),
+        minimumIntensity_(0),
+        maximumIntensity_(0)
+    {
+    }
+
+    void BeforeThreadedGenerateData();
+
+    void ThreadedGenerateData(const typename TImage::RegionType& outputRegionForThread, int threadId);
+
+    void AfterThreadedGenerateData();
+
+    /** 
+     * The GradientMagnitudeSigmoidImageFilter needs the entire input.
+     * Therefore it must provide an implementation
+     * GenerateInputRequestedRegion().
+     */
+    void GenerateInputRequestedRegion();
+
+private:
+
+    /**
+     * Computes the output pixels from beginX to endX of a row, given the row
+     * and the rows above and below of it.  The range of the computed values
+     * is added to minimum and maximum.
+     */
+    void computeRow(const float* upperRow, const float* row, const float* lowerRow, 
+            long width, long beginX, long endX, 
+            float* outputRow, float& minimum, float& maximum) const;
+
+    /**
+     * Computes the output pixels from beginX to endX one by one.
+     */
+    void computePixels(const float* upperRow, const float* row, const float* lowerRow, 
+            long width, long beginX, long endX, 
+            float* outputRow, float& minimum, float& maximum) const;
+
+    double alpha_;
+    double beta_;
+    PixelType outputMinimum_;
+    PixelType outputMaximum_;
+
+    // the central differences are multiplied by half the inverse spacing
+    float scaleX_;
+    float scaleY_;
+
+    PixelType minimumIntensity_;
+    PixelType maximumIntensity_;
+
+    // the range found by every thread
+    std::vector<PixelType> threadMinimumIntensities_;
+    std::vector<PixelType> threadMaximumIntensities_;
+};
+
+}
+
+// include template implementation
+#include "GradientMagnitudeSigmoidImageFilter.txx"
+
+#endif
@@ -0,0 +1,183 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef GradientMagnitudeSigmoidImageFilter_txx
+#define GradientMagnitudeSigmoidImageFilter_txx
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <itkProgressReporter.h>
+
+#include <filters/VectorMath.h>
+
+namespace PT
+{
+
+template <class TImage>
+void GradientMagnitudeSigmoidImageFilter<TImage>::BeforeThreadedGenerateData()
+{
+    const TImage* input = this->GetInput();
+    scaleX_ = static_cast<float>(0.5 / input->GetSpacing()[0]);
+    scaleY_ = static_cast<float>(0.5 / input->GetSpacing()[1]);
+
+    threadMinimumIntensities_.assign(this->GetNumberOfThreads(), itk::NumericTraits<PixelType>::max());
+    threadMaximumIntensities_.assign(this->GetNumberOfThreads(), itk::NumericTraits<PixelType>::NonpositiveMin());
+}
+
+template <class TImage>
+void GradientMagnitudeSigmoidImageFilter<TImage>::ThreadedGenerateData(const typename TImage::RegionType& outputRegionForThread, int threadId)
+{
+    long numberOfRows = outputRegionForThread.GetSize()[1];
+    itk::ProgressReporter progress(this, threadId, numberOfRows);
+
+    // the entire input is buffered, see GenerateInputRequestedRegion()
+    const TImage* input = this->GetInput();
+    TImage* output = this->GetOutput();
+    typename TImage::RegionType inputRegion = input->GetBufferedRegion();
+    long width = inputRegion.GetSize()[0];
+    long height = inputRegion.GetSize()[1];
+
+    long beginX = outputRegionForThread.GetIndex()[0] - inputRegion.GetIndex()[0];
+    long endX = beginX + outputRegionForThread.GetSize()[0];
+    long beginY = outputRegionForThread.GetIndex()[1] - inputRegion.GetIndex()[1];
+
+    float minimum = threadMinimumIntensities_[threadId];
+    float maximum = threadMaximumIntensities_[threadId];
+
+    typename TImage::IndexType outputIndex = outputRegionForThread.GetIndex();
+    for (long i = 0; i < numberOfRows; ++i)
+    {
+        // the rows outside of the image repeat the border rows
+        long y = beginY + i;
+        const float* row = input->GetBufferPointer() + y * width;
+        const float* upperRow = y > 0 ? row - width : row;
+        const float* lowerRow = y < height - 1 ? row + width : row;
+
+        outputIndex[1] = outputRegionForThread.GetIndex()[1] + i;
+        float* outputRow = output->GetBufferPointer() + output->ComputeOffset(outputIndex) - beginX;
+
+        computeRow(upperRow, row, lowerRow, width, beginX, endX, outputRow, minimum, maximum);
+
+        progress.CompletedPixel();
+    }
+
+    threadMinimumIntensities_[threadId] = minimum;
+    threadMaximumIntensities_[threadId] = maximum;
+}
+
+template <class TImage>
+void GradientMagnitudeSigmoidImageFilter<TImage>::AfterThreadedGenerateData()
+{
+    minimumIntensity_ = *std::min_element(threadMinimumIntensities_.begin(), threadMinimumIntensities_.end());
+    maximumIntensity_ = *std::max_element(threadMaximumIntensities_.begin(), threadMaximumIntensities_.end());
+}
+
+template <class TImage>
+void GradientMagnitudeSigmoidImageFilter<TImage>::computeRow(
+        const float* upperRow, const float* row, const float* lowerRow, 
+        long width, long beginX, long endX, 
+        float* outputRow, float& minimum, float& maximum) const
+{
+    long x = beginX;
+#ifdef PT_SSE2
+    // the first and the last pixel of the image need the repeated border
+    // and are left to the scalar loop
+    long vectorBeginX = std::max(beginX, 1L);
+    long vectorEndX = std::min(endX, width - 1);
+    if (vectorBeginX + 4 <= vectorEndX)
+    {
+        computePixels(upperRow, row, lowerRow, width, x, vectorBeginX, outputRow, minimum, maximum);
+        x = vectorBeginX;
+
+        __m128 scaleX = _mm_set1_ps(scaleX_);
+        __m128 scaleY = _mm_set1_ps(scaleY_);
+        __m128 alpha = _mm_set1_ps(static_cast<float>(alpha_));
+        __m128 beta = _mm_set1_ps(static_cast<float>(beta_));
+        __m128 outputMinimum = _mm_set1_ps(outputMinimum_);
+        __m128 outputRange = _mm_set1_ps(outputMaximum_ - outputMinimum_);
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 vectorMinimum = _mm_set1_ps(minimum);
+        __m128 vectorMaximum = _mm_set1_ps(maximum);
+        for (; x + 4 <= vectorEndX; x += 4)
+        {
+            __m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x + 1), _mm_loadu_ps(row + x - 1)), scaleX);
+            __m128 dy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(lowerRow + x), _mm_loadu_ps(upperRow + x)), scaleY);
+            __m128 gradient = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+            __m128 e = VectorMath::exp4(_mm_div_ps(_mm_sub_ps(beta, gradient), alpha));
+            __m128 value = _mm_add_ps(_mm_div_ps(outputRange, _mm_add_ps(one, e)), outputMinimum);
+            _mm_storeu_ps(outputRow + x, value);
+            vectorMinimum = _mm_min_ps(vectorMinimum, value);
+            vectorMaximum = _mm_max_ps(vectorMaximum, value);
+        }
+
+        float minima[4];
+        float maxima[4];
+        _mm_storeu_ps(minima, vectorMinimum);
+        _mm_storeu_ps(maxima, vectorMaximum);
+        minimum = *std::min_element(minima, minima + 4);
+        maximum = *std::max_element(maxima, maxima + 4);
+    }
+#endif
+    computePixels(upperRow, row, lowerRow, width, x, endX, outputRow, minimum, maximum);
+}
+
+template <class TImage>
+void GradientMagnitudeSigmoidImageFilter<TImage>::computePixels(
+        const float* upperRow, const float* row, const float* lowerRow, 
+        long width, long beginX, long endX, 
+        float* outputRow, float& minimum, float& maximum) const
+{
+    float alpha = static_cast<float>(alpha_);
+    float beta = static_cast<float>(beta_);
+    float outputRange = outputMaximum_ - outputMinimum_;
+    for (long x = beginX; x < endX; ++x)
+    {
+        float dx = (row[x + 1 < width ? x + 1 : x] - row[x > 0 ? x - 1 : x]) * scaleX_;
+        float dy = (lowerRow[x] - upperRow[x]) * scaleY_;
+        float gradient = sqrtf(dx * dx + dy * dy);
+        float value = outputRange / (1.0f + expf((beta - gradient) / alpha)) + outputMinimum_;
+        outputRow[x] = value;
+        minimum = std::min(minimum, value);
+        maximum = std::max(maximum, value);
+    }
+}
+
+template <class TImage>
+void GradientMagnitudeSigmoidImageFilter<TImage>::GenerateInputRequestedRegion()
+{
+    Superclass::GenerateInputRequestedRegion();
+
+    TImage* input = const_cast<TImage*>( this->GetInput() );
+    if ( input )
+    {
+        input->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+}
+
+#endif
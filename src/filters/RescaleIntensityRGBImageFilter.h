@@ -30,6 +30,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <itkImageToImageFilter.h>
 
+#include <filters/IntensityRangeSource.h>
 #include <images.h>
 
 namespace PT
@@ -52,11 +53,22 @@ public:
 
     typename TInputImage::PixelType getMaxIntensity() { return maxIntensity_; }
 
+    /**
+     * If the filter producing the input determines its intensity range, the
+     * range is taken from there instead of being computed anew.
+     */
+    void setIntensityRangeSource(const IntensityRangeSource<typename TInputImage::PixelType>* intensityRangeSource)
+    {
+        intensityRangeSource_ = intensityRangeSource;
+        this->Modified();
+    }
+
 protected:
 
     RescaleIntensityRGBImageFilter() :
         minIntensity_( itk::NumericTraits< typename TInputImage::PixelType >::max() ),
-        maxIntensity_( itk::NumericTraits< typename TInputImage::PixelType >::min() )
+        maxIntensity_( itk::NumericTraits< typename TInputImage::PixelType >::min() ),
+        intensityRangeSource_(0)
     {
     }
 
@@ -70,6 +82,8 @@ protected:
 
     typename TInputImage::PixelType maxIntensity_;
 
+    const IntensityRangeSource<typename TInputImage::PixelType>* intensityRangeSource_;
+
 };
 
 }
@@ -38,6 +38,14 @@ namespace PT
 template <class TInputImage>
 void RescaleIntensityRGBImageFilter<TInputImage>::BeforeThreadedGenerateData()
 {
+    // the input is up to date at this point, and so is its range
+    if (intensityRangeSource_)
+    {
+        minIntensity_ = intensityRangeSource_->getMinimumIntensity();
+        maxIntensity_ = intensityRangeSource_->getMaximumIntensity();
+        return;
+    }
+
     typedef typename itk::MinimumMaximumImageCalculator<TInputImage> CalculatorType;
     typename CalculatorType::Pointer calculator = CalculatorType::New();
     calculator->SetImage( this->GetInput() );
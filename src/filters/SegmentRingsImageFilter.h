@@ -26,6 +26,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SegmentRingsImageFilter_h
 #define SegmentRingsImageFilter_h
 
+#include <vector>
+
 #include <itkImageToImageFilter.h>
 
 #include <filters/SegmentKey.h>
@@ -39,8 +41,16 @@ namespace PT
  * by a common pixel value.  New labels are determined as follows.  The
  * original object label is shifted leftwards by 8 bit and the ring number is
  * stored in the  lowest eight bit.  Ring numbers are counted from the outside
- * to the inside, with the outermost ring having number one.  Pixels of the
+ * to the inside, starting with zero for the outermost ring.  The pixels
+ * inside of all rings get the number of rings as ring number.  Pixels of the
  * background, i. e. the value zero, are left unchanged.
+ *
+ * By default, every pixel compares its label with the pixels of a disc
+ * around it, which costs time proportional to the squared sum of the ring
+ * widths.  If the distance transform is enabled, the squared Euclidean
+ * distance of every pixel to the nearest pixel of another segment is computed
+ * in linear time instead, and the ring is derived from it.  Both ways produce
+ * the same output.  The filter supports two-dimensional images only.
  */
 template <class TInputImage, class TLabelToSegmentKeyFunctor>
 class SegmentRingsImageFilter : public itk::ImageToImageFilter<TInputImage, TInputImage>
@@ -65,24 +75,31 @@ public:
     itkNewMacro(Self);
     itkTypeMacro(SegmentRingsImageFilter, itk::ImageToImageFilter);
 
-    void setRingWidth1(int ringWidth1)
+    /**
+     * Sets the widths of the rings from the outermost to the innermost one.
+     * At most 254 rings are supported.
+     */
+    void setRingWidths(const std::vector<int>& ringWidths)
     {
-        assert(ringWidth1 <= 254);
+        assert(ringWidths.size() <= 254);
 
-        if (ringWidth1 != ringWidth1_)
+        if (ringWidths != ringWidths_)
         {
-            ringWidth1_ = ringWidth1;
+            ringWidths_ = ringWidths;
             this->Modified();
         }
     }
 
-    void setRingWidth2(int ringWidth2)
+    int getNumberOfRings() const
     {
-        assert(ringWidth2 <= 254);
+        return ringWidths_.size();
+    }
 
-        if (ringWidth2 != ringWidth2_)
+    void setDistanceTransformEnabled(bool distanceTransformEnabled)
+    {
+        if (distanceTransformEnabled != distanceTransformEnabled_)
         {
-            ringWidth2_ = ringWidth2;
+            distanceTransformEnabled_ = distanceTransformEnabled;
             this->Modified();
         }
     }
@@ -90,13 +107,24 @@ public:
 protected:
 
     SegmentRingsImageFilter() :
-        ringWidth1_(0),
-        ringWidth2_(0)
+        distanceTransformEnabled_(false)
     {
     }
 
+    /**
+     * Computes the distances along the rows if the distance transform is
+     * enabled.
+     */
+    void BeforeThreadedGenerateData();
+
     void ThreadedGenerateData(const typename TInputImage::RegionType& outputRegionForThread, int threadId);  
 
+    /**
+     * The distance transform processes whole columns, so the output region is
+     * split into ranges of columns if it is enabled.
+     */
+    int SplitRequestedRegion(int i, int num, typename TInputImage::RegionType& splitRegion);
+
     /**
      * SegmentRingsImageFilter needs the output requested region padded by the
      * maximum radius of the structuring element. So GenerateInputRequestedRegion
@@ -106,11 +134,37 @@ protected:
 
 private:
 
+    void generateRingsByNeighborhoods(const typename TInputImage::RegionType& outputRegionForThread);
+
+    void generateRingsByDistanceTransform(const typename TInputImage::RegionType& outputRegionForThread);
+
+    /**
+     * Returns the sum of all ring widths.
+     */
+    int getMaxRadius() const;
+
+    /**
+     * Returns the ring index of a pixel whose squared distance to the nearest
+     * pixel of another segment is squaredDistance, a negative value denoting
+     * that there is no such pixel.  squaredRadii holds the squared outer
+     * radius of every ring.
+     */
+    static int getRingIndex(long squaredDistance, const std::vector<long>& squaredRadii);
+
+    /**
+     * Returns the squared outer radius of every ring.
+     */
+    std::vector<long> getSquaredRadii() const;
+
     TLabelToSegmentKeyFunctor labelToSegmentKeyFunctor_;
 
-    int ringWidth1_;
+    std::vector<int> ringWidths_;
+
+    bool distanceTransformEnabled_;
 
-    int ringWidth2_;
+    // the squared distance of every pixel of the input buffered region to the
+    // nearest pixel of another segment in the same row, or -1 if there is none
+    std::vector<long> squaredRowDistances_;
 
 };
 
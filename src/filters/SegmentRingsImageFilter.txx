@@ -28,6 +28,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <math.h>
 
+#include <algorithm>
+
 #include <itkConstShapedNeighborhoodIterator.h>
 #include <itkImageRegionIterator.h>
 #include <itkNeighborhoodAlgorithm.h>
@@ -36,28 +38,323 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace PT
 {
 
+template <class TInputImage, class TLabelToSegmentKeyFunctor>
+void SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::BeforeThreadedGenerateData()
+{
+    if (!distanceTransformEnabled_)
+    {
+        squaredRowDistances_.clear();
+        return;
+    }
+
+    typename TInputImage::ConstPointer input = this->GetInput();
+    const typename TInputImage::SizeType& size = input->GetBufferedRegion().GetSize();
+    int width = size[0];
+    int height = size[1];
+    squaredRowDistances_.resize(width * height);
+
+    // the nearest pixel of another segment in the row of a pixel is the one
+    // preceding or the one following the run of the pixel's segment
+    for (int y = 0; y < height; ++y)
+    {
+        const InputPixelType* row = input->GetBufferPointer() + y * width;
+        long* squaredDistances = &squaredRowDistances_[y * width];
+
+        int runStart = 0;
+        while (runStart < width)
+        {
+            int mainId = labelToSegmentKeyFunctor_(row[runStart]).mainId;
+            int runEnd = runStart + 1;
+            while (runEnd < width && labelToSegmentKeyFunctor_(row[runEnd]).mainId == mainId)
+            {
+                ++runEnd;
+            }
+
+            for (int x = runStart; x < runEnd; ++x)
+            {
+                long distance = -1;
+                if (runStart > 0)
+                {
+                    distance = x - runStart + 1;
+                }
+                if (runEnd < width && (distance < 0 || runEnd - x < distance))
+                {
+                    distance = runEnd - x;
+                }
+                squaredDistances[x] = (distance < 0) ? -1 : distance * distance;
+            }
+
+            runStart = runEnd;
+        }
+    }
+}
+
 template <class TInputImage, class TLabelToSegmentKeyFunctor>
 void SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::ThreadedGenerateData(
         const typename TInputImage::RegionType& outputRegionForThread,
         int threadId)  
+{
+    if (distanceTransformEnabled_)
+    {
+        generateRingsByDistanceTransform(outputRegionForThread);
+    }
+    else
+    {
+        generateRingsByNeighborhoods(outputRegionForThread);
+    }
+}
+
+template <class TInputImage, class TLabelToSegmentKeyFunctor>
+int SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::SplitRequestedRegion(
+        int i, 
+        int num, 
+        typename TInputImage::RegionType& splitRegion)
+{
+    if (!distanceTransformEnabled_)
+    {
+        return Superclass::SplitRequestedRegion(i, num, splitRegion);
+    }
+
+    splitRegion = this->GetOutput()->GetRequestedRegion();
+    typename TInputImage::IndexType splitIndex = splitRegion.GetIndex();
+    typename TInputImage::SizeType splitSize = splitRegion.GetSize();
+
+    int range = splitSize[0];
+    int valuesPerThread = (int)::ceil(range / (double)num);
+    int maxThreadIdUsed = (int)::ceil(range / (double)valuesPerThread) - 1;
+
+    if (i < maxThreadIdUsed)
+    {
+        splitIndex[0] += i * valuesPerThread;
+        splitSize[0] = valuesPerThread;
+    }
+    if (i == maxThreadIdUsed)
+    {
+        splitIndex[0] += i * valuesPerThread;
+        splitSize[0] = splitSize[0] - i * valuesPerThread;
+    }
+
+    splitRegion.SetIndex(splitIndex);
+    splitRegion.SetSize(splitSize);
+
+    return maxThreadIdUsed + 1;
+}
+
+template <class TInputImage, class TLabelToSegmentKeyFunctor>
+int SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::getMaxRadius() const
+{
+    int maxRadius = 0;
+    for (unsigned int ri = 0; ri < ringWidths_.size(); ++ri)
+    {
+        maxRadius += ringWidths_[ri];
+    }
+    return maxRadius;
+}
+
+template <class TInputImage, class TLabelToSegmentKeyFunctor>
+std::vector<long> SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::getSquaredRadii() const
+{
+    std::vector<long> squaredRadii;
+    long radius = 0;
+    for (unsigned int ri = 0; ri < ringWidths_.size(); ++ri)
+    {
+        radius += ringWidths_[ri];
+        squaredRadii.push_back(radius * radius);
+    }
+    return squaredRadii;
+}
+
+template <class TInputImage, class TLabelToSegmentKeyFunctor>
+int SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::getRingIndex(
+        long squaredDistance, 
+        const std::vector<long>& squaredRadii)
+{
+    // a pixel lies in a ring if its distance is at most the ring's outer
+    // radius, comparing squared integers is exact
+    int numRings = squaredRadii.size();
+    if (squaredDistance >= 0)
+    {
+        for (int ri = 0; ri < numRings; ++ri)
+        {
+            if (squaredDistance <= squaredRadii[ri])
+            {
+                return ri;
+            }
+        }
+    }
+    return numRings;
+}
+
+template <class TInputImage, class TLabelToSegmentKeyFunctor>
+void SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::generateRingsByDistanceTransform(
+        const typename TInputImage::RegionType& outputRegionForThread)
 {
     typename TInputImage::ConstPointer input = this->GetInput();
     typename TInputImage::Pointer output = this->GetOutput();
 
     itk::ProgressReporter progress(this, 0, outputRegionForThread.GetNumberOfPixels());
 
-    typedef itk::ConstShapedNeighborhoodIterator<TInputImage> ShapedNeighborhoodIteratorType;
+    // the distances are computed in the coordinates of the input buffered
+    // region, which contains the output region padded by the largest radius,
+    // so pixels outside of it cannot change the rings
+    const typename TInputImage::RegionType& inputRegion = input->GetBufferedRegion();
+    int width = inputRegion.GetSize()[0];
+    int height = inputRegion.GetSize()[1];
+    const InputPixelType* inputBuffer = input->GetBufferPointer();
+
+    const typename TInputImage::RegionType& outputBufferedRegion = output->GetBufferedRegion();
+    int outputWidth = outputBufferedRegion.GetSize()[0];
+    int outputOffsetX = inputRegion.GetIndex()[0] - outputBufferedRegion.GetIndex()[0];
+    int outputOffsetY = inputRegion.GetIndex()[1] - outputBufferedRegion.GetIndex()[1];
+    InputPixelType* outputBuffer = output->GetBufferPointer();
+
+    std::vector<long> squaredRadii = getSquaredRadii();
+
+    int beginX = outputRegionForThread.GetIndex()[0] - inputRegion.GetIndex()[0];
+    int endX = beginX + outputRegionForThread.GetSize()[0];
+    int beginY = outputRegionForThread.GetIndex()[1] - inputRegion.GetIndex()[1];
+    int endY = beginY + outputRegionForThread.GetSize()[1];
+
+    // the lower envelope of the parabolas of a run, given by their apexes
+    // and the rows from which on they are the lowest
+    std::vector<long> apexRows(height + 2);
+    std::vector<long> apexValues(height + 2);
+    std::vector<long> envelopeStarts(height + 2);
+    std::vector<long> squaredDistances(height);
 
-    // init radii
-    const int numRings = 2;
-    int radii[] = {ringWidth1_, ringWidth2_};
-    for (int ri = 1; ri < numRings; ++ri)
+    for (int x = beginX; x < endX; ++x)
     {
-        radii[ri] += radii[ri-1];
+        int runStart = 0;
+        while (runStart < height)
+        {
+            int mainId = labelToSegmentKeyFunctor_(inputBuffer[runStart * width + x]).mainId;
+            int runEnd = runStart + 1;
+            while (runEnd < height && labelToSegmentKeyFunctor_(inputBuffer[runEnd * width + x]).mainId == mainId)
+            {
+                ++runEnd;
+            }
+
+            int firstRow = std::max(runStart, beginY);
+            int lastRow = std::min(runEnd, endY) - 1;
+            if (mainId != 0 && firstRow <= lastRow)
+            {
+                // the nearest pixel of another segment is either in one of
+                // the rows of the run, where its row distance is known, or
+                // directly above or below the run.  The squared distances
+                // are the lower envelope of the parabolas rooted at these
+                // rows (Meijster et al.)
+                int numberOfParabolas = 0;
+                for (int y = runStart - 1; y <= runEnd; ++y)
+                {
+                    long apexValue;
+                    if (y < 0 || y >= height)
+                    {
+                        continue;
+                    }
+                    else if (y < runStart || y == runEnd)
+                    {
+                        apexValue = 0;
+                    }
+                    else
+                    {
+                        apexValue = squaredRowDistances_[y * width + x];
+                        if (apexValue < 0)
+                        {
+                            continue;
+                        }
+                    }
+
+                    int q = numberOfParabolas - 1;
+                    while (q >= 0)
+                    {
+                        long start = envelopeStarts[q];
+                        long previousValue = (start - apexRows[q]) * (start - apexRows[q]) + apexValues[q];
+                        long value = (start - y) * (start - y) + apexValue;
+                        if (previousValue <= value)
+                        {
+                            break;
+                        }
+                        --q;
+                    }
+
+                    if (q < 0)
+                    {
+                        q = 0;
+                        apexRows[0] = y;
+                        apexValues[0] = apexValue;
+                        envelopeStarts[0] = firstRow;
+                    }
+                    else
+                    {
+                        // the first row where the new parabola is lower
+                        long separation = 1 + 
+                            (y * y - apexRows[q] * apexRows[q] + apexValue - apexValues[q]) / 
+                            (2 * (y - apexRows[q]));
+                        if (separation <= lastRow)
+                        {
+                            ++q;
+                            apexRows[q] = y;
+                            apexValues[q] = apexValue;
+                            envelopeStarts[q] = separation;
+                        }
+                    }
+                    numberOfParabolas = q + 1;
+                }
+
+                int q = numberOfParabolas - 1;
+                for (int y = lastRow; y >= firstRow; --y)
+                {
+                    if (q < 0)
+                    {
+                        squaredDistances[y] = -1;
+                        continue;
+                    }
+                    squaredDistances[y] = (y - apexRows[q]) * (y - apexRows[q]) + apexValues[q];
+                    if (y == envelopeStarts[q])
+                    {
+                        --q;
+                    }
+                }
+
+                for (int y = firstRow; y <= lastRow; ++y)
+                {
+                    int ringIndex = getRingIndex(squaredDistances[y], squaredRadii);
+                    outputBuffer[(y + outputOffsetY) * outputWidth + x + outputOffsetX] = 
+                        (mainId << 8) | (0xff & ringIndex);
+                    progress.CompletedPixel();
+                }
+            }
+            else
+            {
+                for (int y = firstRow; y <= lastRow; ++y)
+                {
+                    outputBuffer[(y + outputOffsetY) * outputWidth + x + outputOffsetX] = 0;
+                    progress.CompletedPixel();
+                }
+            }
+
+            runStart = runEnd;
+        }
     }
+}
+
+template <class TInputImage, class TLabelToSegmentKeyFunctor>
+void SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::generateRingsByNeighborhoods(
+        const typename TInputImage::RegionType& outputRegionForThread)
+{
+    typename TInputImage::ConstPointer input = this->GetInput();
+    typename TInputImage::Pointer output = this->GetOutput();
+
+    itk::ProgressReporter progress(this, 0, outputRegionForThread.GetNumberOfPixels());
+
+    typedef itk::ConstShapedNeighborhoodIterator<TInputImage> ShapedNeighborhoodIteratorType;
+
+    std::vector<long> squaredRadii = getSquaredRadii();
+    int maxRadius = getMaxRadius();
+    long maxSquaredRadius = (long)maxRadius * maxRadius;
 
     typename ShapedNeighborhoodIteratorType::RadiusType iteratorRadius;
-    iteratorRadius.Fill(radii[numRings-1]);
+    iteratorRadius.Fill(maxRadius);
 
     typedef typename itk::NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<TInputImage> FaceCalculatorType;
     FaceCalculatorType faceCalculator;
@@ -66,64 +363,53 @@ void SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::ThreadedGe
     typename FaceCalculatorType::FaceListType::iterator fit;
     for (fit = faceList.begin(); fit != faceList.end(); ++fit)
     {
-        // initialize neighborhood iterators
-        std::auto_ptr<ShapedNeighborhoodIteratorType> inputIts[numRings];
+        // initialize the neighborhood iterator with a disc covering all rings
+        ShapedNeighborhoodIteratorType inputIt(iteratorRadius, input, *fit);
+        for (int y = -maxRadius; y <= maxRadius; y++)
         {
-            for (int ri = 0; ri < numRings; ++ri)
-            {
-                int currentRadius = radii[ri];
-                int previousRadius = (ri > 0) ? radii[ri - 1] : 0;
-
-                iteratorRadius.Fill(currentRadius);
-                inputIts[ri] = std::auto_ptr<ShapedNeighborhoodIteratorType>(
-                    new ShapedNeighborhoodIteratorType(iteratorRadius, input, *fit));
-
-                for (int y = -currentRadius; y <= currentRadius; y++)
+            for (int x = -maxRadius; x <= maxRadius; x++)
+            {     
+                long squaredDistance = x*x + y*y;
+                if (squaredDistance > 0 && squaredDistance <= maxSquaredRadius)
                 {
-                    for (int x = -currentRadius; x <= currentRadius; x++)
-                    {     
-                        float dist = ::sqrt((float)(x*x + y*y));
-                        if (dist <= currentRadius && dist > previousRadius)
-                        {
-                            typename ShapedNeighborhoodIteratorType::OffsetType off;
-                            off[0] = x;
-                            off[1] = y;
-                            inputIts[ri]->ActivateOffset(off);
-                        }
-                    }
+                    typename ShapedNeighborhoodIteratorType::OffsetType off;
+                    off[0] = x;
+                    off[1] = y;
+                    inputIt.ActivateOffset(off);
                 }
-
-                inputIts[ri]->GoToBegin();
             }
         }
+        inputIt.GoToBegin();
 
         typename ShapedNeighborhoodIteratorType::ConstIterator nhIt;
         typename itk::ImageRegionIterator<TInputImage> outputIt(output, *fit);
-        for (outputIt.GoToBegin(); !outputIt.IsAtEnd(); ++outputIt)
+        for (outputIt.GoToBegin(); !outputIt.IsAtEnd(); ++outputIt, ++inputIt)
         {
-            InputPixelType inputPixel = inputIts[0]->GetCenterPixel();
+            InputPixelType inputPixel = inputIt.GetCenterPixel();
 
             SegmentKey segmentKey = labelToSegmentKeyFunctor_(inputPixel);
 
             // check whether input pixel is not background
             if ( ! segmentKey.isBackground() )
             {
-                int ringIndex = numRings;
-                for (int ri = 0; ri < numRings; ++ri)
+                // the ring is determined by the nearest pixel of another
+                // segment
+                long minSquaredDistance = -1;
+                for (nhIt = inputIt.Begin(); nhIt != inputIt.End(); ++nhIt)
                 {
-                    for (nhIt = inputIts[ri]->Begin(); nhIt != inputIts[ri]->End(); ++nhIt)
+                    int tempSegmentId = labelToSegmentKeyFunctor_(nhIt.Get()).mainId;
+                    if (tempSegmentId != segmentKey.mainId)
                     {
-                        int tempSegmentId = labelToSegmentKeyFunctor_(nhIt.Get()).mainId;
-                        if (tempSegmentId != segmentKey.mainId)
+                        typename ShapedNeighborhoodIteratorType::OffsetType off = nhIt.GetNeighborhoodOffset();
+                        long squaredDistance = off[0] * off[0] + off[1] * off[1];
+                        if (minSquaredDistance < 0 || squaredDistance < minSquaredDistance)
                         {
-                            ringIndex = ri;
-                            break;
+                            minSquaredDistance = squaredDistance;
                         }
                     }
-
-                    if (ringIndex < numRings) break;
                 }
-                
+
+                int ringIndex = getRingIndex(minSquaredDistance, squaredRadii);
                 outputIt.Set( (segmentKey.mainId << 8) | (0xff & ringIndex) ) ;
             }
             else
@@ -131,12 +417,6 @@ void SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::ThreadedGe
                 outputIt.Set(0);
             }
 
-            // increment input iterators
-            for (int ri = 0; ri < numRings; ++ri)
-            {
-                ++(*inputIts[ri]);
-            }
-
             progress.CompletedPixel();
         }
     }
@@ -160,16 +440,7 @@ void SegmentRingsImageFilter<TInputImage, TLabelToSegmentKeyFunctor>::GenerateIn
 
     // pad the input requested region by the radius of the maximum structuring
     // element
-    int maxRadius = 0;
-    {
-        const int numRings = 2;
-        int radii[] = {ringWidth1_, ringWidth2_};
-        for (int ri = 0; ri < numRings; ++ri)
-        {
-            maxRadius += radii[ri];
-        }
-    }
-    inputRequestedRegion.PadByRadius(maxRadius);
+    inputRequestedRegion.PadByRadius(getMaxRadius());
 
     // crop the input requested region at the input's largest possible region
     inputRequestedRegion.Crop( input->GetLargestPossibleRegion() );
@@ -26,9 +26,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SegmentSelectionAndMergingImageFilter_h
 #define SegmentSelectionAndMergingImageFilter_h
 
-#include <set>
+#include <utility>
+#include <vector>
 
 #include <itkImageToImageFilter.h>
+#include <itkMultiThreader.h>
 
 #include <filters/SegmentKey.h>
 
@@ -38,10 +40,18 @@ namespace PT
 /**
  * The SegmentSelectionAndMergingImageFilter sorts out segments, whose size is above or below
  * certain thresholds.  It takes a label image as input, where the pixel value
- * denotes the membership to an object.  Pixels of segments which are sorted
- * out are set to zero (denoting background).  All other segments are relabeled
- * so that their new label equals their rank in the list of all segments sorted
- * descendingly by size.
+ * denotes the membership to an object.  Segments larger than the maximum size
+ * are sorted out first.  The remaining segments are merged with all segments
+ * they are connected to via 4-neighborhoods.  Merged segments outside of the
+ * size range are sorted out as well.  Pixels of segments which are sorted out
+ * are set to zero (denoting background).  All other segments are relabeled
+ * with consecutive labels in ascending order of the largest original label
+ * they contain.
+ *
+ * The labels are used as indexes into tables, so they should be dense, as
+ * the ones produced by the watershed filter.  The image is measured in
+ * horizontal stripes by the threads of the filter, only the merging itself
+ * runs in a single thread.
  */
 template <class TInputImage>
 class SegmentSelectionAndMergingImageFilter : public itk::ImageToImageFilter<TInputImage, TInputImage> 
@@ -109,50 +119,93 @@ protected:
         maxNumberOfSegments_(itk::NumericTraits<unsigned long>::max() - 1),
         minimumSegmentSize_(0), 
         maximumSegmentSize_(0), 
-        numberOfSegments_(0)
+        numberOfSegments_(0),
+        stage_(STAGE_FIND_MAX_LABEL),
+        maxLabel_(0)
     {
     }
 
-    typedef typename std::set<InputPixelType> LabelSet;
+    typedef std::vector<unsigned long> SegmentIndexVector;
 
-    struct Segment
+    typedef std::pair<InputPixelType, InputPixelType> LabelPair;
+
+    /**
+     * The measurements of a horizontal stripe of the input.
+     */
+    struct Stripe
     {
-        LabelSet neighbors;
+        InputPixelType maxLabel;
 
-        LabelSet mergedLabels;
+        // the number of pixels of every label in the stripe
+        std::vector<unsigned long> labelSizes;
 
-        unsigned long sizeInPixels;
+        // the pairs of different labels which are 4-neighbors, including
+        // the ones across the lower border of the stripe, the smaller label
+        // first and every pair only once
+        std::vector<LabelPair> neighborLabels;
 
-        Segment() : sizeInPixels(0) { }
+        Stripe() : maxLabel(0) { }
     };
 
-    class SegmentSizeComparator
+    enum Stage
     {
-    public:
-        bool operator()(const Segment& a, const Segment& b)
-        {
-            if (a.sizeInPixels > b.sizeInPixels)
-            {
-                return true;
-            }
-            else if (a.sizeInPixels < b.sizeInPixels)
-            {
-                return false;
-            }
-            // segments of equal size are sorted by original label
-            else if (a.label < b.label)
-            {
-                return true;
-            }
-            else
-            {
-                return false;
-            }
-        }
+        STAGE_FIND_MAX_LABEL,
+        STAGE_MEASURE_STRIPES,
+        STAGE_SUM_LABEL_SIZES,
+        STAGE_RELABEL
     };
 
     void GenerateData();
 
+    /**
+     * Executes the stage with all threads of the filter and waits for them
+     * to finish.
+     */
+    void executeStage(Stage stage);
+
+    static ITK_THREAD_RETURN_TYPE executeStageCallback(void* threadInfo);
+
+    void findMaxLabel(int stripeIndex, int numberOfStripes);
+
+    void measureStripe(int stripeIndex, int numberOfStripes);
+
+    void sumLabelSizes(int threadIndex, int numberOfThreads);
+
+    void relabelStripe(int stripeIndex, int numberOfStripes);
+
+    /**
+     * Returns the representative of the merged segments containing the
+     * segment with the given index.  mergedSegments is a union-find forest,
+     * whose paths are shortened on the way.
+     */
+    static unsigned long findMergedSegment(SegmentIndexVector& mergedSegments, unsigned long segmentIndex)
+    {
+        while (mergedSegments[segmentIndex] != segmentIndex)
+        {
+            mergedSegments[segmentIndex] = mergedSegments[mergedSegments[segmentIndex]];
+            segmentIndex = mergedSegments[segmentIndex];
+        }
+        return segmentIndex;
+    }
+
+    /**
+     * Merges the segments with the given indexes.  The representative with
+     * the smaller index becomes the representative of the union.
+     */
+    static void mergeSegments(SegmentIndexVector& mergedSegments, unsigned long segmentIndex1, unsigned long segmentIndex2)
+    {
+        unsigned long mergedSegment1 = findMergedSegment(mergedSegments, segmentIndex1);
+        unsigned long mergedSegment2 = findMergedSegment(mergedSegments, segmentIndex2);
+        if (mergedSegment1 < mergedSegment2)
+        {
+            mergedSegments[mergedSegment2] = mergedSegment1;
+        }
+        else if (mergedSegment2 < mergedSegment1)
+        {
+            mergedSegments[mergedSegment1] = mergedSegment2;
+        }
+    }
+
     /** 
      * The SegmentSelectionAndMergingImageFilter needs the entire input. Therefore it must
      * provide an implementation GenerateInputRequestedRegion().
@@ -167,6 +220,13 @@ protected:
     unsigned long numberOfSegments_;
     std::vector<unsigned long> segmentSizesInPixels_;
 
+    // the state of the stages shared by the threads
+    Stage stage_;
+    std::vector<Stripe> stripes_;
+    InputPixelType maxLabel_;
+    std::vector<unsigned long> labelSizes_;
+    std::vector<InputPixelType> labelMap_;
+
 };
 
 }
@@ -26,11 +26,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SegmentSelectionAndMergingImageFilter_txx
 #define SegmentSelectionAndMergingImageFilter_txx
 
-#include <itkConstShapedNeighborhoodIterator.h>
+#include <algorithm>
+
 #include <itkImageRegionIterator.h>
-#include <itkNeighborhoodAlgorithm.h>
 #include <itkProgressReporter.h>
-#include <itk_hash_map.h>
 
 namespace PT
 {
@@ -38,290 +37,299 @@ namespace PT
 template <class TInputImage>
 void SegmentSelectionAndMergingImageFilter<TInputImage>::GenerateData()
 {
-    typename TInputImage::ConstPointer input = this->GetInput();
-    typename TInputImage::Pointer output = this->GetOutput();
-
-    // Setup a progress reporter.  The algorithm
-    // has two stages so use the total number of
-    // pixels accessed. In the first pass walk the
-    // entire input, then walk just the output
-    // requested region in the second pass.
-    itk::ProgressReporter progress( this, 0, 
-            input->GetRequestedRegion().GetNumberOfPixels() 
-            + output->GetRequestedRegion().GetNumberOfPixels() );
-
-    typedef itk::hash_map<InputPixelType, Segment> SegmentMap;
-    typedef typename SegmentMap::iterator SegmentMapIterator;
-    typedef typename SegmentMap::value_type SegmentMapValueType;
-
-    // walk the entire input image and identify segments
-    SegmentMap segmentMap;
+    this->AllocateOutputs();
+
+    // the stripes are measured by the threads
+    this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+    stripes_.resize(this->GetMultiThreader()->GetNumberOfThreads());
+
+    executeStage(STAGE_FIND_MAX_LABEL);
+    maxLabel_ = 0;
+    for (unsigned int i = 0; i < stripes_.size(); ++i)
     {
+        maxLabel_ = std::max(maxLabel_, stripes_[i].maxLabel);
+    }
 
-        typedef itk::ConstShapedNeighborhoodIterator<TInputImage> ShapedNeighborhoodIterator;
-        typename ShapedNeighborhoodIterator::RadiusType iteratorRadius;
-        iteratorRadius.Fill(1);
+    executeStage(STAGE_MEASURE_STRIPES);
 
-        typedef itk::NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<TInputImage> FaceCalculator;
-        typedef typename FaceCalculator::FaceListType FaceList;
-        typedef typename FaceList::iterator FaceIterator;
+    unsigned long numberOfLabelValues = (unsigned long)maxLabel_ + 1;
+    labelSizes_.resize(numberOfLabelValues);
+    executeStage(STAGE_SUM_LABEL_SIZES);
 
-        FaceCalculator faceCalculator;
-        FaceList faceList = faceCalculator(input, input->GetRequestedRegion(), iteratorRadius);
-        for (FaceIterator fit = faceList.begin(); fit != faceList.end(); ++fit)
+    // number the segments densely in ascending order of their labels
+    SegmentIndexVector segmentIndexes(numberOfLabelValues, 0);
+    std::vector<InputPixelType> segmentLabels;
+    std::vector<unsigned long> segmentSizes;
+    for (unsigned long label = 0; label < numberOfLabelValues; ++label)
+    {
+        unsigned long size = labelSizes_[label];
+        if (size > 0)
         {
-            ShapedNeighborhoodIterator inputIt(iteratorRadius, input, *fit);
+            segmentIndexes[label] = segmentLabels.size();
+            segmentLabels.push_back(label);
+            segmentSizes.push_back(size);
+        }
+    }
+    unsigned long numberOfLabels = segmentLabels.size();
 
-            // initialize neighborhood iterator
-            for (int y = -1; y <= 1; y++)
-            {
-                for (int x = -1; x <= 1; x++)
-                {     
-                    if (x*x + y*y <= 1) // don't activate diagonal offsets
-                    {
-                        typename ShapedNeighborhoodIterator::OffsetType off;
-                        off[0] = x;
-                        off[1] = y;
-                        inputIt.ActivateOffset(off);
-                    }
-                }
-            }
+    // segments that are too big are sorted out before merging
+    std::vector<bool> segmentsTooBig(numberOfLabels, false);
+    if (maximumSegmentSize_ > 0)
+    {
+        for (unsigned long s = 0; s < numberOfLabels; ++s)
+        {
+            segmentsTooBig[s] = segmentSizes[s] > maximumSegmentSize_;
+        }
+    }
 
-            for (inputIt.GoToBegin(); !inputIt.IsAtEnd(); ++inputIt)
+    // merge all neighboring segments
+    SegmentIndexVector mergedSegments(numberOfLabels);
+    for (unsigned long s = 0; s < numberOfLabels; ++s)
+    {
+        mergedSegments[s] = s;
+    }
+    for (unsigned int i = 0; i < stripes_.size(); ++i)
+    {
+        const std::vector<LabelPair>& neighborLabels = stripes_[i].neighborLabels;
+        for (unsigned long n = 0; n < neighborLabels.size(); ++n)
+        {
+            unsigned long segment = segmentIndexes[neighborLabels[n].first];
+            unsigned long neighborSegment = segmentIndexes[neighborLabels[n].second];
+            if (!segmentsTooBig[segment] && !segmentsTooBig[neighborSegment])
             {
-                InputPixelType label = inputIt.GetCenterPixel();
-
-                // find segment for label
-                SegmentMapIterator segmentMapIt = segmentMap.find( label );
-
-                // create new segment, if it does not exist
-                if (segmentMapIt == segmentMap.end())
-                {
-                    std::pair<SegmentMapIterator, bool> insResult =
-                        segmentMap.insert( SegmentMapValueType(label, Segment()) );
-                    segmentMapIt = insResult.first;
-                    assert(insResult.second);
-                }
-
-                Segment& segment = (*segmentMapIt).second;
-
-                // increase segment size
-                segment.sizeInPixels++;
-
-                // find segment neighbors
-                typename ShapedNeighborhoodIterator::ConstIterator neighborhoodIt;
-                for (neighborhoodIt = inputIt.Begin(); 
-                        neighborhoodIt != inputIt.End();
-                        ++neighborhoodIt)
-                {
-                    InputPixelType neighborhoodLabel = neighborhoodIt.Get();
-                    if (neighborhoodLabel != label)
-                        segment.neighbors.insert(neighborhoodLabel);
-                }
-
-                progress.CompletedPixel();
+                mergeSegments(mergedSegments, segment, neighborSegment);
             }
         }
     }
 
-    typedef std::map<InputPixelType, InputPixelType> LabelMap;
-    typedef typename LabelMap::iterator LabelMapIterator;
-    typedef typename LabelMap::value_type LabelMapValueType;
-
-    // map the original labels to new labels
-    // sort out segments which are too big, merge
-    // others, sort out solitary object which are too
-    // small, determine segment count
-    LabelMap labelMap;
+    // map the original labels to new labels, sort out merged segments which
+    // are too small or too big and determine the segment count
+    labelMap_.assign(numberOfLabelValues, 0);
     {
-        segmentSizesInPixels_.resize(segmentMap.size() + 1);
-        segmentSizesInPixels_[0] = 0;
-
+        segmentSizesInPixels_.assign(numberOfLabels + 1, 0);
         numberOfSegments_ = 0;
 
-        // remove segments that are too big from the
-        // segmentMap and map their labels to
-        // background
-        if (maximumSegmentSize_ > 0)
+        // sum up the sizes of the merged segments and find their last segment
+        std::vector<unsigned long> mergedSizes(numberOfLabels, 0);
+        SegmentIndexVector lastSegments(numberOfLabels, 0);
+        for (unsigned long s = 0; s < numberOfLabels; ++s)
         {
-            SegmentMapIterator segmentIt = segmentMap.begin();
-            SegmentMapIterator segmentEnd = segmentMap.end();
-            while (segmentIt != segmentEnd)
+            if (segmentsTooBig[s])
             {
-                InputPixelType label = (*segmentIt).first;
-                Segment& segment = (*segmentIt).second;
+                segmentSizesInPixels_[0] += segmentSizes[s];
+            }
+            else
+            {
+                unsigned long mergedSegment = findMergedSegment(mergedSegments, s);
+                mergedSizes[mergedSegment] += segmentSizes[s];
+                lastSegments[mergedSegment] = s;
+            }
+        }
 
-                // ensure that iterator is incremented before removal of segment
-                ++segmentIt;
+        // number the merged segments in the order of their last segments
+        std::vector<InputPixelType> newLabels(numberOfLabels, 0);
+        for (unsigned long s = 0; s < numberOfLabels; ++s)
+        {
+            if (segmentsTooBig[s])
+                continue;
 
-                // map to background if too big
-                if (segment.sizeInPixels > maximumSegmentSize_)
-                {
-                    // erase reference to this segment from neighbors
-                    typename LabelSet::iterator neighborLabelIt = segment.neighbors.begin();
-                    typename LabelSet::iterator neighborLabelEnd = segment.neighbors.end();
-                    for (;neighborLabelIt != neighborLabelEnd; ++neighborLabelIt)
-                    {
-                        InputPixelType neighborLabel = *neighborLabelIt;
-                        assert(neighborLabel != label);
-
-                        SegmentMapIterator neighborSegmentIt = segmentMap.find(neighborLabel);
-                        assert(neighborSegmentIt != segmentMap.end());
-
-                        Segment& neighborSegment = (*neighborSegmentIt).second;
-                        neighborSegment.neighbors.erase(label);
-                    }
-
-                    labelMap.insert( typename LabelMap::value_type( label, 0 ) );
-                    segmentSizesInPixels_[0] += segment.sizeInPixels;
-                    segmentMap.erase(label);
-                }
+            unsigned long mergedSegment = findMergedSegment(mergedSegments, s);
+            if (lastSegments[mergedSegment] != s)
+                continue;
+
+            unsigned long size = mergedSizes[mergedSegment];
+            if ( (minimumSegmentSize_ > 0 && size < minimumSegmentSize_)
+                 || (maximumSegmentSize_ > 0 && size > maximumSegmentSize_) )
+            {
+                segmentSizesInPixels_[0] += size;
+            }
+            else
+            {
+                ++numberOfSegments_;
+                newLabels[mergedSegment] = numberOfSegments_;
+                segmentSizesInPixels_[numberOfSegments_] = size;
             }
         }
 
-        // try to merge segments with neighbors
+        for (unsigned long s = 0; s < numberOfLabels; ++s)
         {
-            SegmentMapIterator segmentIt = segmentMap.begin();
-            SegmentMapIterator segmentEnd = segmentMap.end();
-            while (segmentIt != segmentEnd)
+            if (!segmentsTooBig[s])
             {
-                InputPixelType label = (*segmentIt).first;
-                Segment& segment = (*segmentIt).second;
+                labelMap_[segmentLabels[s]] = newLabels[findMergedSegment(mergedSegments, s)];
+            }
+        }
 
-                // ensure that iterator is incremented before removal of segment
-                ++segmentIt;
+        // keep a size for every original label as before, but at least one
+        // for every new label
+        segmentSizesInPixels_.resize(std::max(numberOfLabels, numberOfSegments_ + 1));
+    }
 
-                bool merged = false;
-                InputPixelType mergeLabel;
+    // walk just the output requested region and relabel the pixels
+    executeStage(STAGE_RELABEL);
+}
 
-                typename LabelSet::iterator neighborLabelIt = segment.neighbors.begin();
-                typename LabelSet::iterator neighborLabelEnd = segment.neighbors.end();
-                while (neighborLabelIt != neighborLabelEnd)
-                {
-                    InputPixelType neighborLabel = *neighborLabelIt;
-                    assert(neighborLabel != label);
-
-                    // ensure that iterator is incremented before removal of neighbor label
-                    ++neighborLabelIt;
-
-                    SegmentMapIterator neighborSegmentIt = segmentMap.find(neighborLabel);
-                    assert(neighborSegmentIt != segmentMap.end());
-
-                    Segment& neighborSegment = (*neighborSegmentIt).second;
-
-                    if (! merged)
-                    {
-                        // merge with neighbor segment
-                        neighborSegment.neighbors.erase(label);
-                        neighborSegment.mergedLabels.insert(label);
-                        neighborSegment.mergedLabels.insert(
-                                segment.mergedLabels.begin(),
-                                segment.mergedLabels.end());
-                        neighborSegment.sizeInPixels += segment.sizeInPixels;
-
-                        // copy neighbors to the segment to merge with
-                        segment.neighbors.erase(neighborLabel);
-                        neighborSegment.neighbors.insert(
-                                segment.neighbors.begin(), 
-                                segment.neighbors.end());
-
-                        mergeLabel = neighborLabel;
-                        merged = true;
-                    }
-                    else
-                    {
-                        // tell other neighbor segments about merging
-                        neighborSegment.neighbors.erase(label);
-                        neighborSegment.neighbors.insert(mergeLabel);
-                    }
-                }
+template <class TInputImage>
+void SegmentSelectionAndMergingImageFilter<TInputImage>::executeStage(Stage stage)
+{
+    stage_ = stage;
 
-                if (merged)
-                    segmentMap.erase(label);
-            }
-        }
+    itk::MultiThreader* threader = this->GetMultiThreader();
+    threader->SetSingleMethod(&Self::executeStageCallback, this);
+    threader->SingleMethodExecute();
+}
 
-        // remove segments that are too small from the
-        // segmentMap and map their labels to background
-        // create new labels for all other segments
-        {
-            SegmentMapIterator segmentIt = segmentMap.begin();
-            SegmentMapIterator segmentEnd = segmentMap.end();
-            while (segmentIt != segmentEnd)
-            {
-                InputPixelType label = (*segmentIt).first;
-                Segment& segment = (*segmentIt).second;
+template <class TInputImage>
+ITK_THREAD_RETURN_TYPE SegmentSelectionAndMergingImageFilter<TInputImage>::executeStageCallback(void* threadInfo)
+{
+    itk::MultiThreader::ThreadInfoStruct* info = 
+        static_cast<itk::MultiThreader::ThreadInfoStruct*>(threadInfo);
+    Self* filter = static_cast<Self*>(info->UserData);
 
-                // assert that all neighbors were merged or sorted out
-                assert(segment.neighbors.size() == 0);
+    int threadIndex = info->ThreadID;
+    int numberOfThreads = info->NumberOfThreads;
+    switch (filter->stage_)
+    {
+        case STAGE_FIND_MAX_LABEL:
+            filter->findMaxLabel(threadIndex, numberOfThreads);
+            break;
+        case STAGE_MEASURE_STRIPES:
+            filter->measureStripe(threadIndex, numberOfThreads);
+            break;
+        case STAGE_SUM_LABEL_SIZES:
+            filter->sumLabelSizes(threadIndex, numberOfThreads);
+            break;
+        case STAGE_RELABEL:
+            filter->relabelStripe(threadIndex, numberOfThreads);
+            break;
+    }
 
-                // ensure that iterator is incremented before removal of segment
-                ++segmentIt;
+    return ITK_THREAD_RETURN_VALUE;
+}
 
-                InputPixelType newLabel;
+template <class TInputImage>
+void SegmentSelectionAndMergingImageFilter<TInputImage>::findMaxLabel(int stripeIndex, int numberOfStripes)
+{
+    // the entire input is buffered, see GenerateInputRequestedRegion()
+    const TInputImage* input = this->GetInput();
+    unsigned long width = input->GetBufferedRegion().GetSize()[0];
+    unsigned long height = input->GetBufferedRegion().GetSize()[1];
+    unsigned long beginY = stripeIndex * height / numberOfStripes;
+    unsigned long endY = (stripeIndex + 1) * height / numberOfStripes;
+
+    const InputPixelType* pixel = input->GetBufferPointer() + beginY * width;
+    const InputPixelType* end = input->GetBufferPointer() + endY * width;
+
+    InputPixelType maxLabel = 0;
+    for (; pixel != end; ++pixel)
+    {
+        if (*pixel > maxLabel)
+        {
+            maxLabel = *pixel;
+        }
+    }
+    stripes_[stripeIndex].maxLabel = maxLabel;
+}
 
-                // map to background if too small
-                if ( (minimumSegmentSize_ > 0 && segment.sizeInPixels < minimumSegmentSize_)
-                     || (maximumSegmentSize_ > 0 && segment.sizeInPixels > maximumSegmentSize_) )
-                {
-                    newLabel = 0;
-                    segmentSizesInPixels_[0] += segment.sizeInPixels;
-                }
-                else
+template <class TInputImage>
+void SegmentSelectionAndMergingImageFilter<TInputImage>::measureStripe(int stripeIndex, int numberOfStripes)
+{
+    const TInputImage* input = this->GetInput();
+    unsigned long width = input->GetBufferedRegion().GetSize()[0];
+    unsigned long height = input->GetBufferedRegion().GetSize()[1];
+    unsigned long beginY = stripeIndex * height / numberOfStripes;
+    unsigned long endY = (stripeIndex + 1) * height / numberOfStripes;
+
+    // the measuring makes up the first half of the progress
+    itk::ProgressReporter progress(this, stripeIndex, (endY - beginY) * width, 100, 0.0f, 0.5f);
+
+    Stripe& stripe = stripes_[stripeIndex];
+    stripe.labelSizes.assign((unsigned long)maxLabel_ + 1, 0);
+    stripe.neighborLabels.clear();
+
+    // each pixel is compared with its right and its lower neighbor, which
+    // covers all 4-neighborhoods.  Neighbors along a segment border repeat
+    // the previous pair mostly, so only changes are recorded before the
+    // pairs are made unique.
+    LabelPair previousPair(0, 0);
+    for (unsigned long y = beginY; y < endY; ++y)
+    {
+        const InputPixelType* row = input->GetBufferPointer() + y * width;
+        for (unsigned long x = 0; x < width; ++x)
+        {
+            InputPixelType label = row[x];
+            ++stripe.labelSizes[label];
+
+            if (x + 1 < width && row[x + 1] != label)
+            {
+                LabelPair pair(std::min(label, row[x + 1]), std::max(label, row[x + 1]));
+                if (pair != previousPair)
                 {
-                    // create new mapping
-                    ++numberOfSegments_;
-                    newLabel = numberOfSegments_;
-                    segmentSizesInPixels_[newLabel] = segment.sizeInPixels;
+                    stripe.neighborLabels.push_back(pair);
+                    previousPair = pair;
                 }
-
-                // map label of neighbors
-                typename LabelSet::iterator mergedLabelIt = segment.mergedLabels.begin();
-                typename LabelSet::iterator mergedLabelEnd = segment.mergedLabels.end();
-                for (;mergedLabelIt != mergedLabelEnd; ++mergedLabelIt)
+            }
+            if (y + 1 < height && row[x + width] != label)
+            {
+                LabelPair pair(std::min(label, row[x + width]), std::max(label, row[x + width]));
+                if (pair != previousPair)
                 {
-                    std::pair<LabelMapIterator, bool> insResult =
-                        labelMap.insert( LabelMapValueType(*mergedLabelIt, newLabel) );
-
-                    // assert that label was not mapped before
-                    assert(insResult.second);
+                    stripe.neighborLabels.push_back(pair);
+                    previousPair = pair;
                 }
-
-                labelMap.insert(LabelMapValueType(label, newLabel));
-                segmentMap.erase(label);
             }
-        }
 
-        segmentSizesInPixels_.resize(labelMap.size());
+            progress.CompletedPixel();
+        }
     }
 
-    // walk just the output requested region and relabel the necessary pixels.
+    std::sort(stripe.neighborLabels.begin(), stripe.neighborLabels.end());
+    stripe.neighborLabels.erase(
+            std::unique(stripe.neighborLabels.begin(), stripe.neighborLabels.end()), 
+            stripe.neighborLabels.end());
+}
+
+template <class TInputImage>
+void SegmentSelectionAndMergingImageFilter<TInputImage>::sumLabelSizes(int threadIndex, int numberOfThreads)
+{
+    // every thread sums up its own range of labels over all stripes
+    unsigned long numberOfLabelValues = labelSizes_.size();
+    unsigned long beginLabel = threadIndex * numberOfLabelValues / numberOfThreads;
+    unsigned long endLabel = (threadIndex + 1) * numberOfLabelValues / numberOfThreads;
+    for (unsigned long label = beginLabel; label < endLabel; ++label)
     {
-        this->AllocateOutputs();
-
-        // Remap the labels.  
-        // Note we only walk the region of the output that was requested.
-        // This may be a subset of the input image.
-        itk::ImageRegionConstIterator<TInputImage> it;
-        itk::ImageRegionIterator<TInputImage> oit;
-        it = itk::ImageRegionConstIterator<TInputImage>(input, output->GetRequestedRegion());
-        oit = itk::ImageRegionIterator<TInputImage>(output, output->GetRequestedRegion());
-
-        it.GoToBegin();
-        oit.GoToBegin();
-        InputPixelType inputValue;
-        InputPixelType outputValue;
-        while ( !oit.IsAtEnd() )
+        unsigned long size = 0;
+        for (unsigned int i = 0; i < stripes_.size(); ++i)
         {
-            inputValue = it.Get();
-            outputValue = static_cast<InputPixelType>(labelMap[inputValue]); 
-            oit.Set( outputValue );
-
-            // increment the iterators
-            ++it;
-            ++oit;
-            progress.CompletedPixel();
+            size += stripes_[i].labelSizes[label];
         }
+        labelSizes_[label] = size;
+    }
+}
+
+template <class TInputImage>
+void SegmentSelectionAndMergingImageFilter<TInputImage>::relabelStripe(int stripeIndex, int numberOfStripes)
+{
+    const TInputImage* input = this->GetInput();
+    TInputImage* output = this->GetOutput();
+
+    // Note we only walk the region of the output that was requested.
+    // This may be a subset of the input image.
+    typename TInputImage::RegionType stripeRegion = output->GetRequestedRegion();
+    unsigned long height = stripeRegion.GetSize()[1];
+    unsigned long beginY = stripeIndex * height / numberOfStripes;
+    unsigned long endY = (stripeIndex + 1) * height / numberOfStripes;
+    stripeRegion.SetIndex(1, stripeRegion.GetIndex()[1] + beginY);
+    stripeRegion.SetSize(1, endY - beginY);
+
+    // the relabelling makes up the second half of the progress
+    itk::ProgressReporter progress(this, stripeIndex, stripeRegion.GetNumberOfPixels(), 100, 0.5f, 0.5f);
+
+    itk::ImageRegionConstIterator<TInputImage> it(input, stripeRegion);
+    itk::ImageRegionIterator<TInputImage> oit(output, stripeRegion);
+    for (it.GoToBegin(), oit.GoToBegin(); !oit.IsAtEnd(); ++it, ++oit)
+    {
+        oit.Set( labelMap_[it.Get()] );
+        progress.CompletedPixel();
     }
 }
 
@@ -26,7 +26,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SegmentSizeImageFilter_h
 #define SegmentSizeImageFilter_h
 
+#include <vector>
+
 #include <itkImageToImageFilter.h>
+#include <itkMultiThreader.h>
 
 #include <filters/SegmentKey.h>
 
@@ -40,6 +43,10 @@ namespace PT
  * out are set to zero (denoting background).  All other segments are relabeled
  * so that their new label equals their rank in the list of all segments sorted
  * descendingly by size.
+ *
+ * Integer labels which span a range no larger than the image are counted
+ * in dense tables by the threads of the filter and ranked by a radix sort.
+ * Sparse or non-integer labels are counted in a hash map.
  */
 template <class TInputImage>
 class SegmentSizeImageFilter : public itk::ImageToImageFilter<TInputImage, TInputImage> 
@@ -107,7 +114,10 @@ protected:
         maxNumberOfSegments_(itk::NumericTraits<unsigned long>::max() - 1),
         minimumSegmentSize_(0), 
         maximumSegmentSize_(0), 
-        numberOfSegments_(0)
+        numberOfSegments_(0),
+        stage_(STAGE_FIND_LABEL_RANGE),
+        minLabel_(0),
+        maxLabel_(0)
     {
     }
 
@@ -142,8 +152,19 @@ protected:
         }
     };
 
+    /**
+     * Sorts the segments descendingly by size with a least significant
+     * digit radix sort.  Every pass is stable, so segments of equal size
+     * keep their order, as with the SegmentSizeComparator if they are
+     * sorted by label.
+     */
+    static void sortSegmentsBySize(std::vector<Segment>& segments);
+
     void GenerateData();
 
+    void generateDataByDenseLabels();
+    void generateDataBySparseLabels();
+
     /** 
      * The SegmentSizeImageFilter needs the entire input. Therefore it must
      * provide an implementation GenerateInputRequestedRegion().
@@ -159,6 +180,42 @@ private:
     unsigned long numberOfSegments_;
     std::vector<unsigned long> segmentSizesInPixels_;
 
+    /**
+     * The label range and the label sizes are determined for horizontal
+     * stripes of the input by the threads of the filter.
+     */
+    struct Stripe
+    {
+        InputPixelType minLabel;
+        InputPixelType maxLabel;
+        std::vector<unsigned long> labelSizes;
+    };
+
+    enum Stage
+    {
+        STAGE_FIND_LABEL_RANGE,
+        STAGE_COUNT_LABELS,
+        STAGE_SUM_LABEL_SIZES,
+        STAGE_RELABEL
+    };
+
+    void executeStage(Stage stage);
+    static ITK_THREAD_RETURN_TYPE executeStageCallback(void* threadInfo);
+
+    void findLabelRange(int stripeIndex, int numberOfStripes);
+    void countLabels(int stripeIndex, int numberOfStripes);
+    void sumLabelSizes(int threadIndex, int numberOfThreads);
+    void relabelStripe(int stripeIndex, int numberOfStripes);
+
+    Stage stage_;
+    std::vector<Stripe> stripes_;
+
+    // the dense tables are indexed by label minus minLabel_
+    InputPixelType minLabel_;
+    InputPixelType maxLabel_;
+    std::vector<unsigned long> labelSizes_;
+    std::vector<InputPixelType> labelMap_;
+
 };
 
 }
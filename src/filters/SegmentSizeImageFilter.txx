@@ -26,6 +26,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SegmentSizeImageFilter_txx
 #define SegmentSizeImageFilter_txx
 
+#include <algorithm>
+#include <map>
+
 #include <itkImageRegionIterator.h>
 #include <itkProgressReporter.h>
 #include <itk_hash_map.h>
@@ -35,6 +38,142 @@ namespace PT
 
 template <class TInputImage>
 void SegmentSizeImageFilter<TInputImage>::GenerateData()
+{
+    this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+    stripes_.resize(this->GetMultiThreader()->GetNumberOfThreads());
+
+    executeStage(STAGE_FIND_LABEL_RANGE);
+    minLabel_ = itk::NumericTraits<InputPixelType>::max();
+    maxLabel_ = itk::NumericTraits<InputPixelType>::NonpositiveMin();
+    for (unsigned int i = 0; i < stripes_.size(); ++i)
+    {
+        minLabel_ = std::min(minLabel_, stripes_[i].minLabel);
+        maxLabel_ = std::max(maxLabel_, stripes_[i].maxLabel);
+    }
+
+    // the dense tables must not outgrow the image
+    double numberOfPixels = this->GetInput()->GetBufferedRegion().GetNumberOfPixels();
+    if (itk::NumericTraits<InputPixelType>::is_integer
+            && minLabel_ <= maxLabel_
+            && static_cast<double>(maxLabel_) - static_cast<double>(minLabel_) < numberOfPixels)
+    {
+        generateDataByDenseLabels();
+    }
+    else
+    {
+        generateDataBySparseLabels();
+    }
+}
+
+template <class TInputImage>
+void SegmentSizeImageFilter<TInputImage>::sortSegmentsBySize(std::vector<Segment>& segments)
+{
+    // a byte of the sizes per pass, the passes end with the highest nonzero
+    // byte of the largest size
+    const unsigned int DIGIT_BITS = 8;
+    const unsigned long NUMBER_OF_BUCKETS = 1UL << DIGIT_BITS;
+    const unsigned int SIZE_BITS = 8 * sizeof(unsigned long);
+
+    unsigned long maxSize = 0;
+    for (unsigned long i = 0; i < segments.size(); ++i)
+    {
+        maxSize = std::max(maxSize, segments[i].sizeInPixels);
+    }
+
+    std::vector<Segment> sortedSegments(segments.size());
+    std::vector<unsigned long> bucketBegins(NUMBER_OF_BUCKETS);
+    for (unsigned int shift = 0; shift < SIZE_BITS && (maxSize >> shift) > 0; shift += DIGIT_BITS)
+    {
+        // the buckets are ordered by descending digits
+        bucketBegins.assign(NUMBER_OF_BUCKETS, 0);
+        for (unsigned long i = 0; i < segments.size(); ++i)
+        {
+            unsigned long digit = (segments[i].sizeInPixels >> shift) & (NUMBER_OF_BUCKETS - 1);
+            ++bucketBegins[NUMBER_OF_BUCKETS - 1 - digit];
+        }
+
+        unsigned long begin = 0;
+        for (unsigned long bucket = 0; bucket < NUMBER_OF_BUCKETS; ++bucket)
+        {
+            unsigned long bucketSize = bucketBegins[bucket];
+            bucketBegins[bucket] = begin;
+            begin += bucketSize;
+        }
+
+        for (unsigned long i = 0; i < segments.size(); ++i)
+        {
+            unsigned long digit = (segments[i].sizeInPixels >> shift) & (NUMBER_OF_BUCKETS - 1);
+            sortedSegments[bucketBegins[NUMBER_OF_BUCKETS - 1 - digit]++] = segments[i];
+        }
+        segments.swap(sortedSegments);
+    }
+}
+
+template <class TInputImage>
+void SegmentSizeImageFilter<TInputImage>::generateDataByDenseLabels()
+{
+    this->AllocateOutputs();
+
+    unsigned long numberOfLabelValues = static_cast<unsigned long>(maxLabel_ - minLabel_) + 1;
+    executeStage(STAGE_COUNT_LABELS);
+    labelSizes_.resize(numberOfLabelValues);
+    executeStage(STAGE_SUM_LABEL_SIZES);
+
+    // sort the segments by size, the labels are stored as offsets from the
+    // minimum label and are collected in ascending order
+    typedef std::vector<Segment> SegmentVector;
+    SegmentVector segmentVector;
+    for (unsigned long offset = 0; offset < numberOfLabelValues; ++offset)
+    {
+        if (labelSizes_[offset] > 0)
+        {
+            Segment segment;
+            segment.label = static_cast<InputPixelType>(offset);
+            segment.sizeInPixels = labelSizes_[offset];
+            segmentVector.push_back(segment);
+        }
+    }
+    sortSegmentsBySize(segmentVector);
+
+    // map the original labels to new labels
+    // sort out labels which are too big or too small
+    // determine object count
+    labelMap_.assign(numberOfLabelValues, 0);
+    {
+        segmentSizesInPixels_.resize(segmentVector.size() + 1);
+        segmentSizesInPixels_[0] = 0;
+
+        numberOfSegments_ = 0;
+        for (unsigned long s = 0; s < segmentVector.size(); ++s)
+        {
+            unsigned long segmentSize = segmentVector[s].sizeInPixels;
+
+            if ((numberOfSegments_ == maxNumberOfSegments_) ||
+                (maximumSegmentSize_ > 0 && segmentSize > maximumSegmentSize_ ) ||
+                (minimumSegmentSize_ > 0 && segmentSize < minimumSegmentSize_) )
+            {
+                // map to background
+                segmentSizesInPixels_[0] += segmentSize;
+            }
+            else
+            {
+                ++numberOfSegments_;
+                labelMap_[static_cast<unsigned long>(segmentVector[s].label)] = static_cast<InputPixelType>(numberOfSegments_);
+                segmentSizesInPixels_[numberOfSegments_] = segmentSize;
+            }
+        }
+
+        // plus 1 because segmentSizesInPixels_ serves as a map and labels
+        // start at 1
+        segmentSizesInPixels_.resize(numberOfSegments_ + 1);
+    }
+
+    // walk just the output requested region and relabel the pixels
+    executeStage(STAGE_RELABEL);
+}
+
+template <class TInputImage>
+void SegmentSizeImageFilter<TInputImage>::generateDataBySparseLabels()
 {
     typename TInputImage::ConstPointer input = this->GetInput();
     typename TInputImage::Pointer output = this->GetOutput();
@@ -162,6 +301,144 @@ void SegmentSizeImageFilter<TInputImage>::GenerateData()
     }
 }
 
+template <class TInputImage>
+void SegmentSizeImageFilter<TInputImage>::executeStage(Stage stage)
+{
+    stage_ = stage;
+
+    itk::MultiThreader* threader = this->GetMultiThreader();
+    threader->SetSingleMethod(&Self::executeStageCallback, this);
+    threader->SingleMethodExecute();
+}
+
+template <class TInputImage>
+ITK_THREAD_RETURN_TYPE SegmentSizeImageFilter<TInputImage>::executeStageCallback(void* threadInfo)
+{
+    itk::MultiThreader::ThreadInfoStruct* info = 
+        static_cast<itk::MultiThreader::ThreadInfoStruct*>(threadInfo);
+    Self* filter = static_cast<Self*>(info->UserData);
+
+    int threadIndex = info->ThreadID;
+    int numberOfThreads = info->NumberOfThreads;
+    switch (filter->stage_)
+    {
+        case STAGE_FIND_LABEL_RANGE:
+            filter->findLabelRange(threadIndex, numberOfThreads);
+            break;
+        case STAGE_COUNT_LABELS:
+            filter->countLabels(threadIndex, numberOfThreads);
+            break;
+        case STAGE_SUM_LABEL_SIZES:
+            filter->sumLabelSizes(threadIndex, numberOfThreads);
+            break;
+        case STAGE_RELABEL:
+            filter->relabelStripe(threadIndex, numberOfThreads);
+            break;
+    }
+
+    return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage>
+void SegmentSizeImageFilter<TInputImage>::findLabelRange(int stripeIndex, int numberOfStripes)
+{
+    // the entire input is buffered, see GenerateInputRequestedRegion()
+    const TInputImage* input = this->GetInput();
+    unsigned long width = input->GetBufferedRegion().GetSize()[0];
+    unsigned long height = input->GetBufferedRegion().GetNumberOfPixels() / std::max(width, 1UL);
+    unsigned long beginY = stripeIndex * height / numberOfStripes;
+    unsigned long endY = (stripeIndex + 1) * height / numberOfStripes;
+
+    const InputPixelType* pixel = input->GetBufferPointer() + beginY * width;
+    const InputPixelType* end = input->GetBufferPointer() + endY * width;
+
+    InputPixelType minLabel = itk::NumericTraits<InputPixelType>::max();
+    InputPixelType maxLabel = itk::NumericTraits<InputPixelType>::NonpositiveMin();
+    for (; pixel != end; ++pixel)
+    {
+        if (*pixel < minLabel)
+        {
+            minLabel = *pixel;
+        }
+        if (*pixel > maxLabel)
+        {
+            maxLabel = *pixel;
+        }
+    }
+    stripes_[stripeIndex].minLabel = minLabel;
+    stripes_[stripeIndex].maxLabel = maxLabel;
+}
+
+template <class TInputImage>
+void SegmentSizeImageFilter<TInputImage>::countLabels(int stripeIndex, int numberOfStripes)
+{
+    const TInputImage* input = this->GetInput();
+    unsigned long width = input->GetBufferedRegion().GetSize()[0];
+    unsigned long height = input->GetBufferedRegion().GetNumberOfPixels() / std::max(width, 1UL);
+    unsigned long beginY = stripeIndex * height / numberOfStripes;
+    unsigned long endY = (stripeIndex + 1) * height / numberOfStripes;
+
+    // the counting makes up the first half of the progress
+    itk::ProgressReporter progress(this, stripeIndex, (endY - beginY) * width, 100, 0.0f, 0.5f);
+
+    Stripe& stripe = stripes_[stripeIndex];
+    stripe.labelSizes.assign(static_cast<unsigned long>(maxLabel_ - minLabel_) + 1, 0);
+
+    const InputPixelType* pixel = input->GetBufferPointer() + beginY * width;
+    const InputPixelType* end = input->GetBufferPointer() + endY * width;
+    for (; pixel != end; ++pixel)
+    {
+        ++stripe.labelSizes[static_cast<unsigned long>(*pixel - minLabel_)];
+        progress.CompletedPixel();
+    }
+}
+
+template <class TInputImage>
+void SegmentSizeImageFilter<TInputImage>::sumLabelSizes(int threadIndex, int numberOfThreads)
+{
+    // every thread sums up its own range of labels over all stripes
+    unsigned long numberOfLabelValues = labelSizes_.size();
+    unsigned long beginOffset = threadIndex * numberOfLabelValues / numberOfThreads;
+    unsigned long endOffset = (threadIndex + 1) * numberOfLabelValues / numberOfThreads;
+    for (unsigned long offset = beginOffset; offset < endOffset; ++offset)
+    {
+        unsigned long size = 0;
+        for (unsigned int i = 0; i < stripes_.size(); ++i)
+        {
+            size += stripes_[i].labelSizes[offset];
+        }
+        labelSizes_[offset] = size;
+    }
+}
+
+template <class TInputImage>
+void SegmentSizeImageFilter<TInputImage>::relabelStripe(int stripeIndex, int numberOfStripes)
+{
+    const TInputImage* input = this->GetInput();
+    TInputImage* output = this->GetOutput();
+
+    // Note we only walk the region of the output that was requested.
+    // This may be a subset of the input image.
+    typename TInputImage::RegionType stripeRegion = output->GetRequestedRegion();
+    const unsigned int stripeDimension = TInputImage::ImageDimension - 1;
+    unsigned long length = stripeRegion.GetSize()[stripeDimension];
+    unsigned long begin = stripeIndex * length / numberOfStripes;
+    unsigned long end = (stripeIndex + 1) * length / numberOfStripes;
+    stripeRegion.SetIndex(stripeDimension, stripeRegion.GetIndex()[stripeDimension] + begin);
+    stripeRegion.SetSize(stripeDimension, end - begin);
+
+    // the relabelling makes up the second half of the progress
+    itk::ProgressReporter progress(this, stripeIndex, stripeRegion.GetNumberOfPixels(), 100, 0.5f, 0.5f);
+
+    itk::ImageRegionConstIterator<TInputImage> it(input, stripeRegion);
+    itk::ImageRegionIterator<TInputImage> oit(output, stripeRegion);
+    for (it.GoToBegin(), oit.GoToBegin(); !oit.IsAtEnd(); ++it, ++oit)
+    {
+        oit.Set( labelMap_[static_cast<unsigned long>(it.Get() - minLabel_)] );
+        progress.CompletedPixel();
+    }
+}
+
 template <class TInputImage>
 void SegmentSizeImageFilter<TInputImage>::GenerateInputRequestedRegion()
 {
@@ -57,6 +57,13 @@ typedef itk::Image<unsigned long, 2> ULongImage;
 
 typedef itk::Image<float, 2> FloatImage;
 
+/**
+ * The type of the intensity images of a scan.  Scans consist of 8-bit and
+ * 16-bit images, which are kept at their own precision until they are
+ * filtered.
+ */
+typedef UShortImage IntensityImage;
+
 typedef itk::RGBPixel<unsigned char> RGBPixel;
 
 typedef itk::Image<RGBPixel, 2> RGBImage;
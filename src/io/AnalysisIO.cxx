@@ -25,16 +25,127 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <io/AnalysisIO.h>
 
+#include <stdio.h>
+
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkImageRegionIterator.h>
+#include <itksys/SystemTools.hxx>
 #include <tinyxml.h>
 
 #include <common.h>
+#include <images.h>
 
 namespace PT
 {
 
+static TiXmlElement* createImageSeriesElement(const ImageSeries& imageSeries)
+{
+    const ImageLocation& location = imageSeries.location;
+    const ImageSeries::TimeRange& timeRange = imageSeries.timeRange;
+
+    TiXmlElement *imageSeriesElement = new TiXmlElement("image-series");
+
+    imageSeriesElement->SetAttribute("well", location.well);
+    imageSeriesElement->SetAttribute("position", location.position);
+    imageSeriesElement->SetAttribute("slide", location.slide);
+    imageSeriesElement->SetAttribute("start", timeRange.min);
+    imageSeriesElement->SetAttribute("end", timeRange.max);
+
+    return imageSeriesElement;
+}
+
+static TiXmlElement* createCellElement(Cell* cell)
+{
+    TiXmlElement *cellElement = new TiXmlElement("cell");
+
+    cellElement->SetAttribute("id", cell->getId());
+
+    // create image-location element
+    {
+        const ImageLocation& imageLocation = cell->getLocation();
+
+        TiXmlElement *imageLocationElement = new TiXmlElement("image-location");
+        cellElement->LinkEndChild(imageLocationElement);
+
+        imageLocationElement->SetAttribute("w", imageLocation.well);
+        imageLocationElement->SetAttribute("p", imageLocation.position);
+        imageLocationElement->SetAttribute("s", imageLocation.slide);
+    }
+
+    // create observations elements
+    Cell::ObservationIterator observationIt = cell->getObservationStart();
+    Cell::ObservationIterator observationEnd = cell->getObservationEnd();
+    for (;observationIt != observationEnd; ++observationIt)
+    {
+        CellObservation* observation = *observationIt;
+
+        TiXmlElement *observationElement = new TiXmlElement("o");
+        cellElement->LinkEndChild(observationElement);
+
+        // set time attribute
+        short time = observation->getTime();
+        observationElement->SetAttribute("t", time);
+
+        // create region element
+        {
+            const ImageRegion& imageRegion = observation->getRegion();
+
+            TiXmlElement *regionElement = new TiXmlElement("r");
+            observationElement->LinkEndChild(regionElement);
+
+            regionElement->SetAttribute("x", imageRegion.GetIndex()[0]);
+            regionElement->SetAttribute("y", imageRegion.GetIndex()[1]);
+            regionElement->SetAttribute("w", imageRegion.GetSize()[0]);
+            regionElement->SetAttribute("h", imageRegion.GetSize()[1]);
+        }
+
+        // create feature value elements
+        {
+            for (int featureIndex = 0; featureIndex < observation->getNumberOfFeatures(); ++featureIndex)
+            {
+                if (! observation->isFeatureAvailable(featureIndex))
+                    continue;
+
+                float featureValue = observation->getFeature(featureIndex); 
+
+                TiXmlElement *featureValueElement = new TiXmlElement("f");
+                observationElement->LinkEndChild(featureValueElement);
+
+                featureValueElement->SetAttribute("i", featureIndex);
+                featureValueElement->SetDoubleAttribute("v", featureValue);
+            }
+        }
+    }
+
+    return cellElement;
+}
+
+/**
+ * Writes the document to a temporary file first and renames it afterwards,
+ * so that an interrupted write does not leave a truncated file behind.
+ */
+static void saveDocument(const TiXmlDocument& document, const std::string& filePath)
+{
+    std::string temporaryFilePath = filePath + ".tmp";
+
+    std::ofstream file;
+    file.open (temporaryFilePath.c_str());
+    file << document;
+    file.close();
+
+    if (file.bad() || file.fail())
+    {
+        throw IOException("cannot save document");
+    }
+
+    replaceFile(temporaryFilePath, filePath);
+}
+
 void saveAnalysis(const Analysis& analysis)
 {
 	TiXmlDocument document;
@@ -101,17 +212,7 @@ void saveAnalysis(const Analysis& analysis)
         for (;imageSeriesIt != imageSeriesEnd; ++imageSeriesIt)
         {
             const ImageSeries& imageSeries = *imageSeriesIt;
-            const ImageLocation& location = imageSeries.location;
-            const ImageSeries::TimeRange& timeRange = imageSeries.timeRange;
-
-            TiXmlElement *imageSeriesElement = new TiXmlElement("image-series");
-            imagesElement->LinkEndChild(imageSeriesElement);
-
-            imageSeriesElement->SetAttribute("well", location.well);
-            imageSeriesElement->SetAttribute("position", location.position);
-            imageSeriesElement->SetAttribute("slide", location.slide);
-            imageSeriesElement->SetAttribute("start", timeRange.min);
-            imageSeriesElement->SetAttribute("end", timeRange.max);
+            imagesElement->LinkEndChild(createImageSeriesElement(imageSeries));
         }
     }
 
@@ -125,68 +226,7 @@ void saveAnalysis(const Analysis& analysis)
         for (;cellIt != cellEnd; ++cellIt)
         {
             Cell* cell = *cellIt;
-
-            TiXmlElement *cellElement = new TiXmlElement("cell");
-            cellsElement->LinkEndChild(cellElement);
-
-            cellElement->SetAttribute("id", cell->getId());
-
-            // create image-location element
-            {
-                const ImageLocation& imageLocation = cell->getLocation();
-
-                TiXmlElement *imageLocationElement = new TiXmlElement("image-location");
-                cellElement->LinkEndChild(imageLocationElement);
-
-                imageLocationElement->SetAttribute("w", imageLocation.well);
-                imageLocationElement->SetAttribute("p", imageLocation.position);
-                imageLocationElement->SetAttribute("s", imageLocation.slide);
-            }
-
-            // create observations elements
-            Cell::ObservationIterator observationIt = cell->getObservationStart();
-            Cell::ObservationIterator observationEnd = cell->getObservationEnd();
-            for (;observationIt != observationEnd; ++observationIt)
-            {
-                CellObservation* observation = *observationIt;
-
-                TiXmlElement *observationElement = new TiXmlElement("o");
-                cellElement->LinkEndChild(observationElement);
-
-                // set time attribute
-                short time = observation->getTime();
-                observationElement->SetAttribute("t", time);
-
-                // create region element
-                {
-                    const ImageRegion& imageRegion = observation->getRegion();
-
-                    TiXmlElement *regionElement = new TiXmlElement("r");
-                    observationElement->LinkEndChild(regionElement);
-
-                    regionElement->SetAttribute("x", imageRegion.GetIndex()[0]);
-                    regionElement->SetAttribute("y", imageRegion.GetIndex()[1]);
-                    regionElement->SetAttribute("w", imageRegion.GetSize()[0]);
-                    regionElement->SetAttribute("h", imageRegion.GetSize()[1]);
-                }
-
-                // create feature value elements
-                {
-                    for (int featureIndex = 0; featureIndex < observation->getNumberOfFeatures(); ++featureIndex)
-                    {
-                        if (! observation->isFeatureAvailable(featureIndex))
-                            continue;
-
-                        float featureValue = observation->getFeature(featureIndex); 
-
-                        TiXmlElement *featureValueElement = new TiXmlElement("f");
-                        observationElement->LinkEndChild(featureValueElement);
-
-                        featureValueElement->SetAttribute("i", featureIndex);
-                        featureValueElement->SetDoubleAttribute("v", featureValue);
-                    }
-                }
-            }
+            cellsElement->LinkEndChild(createCellElement(cell));
         }
     }
 
@@ -197,21 +237,7 @@ void saveAnalysis(const Analysis& analysis)
         filePathStream << "analysis.xml";
         std::string filePath = filePathStream.str();
 
-        std::ofstream file;
-        file.open (filePath.c_str());
-        file << document;
-        file.close();
-
-        if (file.bad() || file.fail())
-        {
-            throw IOException("cannot save document");
-        }
-
-        //bool successful = document.SaveFile(filePath.c_str());
-        //if (!successful)
-        //{
-        //    throw IOException("cannot save document");
-        //}
+        saveDocument(document, filePath);
     }
 }
 
@@ -282,6 +308,70 @@ double readDoubleAttribute(TiXmlElement* element, const char* attributeName)
     return doubleValue;
 }
 
+static ImageSeries readImageSeriesElement(TiXmlElement* imageSeriesElement)
+{
+    ImageLocation location;
+    location.well = (short) readIntAttribute(imageSeriesElement, "well");
+    location.position = (short) readIntAttribute(imageSeriesElement, "position");
+    location.slide = (short) readIntAttribute(imageSeriesElement, "slide");
+
+    ImageSeries::TimeRange timeRange;
+    timeRange.min = (short) readIntAttribute(imageSeriesElement, "start");
+    timeRange.max = (short) readIntAttribute(imageSeriesElement, "end");
+
+    return ImageSeries(location, timeRange);
+}
+
+static std::auto_ptr<Cell> readCellElement(TiXmlElement* cellElement, int numberOfFeatures)
+{
+    int cellId = readIntAttribute(cellElement, "id");
+
+    // read image-location element
+    TiXmlElement* imageLocationElement = readFirstChildElement(cellElement, "image-location");
+    int well = readIntAttribute(imageLocationElement, "w");
+    int position = readIntAttribute(imageLocationElement, "p");
+    int slide = readIntAttribute(imageLocationElement, "s");
+    ImageLocation imageLocation(well, position, slide);
+
+    std::auto_ptr<Cell> cell(new Cell(cellId, imageLocation));
+
+    // read observation elements
+    TiXmlElement* observationElement = TiXmlHandle(cellElement).FirstChildElement("o").Element();
+    for (;observationElement; observationElement = observationElement->NextSiblingElement("o"))
+    {
+        // read time attribute
+        int time = readIntAttribute(observationElement, "t");
+
+        CellObservation* observation = new CellObservation(time, numberOfFeatures);
+        cell->addObservation(std::auto_ptr<CellObservation>(observation));
+
+        // read region element
+        TiXmlElement* regionElement = readFirstChildElement(observationElement, "r");
+        int x = readIntAttribute(regionElement, "x");
+        int y = readIntAttribute(regionElement, "y");
+        int width = readIntAttribute(regionElement, "w");
+        int height = readIntAttribute(regionElement, "h");
+        ImageIndex index;
+        index[0] = x;
+        index[1] = y;
+        ImageSize size;
+        size[0] = width;
+        size[1] = height;
+        observation->setRegion(ImageRegion(index, size));
+
+        // read feature value elements
+        TiXmlElement* featureValueElement = TiXmlHandle(observationElement).FirstChildElement("f").Element();
+        for (;featureValueElement; featureValueElement = featureValueElement->NextSiblingElement("f"))
+        {
+            int featureIndex = readIntAttribute(featureValueElement, "i");
+            float featureValue = (float) readDoubleAttribute(featureValueElement, "v");
+            observation->setFeature(featureIndex, featureValue);
+        }
+    }
+
+    return cell;
+}
+
 std::auto_ptr<Analysis> loadAnalysis(const char *filepath)
 {
     TiXmlDocument document(filepath);
@@ -342,17 +432,7 @@ std::auto_ptr<Analysis> loadAnalysis(const char *filepath)
     TiXmlElement* imageSeriesElement = TiXmlHandle(imagesElement).FirstChildElement("image-series").Element();
     for (;imageSeriesElement; imageSeriesElement = imageSeriesElement->NextSiblingElement("image-series"))
     {
-        ImageLocation location;
-        location.well = (short) readIntAttribute(imageSeriesElement, "well");
-        location.position = (short) readIntAttribute(imageSeriesElement, "position");
-        location.slide = (short) readIntAttribute(imageSeriesElement, "slide");
-
-        ImageSeries::TimeRange timeRange;
-        timeRange.min = (short) readIntAttribute(imageSeriesElement, "start");
-        timeRange.max = (short) readIntAttribute(imageSeriesElement, "end");
-
-        ImageSeries imageSeries(location, timeRange);
-        analysis->addImageSeries(imageSeries);
+        analysis->addImageSeries(readImageSeriesElement(imageSeriesElement));
     }
 
     // read cells element
@@ -360,55 +440,294 @@ std::auto_ptr<Analysis> loadAnalysis(const char *filepath)
     TiXmlElement* cellElement = TiXmlHandle(cellsElement).FirstChildElement("cell").Element();
     for (;cellElement; cellElement = cellElement->NextSiblingElement("cell"))
     {
-        int cellId = readIntAttribute(cellElement, "id");
+        int numberOfFeatures = analysisMetadata.featureNames.size();
+        analysis->addCell(readCellElement(cellElement, numberOfFeatures));
+    }
 
-        // read image-location element
-        TiXmlElement* imageLocationElement = readFirstChildElement(cellElement, "image-location");
-        int well = readIntAttribute(imageLocationElement, "w");
-        int position = readIntAttribute(imageLocationElement, "p");
-        int slide = readIntAttribute(imageLocationElement, "s");
-        ImageLocation imageLocation(well, position, slide);
+    return analysis;
+}
+
+/**
+ * Replaces every cell id stored in the analysis image by the id returned by
+ * the relabel functor.
+ */
+template <class TRelabelFunctor>
+static void relabelAnalysisImage(RGBAImage* image, TRelabelFunctor relabel)
+{
+    itk::ImageRegionIterator<RGBAImage> it(image, image->GetLargestPossibleRegion());
+    for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+    {
+        RGBAPixel pixel = it.Get();
 
-        Cell* cell = new Cell(cellId, imageLocation);
-        analysis->addCell(std::auto_ptr<Cell>(cell));
+        int cellId = Analysis::decodeCellId(pixel);
+        if (cellId == 0)
+            continue;
 
-        // read observation elements
-        TiXmlElement* observationElement = TiXmlHandle(cellElement).FirstChildElement("o").Element();
-        for (;observationElement; observationElement = observationElement->NextSiblingElement("o"))
+        cellId = relabel(cellId);
+        if (cellId > Analysis::MAX_ENCODABLE_CELL_ID)
         {
-            // read time attribute
-            int time = readIntAttribute(observationElement, "t");
-
-            int numFeatures = analysisMetadata.featureNames.size();
-            CellObservation* observation = new CellObservation(time, numFeatures);
-            cell->addObservation(std::auto_ptr<CellObservation>(observation));
-
-            // read region element
-            TiXmlElement* regionElement = readFirstChildElement(observationElement, "r");
-            int x = readIntAttribute(regionElement, "x");
-            int y = readIntAttribute(regionElement, "y");
-            int width = readIntAttribute(regionElement, "w");
-            int height = readIntAttribute(regionElement, "h");
-            ImageIndex index;
-            index[0] = x;
-            index[1] = y;
-            ImageSize size;
-            size[0] = width;
-            size[1] = height;
-            observation->setRegion(ImageRegion(index, size));
-
-            // read feature value elements
-            TiXmlElement* featureValueElement = TiXmlHandle(observationElement).FirstChildElement("f").Element();
-            for (;featureValueElement; featureValueElement = featureValueElement->NextSiblingElement("f"))
+            throw InvalidArgumentException("cell id exceeds the range of the analysis image format");
+        }
+
+        Analysis::encodeCellId(cellId, pixel);
+        it.Set(pixel);
+    }
+}
+
+class CellIdOffsetFunctor
+{
+public:
+
+    CellIdOffsetFunctor(int cellIdOffset) : cellIdOffset_(cellIdOffset) { }
+
+    int operator()(int cellId) const
+    {
+        return cellId + cellIdOffset_;
+    }
+
+private:
+
+    int cellIdOffset_;
+};
+
+class CellIdMapFunctor
+{
+public:
+
+    CellIdMapFunctor(const std::vector<int>& cellIds) : cellIds_(cellIds) { }
+
+    int operator()(int cellId) const
+    {
+        if (cellId >= (int)cellIds_.size() || cellIds_[cellId] == 0)
+        {
+            throw InvalidArgumentException("analysis image contains an unknown cell id");
+        }
+        return cellIds_[cellId];
+    }
+
+private:
+
+    const std::vector<int>& cellIds_;
+};
+
+void copyAnalysisImage(
+        const AnalysisMetadata& sourceMetadata, 
+        const AnalysisMetadata& targetMetadata, 
+        const ImageKey& imageKey, 
+        int cellIdOffset)
+{
+    typedef itk::ImageFileReader<RGBAImage> FileReader;
+    typedef itk::ImageFileWriter<RGBAImage> FileWriter;
+
+    std::string sourceFilePath = sourceMetadata.getFilePath(imageKey);
+    std::string targetFilePath = targetMetadata.getFilePath(imageKey);
+
+    std::string temporaryFilePath = getTemporaryFilePath(targetFilePath);
+
+    try
+    {
+        FileReader::Pointer fileReader = FileReader::New();
+        fileReader->SetFileName(sourceFilePath.c_str());
+        fileReader->Update();
+
+        RGBAImage::Pointer image = fileReader->GetOutput();
+        image->DisconnectPipeline();
+
+        if (cellIdOffset != 0)
+        {
+            relabelAnalysisImage(image, CellIdOffsetFunctor(cellIdOffset));
+        }
+
+        FileWriter::Pointer fileWriter = FileWriter::New();
+        fileWriter->SetFileName(temporaryFilePath.c_str());
+        fileWriter->SetInput(image);
+        fileWriter->Update();
+    }
+    catch (itk::ExceptionObject& e)
+    {
+        std::stringstream message;
+        message << "cannot copy analysis image " << sourceFilePath << ": " << e.what();
+        throw IOException(message.str().c_str());
+    }
+
+    replaceFile(temporaryFilePath, targetFilePath);
+}
+
+void mapAnalysisImageCellIds(RGBAImage* image, const std::vector<int>& cellIds)
+{
+    relabelAnalysisImage(image, CellIdMapFunctor(cellIds));
+}
+
+void replaceFile(const std::string& sourcePath, const std::string& targetPath)
+{
+#ifdef WIN32
+    // rename does not replace existing files on Windows
+    remove(targetPath.c_str());
+#endif
+    if (rename(sourcePath.c_str(), targetPath.c_str()) != 0)
+    {
+        std::stringstream message;
+        message << "cannot rename " << sourcePath << " to " << targetPath;
+        throw IOException(message.str().c_str());
+    }
+}
+
+std::string getTemporaryFilePath(const std::string& filePath)
+{
+    // a dot in a directory name does not start an extension
+    std::string::size_type extensionPos = filePath.rfind('.');
+    std::string::size_type separatorPos = filePath.find_last_of("/\\");
+    if (extensionPos == std::string::npos || 
+        (separatorPos != std::string::npos && extensionPos < separatorPos))
+    {
+        extensionPos = filePath.size();
+    }
+
+    std::string temporaryFilePath = filePath;
+    temporaryFilePath.insert(extensionPos, ".tmp");
+    return temporaryFilePath;
+}
+
+static std::string getJournalFilePath(const AnalysisMetadata& metadata, const ImageLocation& location)
+{
+    std::stringstream filePath;
+    filePath << metadata.baseDirectory;
+
+    filePath << "journal_w" << location.well 
+             << "_p" << location.position
+             << "_s" << location.slide
+             << ".xml";
+    return filePath.str();
+}
+
+void saveImageSeriesJournal(const Analysis& analysis, const ImageSeries& imageSeries)
+{
+    TiXmlDocument document;
+    
+    // initialize document
+    TiXmlDeclaration *xmlDeclaration = new TiXmlDeclaration("1.0", "", "");
+    document.LinkEndChild(xmlDeclaration);
+
+    // create journal element
+    TiXmlElement *journalElement = new TiXmlElement("journal");
+    document.LinkEndChild(journalElement);
+
+    journalElement->LinkEndChild(createImageSeriesElement(imageSeries));
+
+    // create cell elements of the image series
+    {
+        TiXmlElement *cellsElement = new TiXmlElement("cells");
+        journalElement->LinkEndChild(cellsElement);
+
+        Analysis::CellIterator cellIt = (const_cast<Analysis&>(analysis)).getCellStart();
+        Analysis::CellIterator cellEnd = (const_cast<Analysis&>(analysis)).getCellEnd();
+        for (;cellIt != cellEnd; ++cellIt)
+        {
+            Cell* cell = *cellIt;
+            if (cell->getLocation() == imageSeries.location)
             {
-                int featureIndex = readIntAttribute(featureValueElement, "i");
-                float featureValue = (float) readDoubleAttribute(featureValueElement, "v");
-                observation->setFeature(featureIndex, featureValue);
+                cellsElement->LinkEndChild(createCellElement(cell));
             }
         }
     }
 
-    return analysis;
+    saveDocument(document, getJournalFilePath(analysis.getMetadata(), imageSeries.location));
+}
+
+bool loadImageSeriesJournal(Analysis& analysis, const ImageSeries& imageSeries)
+{
+    const AnalysisMetadata& metadata = analysis.getMetadata();
+
+    std::string filePath = getJournalFilePath(metadata, imageSeries.location);
+    if (! itksys::SystemTools::FileExists(filePath.c_str()))
+    {
+        return false;
+    }
+
+    // the journal is only valid if all analysis images were written
+    for (short time = imageSeries.timeRange.min; time <= imageSeries.timeRange.max; ++time)
+    {
+        std::string imageFilePath = metadata.getFilePath(imageSeries.getImageKey(time));
+        if (! itksys::SystemTools::FileExists(imageFilePath.c_str()))
+        {
+            return false;
+        }
+    }
+
+    TiXmlDocument document(filePath.c_str());
+    if (! document.LoadFile())
+    {
+        return false;
+    }
+
+    // read all cells before modifying the analysis, a journal which cannot
+    // be read is treated like a missing one
+    std::vector<Cell*> cells;
+    try
+    {
+        TiXmlElement* journalElement = readFirstChildElement(&document, "journal");
+
+        // the journal must belong to the same image series
+        TiXmlElement* imageSeriesElement = readFirstChildElement(journalElement, "image-series");
+        ImageSeries journalImageSeries = readImageSeriesElement(imageSeriesElement);
+        if (journalImageSeries.location != imageSeries.location || 
+            journalImageSeries.timeRange.min != imageSeries.timeRange.min || 
+            journalImageSeries.timeRange.max != imageSeries.timeRange.max)
+        {
+            return false;
+        }
+
+        int numberOfFeatures = metadata.featureNames.size();
+
+        TiXmlElement* cellsElement = readFirstChildElement(journalElement, "cells");
+        TiXmlElement* cellElement = TiXmlHandle(cellsElement).FirstChildElement("cell").Element();
+        for (;cellElement; cellElement = cellElement->NextSiblingElement("cell"))
+        {
+            cells.push_back(readCellElement(cellElement, numberOfFeatures).release());
+        }
+    }
+    catch (IOException&)
+    {
+        for (unsigned int i = 0; i < cells.size(); ++i)
+        {
+            delete cells[i];
+        }
+        return false;
+    }
+
+    // the cell ids of the image series must continue those of the analysis,
+    // otherwise the journal was written by a different run
+    bool consistent = true;
+    for (unsigned int i = 0; i < cells.size(); ++i)
+    {
+        if (cells[i]->getId() != analysis.getNumberOfCells() + (int)i + 1)
+        {
+            consistent = false;
+        }
+    }
+
+    if (! consistent)
+    {
+        for (unsigned int i = 0; i < cells.size(); ++i)
+        {
+            delete cells[i];
+        }
+        return false;
+    }
+
+    analysis.addImageSeries(imageSeries);
+    for (unsigned int i = 0; i < cells.size(); ++i)
+    {
+        analysis.addCell(std::auto_ptr<Cell>(cells[i]));
+    }
+
+    return true;
+}
+
+void removeImageSeriesJournal(const Analysis& analysis, const ImageSeries& imageSeries)
+{
+    std::string filePath = getJournalFilePath(analysis.getMetadata(), imageSeries.location);
+    remove(filePath.c_str());
 }
 
 }
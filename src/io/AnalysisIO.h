@@ -27,6 +27,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define AnalysisIO_h
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <Analysis.h>
 
@@ -37,6 +39,51 @@ void saveAnalysis(const Analysis& analysis);
 
 std::auto_ptr<Analysis> loadAnalysis(const char *filepath);
 
+/**
+ * Saves the cells of a finished image series to a journal file in the
+ * analysis directory, so that an interrupted analysis can be resumed.
+ */
+void saveImageSeriesJournal(const Analysis& analysis, const ImageSeries& imageSeries);
+
+/**
+ * Adds the image series and its cells from the journal file to the analysis.
+ * Returns false and leaves the analysis unchanged if there is no valid
+ * journal, i.e. if it is missing, an analysis image of the image series is
+ * missing or the cell ids do not continue those of the analysis.
+ */
+bool loadImageSeriesJournal(Analysis& analysis, const ImageSeries& imageSeries);
+
+void removeImageSeriesJournal(const Analysis& analysis, const ImageSeries& imageSeries);
+
+/**
+ * Copies the analysis image of the given image from the source to the target
+ * analysis, adding cellIdOffset to every cell id stored in it.  Background
+ * pixels are left unchanged.
+ */
+void copyAnalysisImage(
+        const AnalysisMetadata& sourceMetadata, 
+        const AnalysisMetadata& targetMetadata, 
+        const ImageKey& imageKey, 
+        int cellIdOffset);
+
+/**
+ * Replaces every cell id stored in the analysis image by cellIds[id].
+ * Background pixels are left unchanged.
+ */
+void mapAnalysisImageCellIds(RGBAImage* image, const std::vector<int>& cellIds);
+
+/**
+ * Renames sourcePath to targetPath, replacing an existing file.
+ */
+void replaceFile(const std::string& sourcePath, const std::string& targetPath);
+
+/**
+ * Returns the path of the temporary file a file is written to before it
+ * replaces the file.  The extension is kept, so that the image writers still
+ * recognize the format.
+ */
+std::string getTemporaryFilePath(const std::string& filePath);
+
 }
 
 #endif
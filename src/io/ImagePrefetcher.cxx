@@ -0,0 +1,165 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <io/ImagePrefetcher.h>
+
+#include <sstream>
+
+#include <common.h>
+
+namespace PT
+{
+
+class ImagePrefetcher::ReadJob : public Job
+{
+public:
+
+    ReadJob(ImagePrefetcher* prefetcher, int index) :
+        prefetcher_(prefetcher),
+        index_(index)
+    {
+    }
+
+    void run(int workerIndex)
+    {
+        prefetcher_->readImage(index_, workerIndex);
+    }
+
+private:
+
+    ImagePrefetcher* prefetcher_;
+
+    int index_;
+};
+
+ImagePrefetcher::ImagePrefetcher(
+        const std::vector<std::string>& filePaths,
+        int shrinkFactor,
+        int numberOfPrefetchedImages,
+        int numberOfThreads) :
+    filePaths_(filePaths),
+    images_(filePaths.size()),
+    numberOfPrefetchedImages_(numberOfPrefetchedImages),
+    numberOfRequestedImages_(0),
+    numberOfTakenImages_(0),
+    imageFinished_(itk::ConditionVariable::New()),
+    // the prefetched images and as many images kept by the consumers
+    bufferPool_(2 * numberOfPrefetchedImages),
+    workerPool_(numberOfThreads)
+{
+    assert(shrinkFactor > 0);
+    assert(numberOfPrefetchedImages > 0);
+
+    for (int i = 0; i < workerPool_.getNumberOfWorkers(); ++i)
+    {
+        FileReader::Pointer fileReader = FileReader::New();
+        fileReader->setShrinkFactor(shrinkFactor);
+        fileReader->SetReleaseDataBeforeUpdateFlag(false);
+        fileReaders_.push_back(fileReader);
+    }
+
+    mutex_.Lock();
+    prefetchImages();
+    mutex_.Unlock();
+}
+
+IntensityImage::Pointer ImagePrefetcher::takeImage(int index)
+{
+    assert(index >= 0 && index < (int)images_.size());
+
+    mutex_.Lock();
+
+    // make sure the image is requested even if it is not taken in order
+    while (numberOfRequestedImages_ <= index)
+    {
+        std::auto_ptr<Job> job(new ReadJob(this, numberOfRequestedImages_++));
+        workerPool_.addJob(job);
+    }
+
+    PrefetchedImage& prefetchedImage = images_[index];
+    while (!prefetchedImage.finished)
+    {
+        imageFinished_->Wait(&mutex_);
+    }
+
+    IntensityImage::Pointer image = prefetchedImage.image;
+    std::string errorMessage = prefetchedImage.errorMessage;
+    prefetchedImage.image = 0;
+
+    ++numberOfTakenImages_;
+    prefetchImages();
+
+    mutex_.Unlock();
+
+    if (!errorMessage.empty())
+    {
+        throw IOException(errorMessage.c_str());
+    }
+
+    return image;
+}
+
+void ImagePrefetcher::readImage(int index, int workerIndex)
+{
+    IntensityImage::Pointer image;
+    std::string errorMessage;
+    try
+    {
+        // disconnecting the previous output gave the reader a new one
+        FileReader* fileReader = fileReaders_[workerIndex];
+        fileReader->setFileName(filePaths_[index]);
+        bufferPool_.assignBuffer(fileReader->GetOutput());
+        fileReader->Update();
+
+        image = fileReader->GetOutput();
+        image->DisconnectPipeline();
+    }
+    catch (std::exception& e)
+    {
+        std::stringstream message;
+        message << "cannot read image " << filePaths_[index] << ": " << e.what();
+        errorMessage = message.str();
+    }
+
+    mutex_.Lock();
+    images_[index].image = image;
+    images_[index].errorMessage = errorMessage;
+    images_[index].finished = true;
+    imageFinished_->Broadcast();
+    mutex_.Unlock();
+}
+
+void ImagePrefetcher::prefetchImages()
+{
+    int numberOfImages = images_.size();
+    while (numberOfRequestedImages_ < numberOfImages && 
+           numberOfRequestedImages_ - numberOfTakenImages_ < numberOfPrefetchedImages_)
+    {
+        std::auto_ptr<Job> job(new ReadJob(this, numberOfRequestedImages_++));
+        workerPool_.addJob(job);
+    }
+}
+
+}
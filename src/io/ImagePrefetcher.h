@@ -0,0 +1,128 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef ImagePrefetcher_h
+#define ImagePrefetcher_h
+
+#include <string>
+#include <vector>
+
+#include <itkConditionVariable.h>
+#include <itkMutexLock.h>
+
+#include <ImageBufferPool.h>
+#include <WorkerPool.h>
+#include <images.h>
+#include <io/ShrinkingImageFileReader.h>
+
+namespace PT
+{
+
+/**
+ * The ImagePrefetcher reads a list of images in the background, so that
+ * reading the next images overlaps with processing the current one.  The
+ * images are shrunk while they are read, see ShrinkingImageFileReader.  The
+ * images are read in the order of the list.  At most a fixed number of
+ * images are read ahead of the ones taken.  The buffers of taken images are
+ * reused for reading further images once they are released.  Every thread
+ * keeps its own reader, so that the file buffer of the reader is reused as
+ * well.
+ */
+class ImagePrefetcher
+{
+public:
+
+    /**
+     * Starts reading the first numberOfPrefetchedImages images using
+     * numberOfThreads threads.  The images are shrunk by shrinkFactor.
+     */
+    ImagePrefetcher(
+            const std::vector<std::string>& filePaths,
+            int shrinkFactor,
+            int numberOfPrefetchedImages,
+            int numberOfThreads);
+
+    /**
+     * Returns the image with the given index in the list, blocking until it
+     * has been read.  Every image can be taken only once.  Throws an
+     * IOException if the image could not be read.
+     */
+    IntensityImage::Pointer takeImage(int index);
+
+private:
+
+    // not implemented
+    ImagePrefetcher(const ImagePrefetcher&);
+    void operator=(const ImagePrefetcher&);
+
+    struct PrefetchedImage
+    {
+        IntensityImage::Pointer image;
+
+        std::string errorMessage;
+
+        bool finished;
+
+        PrefetchedImage() : finished(false) { }
+    };
+
+    typedef ShrinkingImageFileReader<IntensityImage> FileReader;
+
+    class ReadJob;
+
+    void readImage(int index, int workerIndex);
+
+    /**
+     * Adds read jobs until the number of images which were not taken
+     * reaches the limit.  The mutex must be locked by the caller.
+     */
+    void prefetchImages();
+
+    std::vector<std::string> filePaths_;
+
+    std::vector<PrefetchedImage> images_;
+
+    int numberOfPrefetchedImages_;
+
+    int numberOfRequestedImages_;
+
+    int numberOfTakenImages_;
+
+    itk::SimpleMutexLock mutex_;
+
+    itk::ConditionVariable::Pointer imageFinished_;
+
+    ImageBufferPool<IntensityImage> bufferPool_;
+
+    // one reader per worker
+    std::vector<FileReader::Pointer> fileReaders_;
+
+    // declared last, so that the pending read jobs are finished before the
+    // images are destroyed
+    WorkerPool workerPool_;
+};
+
+}
+#endif
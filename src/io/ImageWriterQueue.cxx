@@ -0,0 +1,171 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <io/ImageWriterQueue.h>
+
+#include <sstream>
+
+#include <itkImageFileWriter.h>
+#include <itksys/SystemTools.hxx>
+
+#include <common.h>
+#include <io/AnalysisIO.h>
+
+namespace PT
+{
+
+class ImageWriterQueue::WriteJob : public Job
+{
+public:
+
+    WriteJob(ImageWriterQueue* writerQueue, RGBAImage* image, const std::string& filePath) :
+        writerQueue_(writerQueue),
+        image_(image),
+        filePath_(filePath)
+    {
+    }
+
+    void run(int workerIndex)
+    {
+        typedef itk::ImageFileWriter<RGBAImage> FileWriter;
+
+        // the image is written to a temporary file first, so that an
+        // existing image file is always complete
+        std::string temporaryFilePath = getTemporaryFilePath(filePath_);
+
+        double startWallTime = itksys::SystemTools::GetTime();
+        double startCpuTime = getThreadCpuTime();
+
+        std::string errorMessage;
+        try
+        {
+            FileWriter::Pointer fileWriter = FileWriter::New();
+            fileWriter->SetFileName(temporaryFilePath.c_str());
+            fileWriter->SetInput(image_);
+            fileWriter->Update();
+
+            replaceFile(temporaryFilePath, filePath_);
+        }
+        catch (std::exception& e)
+        {
+            std::stringstream message;
+            message << "cannot write image " << filePath_ << ": " << e.what();
+            errorMessage = message.str();
+        }
+
+        Statistics statistics;
+        statistics.numberOfImages = 1;
+        statistics.wallTime = itksys::SystemTools::GetTime() - startWallTime;
+        statistics.cpuTime = getThreadCpuTime() - startCpuTime;
+        statistics.numberOfPixels = image_->GetBufferedRegion().GetNumberOfPixels();
+
+        // release the image before the next one may be queued
+        image_ = 0;
+
+        writerQueue_->finishImage(errorMessage, statistics);
+    }
+
+private:
+
+    ImageWriterQueue* writerQueue_;
+
+    RGBAImage::Pointer image_;
+
+    std::string filePath_;
+};
+
+ImageWriterQueue::ImageWriterQueue(int maxNumberOfPendingImages, int numberOfThreads) :
+    maxNumberOfPendingImages_(maxNumberOfPendingImages),
+    numberOfPendingImages_(0),
+    imageWritten_(itk::ConditionVariable::New()),
+    workerPool_(numberOfThreads)
+{
+    assert(maxNumberOfPendingImages > 0);
+}
+
+void ImageWriterQueue::writeImage(RGBAImage* image, const std::string& filePath)
+{
+    assert(image != 0);
+
+    mutex_.Lock();
+    while (numberOfPendingImages_ >= maxNumberOfPendingImages_ && errorMessage_.empty())
+    {
+        imageWritten_->Wait(&mutex_);
+    }
+    checkError();
+    ++numberOfPendingImages_;
+    mutex_.Unlock();
+
+    std::auto_ptr<Job> job(new WriteJob(this, image, filePath));
+    workerPool_.addJob(job);
+}
+
+void ImageWriterQueue::waitForImages()
+{
+    mutex_.Lock();
+    while (numberOfPendingImages_ > 0)
+    {
+        imageWritten_->Wait(&mutex_);
+    }
+    checkError();
+    mutex_.Unlock();
+}
+
+ImageWriterQueue::Statistics ImageWriterQueue::getStatistics()
+{
+    mutex_.Lock();
+    Statistics statistics = statistics_;
+    mutex_.Unlock();
+
+    return statistics;
+}
+
+void ImageWriterQueue::finishImage(const std::string& errorMessage, const Statistics& statistics)
+{
+    mutex_.Lock();
+    if (!errorMessage.empty() && errorMessage_.empty())
+    {
+        errorMessage_ = errorMessage;
+    }
+    statistics_.numberOfImages += statistics.numberOfImages;
+    statistics_.wallTime += statistics.wallTime;
+    statistics_.cpuTime += statistics.cpuTime;
+    statistics_.numberOfPixels += statistics.numberOfPixels;
+    --numberOfPendingImages_;
+    imageWritten_->Broadcast();
+    mutex_.Unlock();
+}
+
+void ImageWriterQueue::checkError()
+{
+    if (!errorMessage_.empty())
+    {
+        std::string errorMessage = errorMessage_;
+        mutex_.Unlock();
+        throw IOException(errorMessage.c_str());
+    }
+}
+
+}
@@ -0,0 +1,126 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef ImageWriterQueue_h
+#define ImageWriterQueue_h
+
+#include <string>
+
+#include <itkConditionVariable.h>
+#include <itkMutexLock.h>
+
+#include <WorkerPool.h>
+#include <images.h>
+
+namespace PT
+{
+
+/**
+ * The ImageWriterQueue writes analysis images in the background, so that
+ * compressing and writing an image overlaps with processing the next ones.
+ * The number of images waiting to be written is limited; writeImage()
+ * blocks while the limit is reached.  The time spent writing is measured.
+ */
+class ImageWriterQueue
+{
+public:
+
+    /**
+     * The time and throughput of writing, summed over the written images.
+     */
+    struct Statistics
+    {
+        int numberOfImages;
+
+        // in seconds
+        double wallTime;
+
+        // in seconds, see getThreadCpuTime()
+        double cpuTime;
+
+        double numberOfPixels;
+
+        Statistics() :
+            numberOfImages(0),
+            wallTime(0.0),
+            cpuTime(0.0),
+            numberOfPixels(0.0)
+        {}
+    };
+
+    ImageWriterQueue(int maxNumberOfPendingImages, int numberOfThreads);
+
+    /**
+     * Queues the image for writing.  The image must not be modified
+     * afterwards.  Throws an IOException if writing a previous image failed.
+     */
+    void writeImage(RGBAImage* image, const std::string& filePath);
+
+    /**
+     * Blocks until all queued images are written.  Throws an IOException if
+     * writing an image failed.
+     */
+    void waitForImages();
+
+    /**
+     * Returns the statistics of the images written so far.
+     */
+    Statistics getStatistics();
+
+private:
+
+    // not implemented
+    ImageWriterQueue(const ImageWriterQueue&);
+    void operator=(const ImageWriterQueue&);
+
+    class WriteJob;
+
+    void finishImage(const std::string& errorMessage, const Statistics& statistics);
+
+    /**
+     * Throws an IOException if writing an image failed.  The mutex must be
+     * locked by the caller and is unlocked before throwing.
+     */
+    void checkError();
+
+    int maxNumberOfPendingImages_;
+
+    int numberOfPendingImages_;
+
+    std::string errorMessage_;
+
+    Statistics statistics_;
+
+    itk::SimpleMutexLock mutex_;
+
+    itk::ConditionVariable::Pointer imageWritten_;
+
+    // declared last, so that the pending write jobs are finished before the
+    // other members are destroyed
+    WorkerPool workerPool_;
+};
+
+}
+#endif
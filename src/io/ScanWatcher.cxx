@@ -0,0 +1,313 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <io/ScanWatcher.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <itksys/Directory.hxx>
+#include <itksys/SystemTools.hxx>
+
+namespace PT
+{
+
+static bool isImageFilename(const std::string& filename)
+{
+    std::string extension = itksys::SystemTools::LowerCase(
+        itksys::SystemTools::GetFilenameLastExtension(filename));
+    return extension == ".tif" || extension == ".png";
+}
+
+ScanWatcher::ScanWatcher(const std::string& directory, const ImageFilenameFormat& filenameFormat, short firstTime) :
+    directory_(directory),
+    filenameFormat_(filenameFormat),
+    firstTime_(firstTime)
+{
+    // ensure that directory ends with a slash or backslash
+#ifdef WIN32
+    if (directory_.empty() || directory_[directory_.size() - 1] != '\\')
+        directory_.append(1, '\\');
+#else
+    if (directory_.empty() || directory_[directory_.size() - 1] != '/')
+        directory_.append(1, '/');
+#endif
+
+    if (! itksys::SystemTools::FileIsDirectory(directory_.c_str()))
+    {
+        std::string message = "Invalid image directory: " + directory_;
+        throw IOException(message.c_str());
+    }
+
+#ifdef __linux__
+    inotifyDescriptor_ = inotify_init();
+    if (inotifyDescriptor_ < 0)
+    {
+        throw IOException("Cannot initialize inotify");
+    }
+
+    // images are reported when they are closed after writing or when they are
+    // moved into the directory, as acquisition software often writes to a
+    // temporary file first
+    if (inotify_add_watch(inotifyDescriptor_, directory_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(inotifyDescriptor_);
+        std::string message = "Cannot watch image directory: " + directory_;
+        throw IOException(message.c_str());
+    }
+
+    initialFilesListed_ = false;
+#endif
+}
+
+ScanWatcher::~ScanWatcher()
+{
+#ifdef __linux__
+    close(inotifyDescriptor_);
+#endif
+}
+
+int ScanWatcher::waitForImages(Scan& scan, int timeoutMilliseconds)
+{
+    std::set<std::string> filenames;
+
+#ifdef __linux__
+    // the directory is already watched, so no image gets lost between
+    // listing and waiting; the images present at the start are assumed to
+    // be complete
+    if (! initialFilesListed_)
+    {
+        listFiles(filenames);
+        initialFilesListed_ = true;
+    }
+    else
+#endif
+    {
+        waitForFiles(filenames, timeoutMilliseconds);
+    }
+
+    std::set<std::string>::const_iterator it = filenames.begin();
+    std::set<std::string>::const_iterator end = filenames.end();
+    for (; it != end; ++it)
+    {
+        addFile(*it);
+    }
+
+    return addPendingImages(scan);
+}
+
+#ifdef __linux__
+
+void ScanWatcher::waitForFiles(std::set<std::string>& filenames, int timeoutMilliseconds)
+{
+    struct pollfd pollDescriptor;
+    pollDescriptor.fd = inotifyDescriptor_;
+    pollDescriptor.events = POLLIN;
+    pollDescriptor.revents = 0;
+
+    int result = poll(&pollDescriptor, 1, timeoutMilliseconds);
+    if (result == 0 || (result < 0 && errno == EINTR))
+    {
+        return;
+    }
+    else if (result < 0)
+    {
+        throw IOException("Cannot wait for inotify events");
+    }
+
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t length = read(inotifyDescriptor_, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR)
+    {
+        return;
+    }
+    else if (length < 0)
+    {
+        throw IOException("Cannot read inotify events");
+    }
+
+    for (char* position = buffer; position < buffer + length;)
+    {
+        const struct inotify_event* event = (const struct inotify_event*) position;
+
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            // events were lost, so the whole directory has to be checked
+            listFiles(filenames);
+        }
+        else if (event->len > 0)
+        {
+            filenames.insert(event->name);
+        }
+
+        position += sizeof(struct inotify_event) + event->len;
+    }
+}
+
+#else
+
+void ScanWatcher::waitForFiles(std::set<std::string>& filenames, int timeoutMilliseconds)
+{
+    itksys::SystemTools::Delay(timeoutMilliseconds);
+
+    std::set<std::string> currentFilenames;
+    listFiles(currentFilenames);
+
+    // a file is considered complete if its size did not change since the
+    // last poll
+    std::map<std::string, unsigned long> fileSizes;
+
+    std::set<std::string>::const_iterator it = currentFilenames.begin();
+    std::set<std::string>::const_iterator end = currentFilenames.end();
+    for (; it != end; ++it)
+    {
+        const std::string& filename = *it;
+        if (addedFilenames_.find(filename) != addedFilenames_.end())
+        {
+            continue;
+        }
+
+        unsigned long fileSize = itksys::SystemTools::FileLength((directory_ + filename).c_str());
+
+        std::map<std::string, unsigned long>::const_iterator sizeIt = fileSizes_.find(filename);
+        if (sizeIt != fileSizes_.end() && (*sizeIt).second == fileSize)
+        {
+            filenames.insert(filename);
+        }
+        else
+        {
+            fileSizes[filename] = fileSize;
+        }
+    }
+
+    fileSizes_.swap(fileSizes);
+}
+
+#endif
+
+void ScanWatcher::listFiles(std::set<std::string>& filenames)
+{
+    itksys::Directory directory;
+    if (! directory.Load(directory_.c_str()))
+    {
+        std::string message = "Cannot read image directory: " + directory_;
+        throw IOException(message.c_str());
+    }
+
+    for (unsigned long i = 0; i < directory.GetNumberOfFiles(); ++i)
+    {
+        std::string filename(directory.GetFile(i));
+        if (isImageFilename(filename))
+        {
+            filenames.insert(filename);
+        }
+    }
+}
+
+void ScanWatcher::addFile(const std::string& filename)
+{
+    // a file is reported again if it is rewritten
+    if (addedFilenames_.find(filename) != addedFilenames_.end())
+    {
+        return;
+    }
+
+    // other files in the directory are ignored
+    ImageKey key;
+    if (! isImageFilename(filename) || ! parseImageFilename(filename, filenameFormat_, key))
+    {
+        return;
+    }
+
+    addedFilenames_.insert(filename);
+    pendingImageSeriesMap_[key.location][key.time] = filename;
+}
+
+int ScanWatcher::addPendingImages(Scan& scan)
+{
+    int numberOfAddedImages = 0;
+
+    PendingImageSeriesMap::iterator it = pendingImageSeriesMap_.begin();
+    while (it != pendingImageSeriesMap_.end())
+    {
+        const ImageLocation& location = (*it).first;
+        PendingImageMap& pendingImages = (*it).second;
+
+        // a new image series waits for its first time point, even if later
+        // images are completed before it
+        short nextTime;
+        if (scan.containsImageSeries(location))
+        {
+            nextTime = scan.getImageSeries(location).timeRange.max + 1;
+        }
+        else
+        {
+            nextTime = firstTime_;
+        }
+
+        // images which arrive too late cannot be added anymore
+        while (! pendingImages.empty() && (*pendingImages.begin()).first < nextTime)
+        {
+            droppedFilenames_.push_back((*pendingImages.begin()).second);
+            pendingImages.erase(pendingImages.begin());
+        }
+
+        while (! pendingImages.empty() && (*pendingImages.begin()).first == nextTime)
+        {
+            ImageMetadata imageMetadata;
+            imageMetadata.key = ImageKey(location, nextTime);
+            imageMetadata.filepath = directory_ + (*pendingImages.begin()).second;
+            scan.addImageMetadata(imageMetadata);
+
+            pendingImages.erase(pendingImages.begin());
+            ++nextTime;
+            ++numberOfAddedImages;
+        }
+
+        if (pendingImages.empty())
+        {
+            pendingImageSeriesMap_.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return numberOfAddedImages;
+}
+
+std::vector<std::string> ScanWatcher::takeDroppedFilenames()
+{
+    std::vector<std::string> droppedFilenames;
+    droppedFilenames.swap(droppedFilenames_);
+    return droppedFilenames;
+}
+
+}
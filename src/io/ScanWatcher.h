@@ -0,0 +1,121 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef ScanWatcher_h
+#define ScanWatcher_h
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <Scan.h>
+
+namespace PT
+{
+
+/**
+ * The ScanWatcher builds a scan from the images which are written into a
+ * directory during an acquisition.  The image keys are parsed from the
+ * filenames.  On Linux, the directory is watched with inotify, so that an
+ * image is noticed as soon as it has been completely written.  Elsewhere the
+ * directory is polled and an image is considered complete once its size
+ * stays the same between two polls.
+ *
+ * Images are only added to the scan in the order of their time points, so
+ * that the image series of the scan never have gaps.  An image series starts
+ * with the first time point of the acquisition, even if later images of the
+ * series are completed before it.  Images which cannot be added anymore are
+ * dropped and reported by takeDroppedFilenames().
+ */
+class ScanWatcher
+{
+public:
+
+    /**
+     * Throws an IOException if the directory cannot be watched.  The image
+     * series start with the time point firstTime.
+     */
+    ScanWatcher(const std::string& directory, const ImageFilenameFormat& filenameFormat, short firstTime);
+
+    ~ScanWatcher();
+
+    /**
+     * Waits for images to be completed, but at most the given time.  The
+     * images which continue the image series of the scan are added to it.
+     * Returns the number of added images.  Images present before the
+     * watching started are added on the first call.  Throws an IOException if
+     * reading the directory fails.
+     */
+    int waitForImages(Scan& scan, int timeoutMilliseconds);
+
+    /**
+     * Returns the names of the files which were dropped since the last call,
+     * because they precede the first time point or their image series had
+     * already been continued without them.
+     */
+    std::vector<std::string> takeDroppedFilenames();
+
+private:
+
+    // not implemented
+    ScanWatcher(const ScanWatcher&);
+    void operator=(const ScanWatcher&);
+
+    typedef std::map<short, std::string> PendingImageMap;
+    typedef std::map<ImageLocation, PendingImageMap> PendingImageSeriesMap;
+
+    void waitForFiles(std::set<std::string>& filenames, int timeoutMilliseconds);
+
+    void listFiles(std::set<std::string>& filenames);
+
+    void addFile(const std::string& filename);
+
+    int addPendingImages(Scan& scan);
+
+    std::string directory_;
+
+    ImageFilenameFormat filenameFormat_;
+
+    short firstTime_;
+
+    std::set<std::string> addedFilenames_;
+
+    PendingImageSeriesMap pendingImageSeriesMap_;
+
+    std::vector<std::string> droppedFilenames_;
+
+#ifdef __linux__
+    int inotifyDescriptor_;
+
+    bool initialFilesListed_;
+#else
+    // sizes of the files which were not complete at the last poll
+    std::map<std::string, unsigned long> fileSizes_;
+#endif
+};
+
+}
+#endif
@@ -0,0 +1,182 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef ShrinkingImageFileReader_h
+#define ShrinkingImageFileReader_h
+
+#include <assert.h>
+
+#include <string>
+#include <vector>
+
+#include <itkImageIOBase.h>
+#include <itkImageSource.h>
+
+namespace PT
+{
+
+/**
+ * The ShrinkingImageFileReader reads a two-dimensional image file and shrinks
+ * it while decoding.  It produces the same output as an itk::ImageFileReader
+ * followed by an itk::ShrinkImageFilter, i.e. every shrinkFactor-th pixel of
+ * every shrinkFactor-th row, centered in the image.  The full-resolution
+ * image is never converted to the output pixel type, which has to be scalar.
+ * Values beyond the range of the output pixel type are saturated.
+ *
+ * If the image IO can read regions of a file, only the sampled rows are
+ * read.  Otherwise the file is read in its own component type into a buffer
+ * which is kept for the next file.
+ *
+ * Instead of a file, an image which was already read and shrunk, e.g. by
+ * another reader, can be set.  It is passed on as the output.
+ */
+template <class TOutputImage>
+class ShrinkingImageFileReader : public itk::ImageSource<TOutputImage>
+{
+public:
+    typedef ShrinkingImageFileReader Self;
+    typedef itk::ImageSource<TOutputImage> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    typedef typename TOutputImage::PixelType PixelType;
+
+    itkNewMacro(Self);
+    itkTypeMacro(ShrinkingImageFileReader, itk::ImageSource);
+
+    /**
+     * Sets the file to read.  An image set by setImage() is discarded.
+     */
+    void setFileName(const std::string& fileName)
+    {
+        if (fileName != fileName_ || image_.IsNotNull())
+        {
+            fileName_ = fileName;
+            image_ = 0;
+            this->Modified();
+        }
+    }
+
+    const std::string& getFileName() const
+    {
+        return fileName_;
+    }
+
+    /**
+     * Sets an image which was already shrunk by the shrink factor.  It is
+     * passed on instead of reading a file until the next call of
+     * setFileName().
+     */
+    void setImage(TOutputImage* image)
+    {
+        assert(image != 0);
+
+        if (image != image_.GetPointer())
+        {
+            image_ = image;
+            this->Modified();
+        }
+    }
+
+    void setShrinkFactor(unsigned int shrinkFactor)
+    {
+        assert(shrinkFactor > 0);
+
+        if (shrinkFactor != shrinkFactor_)
+        {
+            shrinkFactor_ = shrinkFactor;
+            this->Modified();
+        }
+    }
+
+    unsigned int getShrinkFactor() const
+    {
+        return shrinkFactor_;
+    }
+
+protected:
+
+    ShrinkingImageFileReader() :
+        shrinkFactor_(1),
+        imageGrafted_(false)
+    {
+        offsets_[0] = 0;
+        offsets_[1] = 0;
+    }
+
+    void GenerateOutputInformation();
+
+    /** 
+     * The ShrinkingImageFileReader always produces the entire image.
+     */
+    void EnlargeOutputRequestedRegion(itk::DataObject* output);
+
+    void GenerateData();
+
+private:
+
+    // not implemented
+    ShrinkingImageFileReader(const Self&);
+    void operator=(const Self&);
+
+    /**
+     * Reads the file, whose components are of type TComponent, and writes
+     * the sampled pixels to the output.
+     */
+    template <class TComponent>
+    void readFile();
+
+    /**
+     * Converts the sampled pixels of a row of the file to the output pixel
+     * type.
+     */
+    template <class TComponent>
+    void convertRow(const TComponent* fileRow, PixelType* outputRow, long outputWidth) const;
+
+    std::string fileName_;
+
+    typename TOutputImage::Pointer image_;
+
+    unsigned int shrinkFactor_;
+
+    // whether the output shares the buffer of a set image
+    bool imageGrafted_;
+
+    itk::ImageIOBase::Pointer imageIO_;
+
+    // the size of the file and the index of its first sampled pixel
+    long fileSize_[2];
+    long offsets_[2];
+
+    // the read rows or the entire file
+    std::vector<char> fileBuffer_;
+};
+
+}
+
+// include template implementation
+#include "ShrinkingImageFileReader.txx"
+
+#endif
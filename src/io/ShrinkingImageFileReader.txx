@@ -0,0 +1,245 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#ifndef ShrinkingImageFileReader_txx
+#define ShrinkingImageFileReader_txx
+
+#include <algorithm>
+
+#include <itkConvertPixelBuffer.h>
+#include <itkDefaultConvertPixelTraits.h>
+#include <itkImageIOFactory.h>
+#include <itkImageIORegion.h>
+#include <itkNumericTraits.h>
+#include <itkProgressReporter.h>
+
+namespace PT
+{
+
+template <class TOutputImage>
+void ShrinkingImageFileReader<TOutputImage>::GenerateOutputInformation()
+{
+    TOutputImage* output = this->GetOutput();
+
+    if (image_.IsNotNull())
+    {
+        output->CopyInformation(image_);
+        return;
+    }
+
+    imageIO_ = itk::ImageIOFactory::CreateImageIO(fileName_.c_str(), itk::ImageIOFactory::ReadMode);
+    if (imageIO_.IsNull())
+    {
+        itkExceptionMacro(<< "cannot read image " << fileName_ << ": unknown file format");
+    }
+    imageIO_->SetFileName(fileName_.c_str());
+    imageIO_->ReadImageInformation();
+
+    typename TOutputImage::RegionType outputRegion;
+    typename TOutputImage::SpacingType outputSpacing;
+    typename TOutputImage::PointType outputOrigin;
+    unsigned int numberOfDimensions = imageIO_->GetNumberOfDimensions();
+    for (unsigned int i = 0; i < 2; ++i)
+    {
+        fileSize_[i] = i < numberOfDimensions ? imageIO_->GetDimensions(i) : 1;
+        double spacing = i < numberOfDimensions ? imageIO_->GetSpacing(i) : 1.0;
+        double origin = i < numberOfDimensions ? imageIO_->GetOrigin(i) : 0.0;
+
+        // like itk::ShrinkImageFilter, drop the incomplete last block and
+        // center the sampled pixels in the image
+        long size = std::max(1L, fileSize_[i] / (long)shrinkFactor_);
+        long margin = (fileSize_[i] - 1) - (size - 1) * (long)shrinkFactor_;
+        offsets_[i] = (margin + 1) / 2;
+
+        outputRegion.SetIndex(i, 0);
+        outputRegion.SetSize(i, size);
+        outputSpacing[i] = spacing * shrinkFactor_;
+        outputOrigin[i] = origin + spacing * margin / 2.0;
+    }
+
+    output->SetLargestPossibleRegion(outputRegion);
+    output->SetSpacing(outputSpacing);
+    output->SetOrigin(outputOrigin);
+}
+
+template <class TOutputImage>
+void ShrinkingImageFileReader<TOutputImage>::EnlargeOutputRequestedRegion(itk::DataObject* output)
+{
+    TOutputImage* image = dynamic_cast<TOutputImage*>(output);
+    image->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TOutputImage>
+void ShrinkingImageFileReader<TOutputImage>::GenerateData()
+{
+    if (image_.IsNotNull())
+    {
+        this->GraftOutput(image_);
+        imageGrafted_ = true;
+        return;
+    }
+
+    TOutputImage* output = this->GetOutput();
+    if (imageGrafted_)
+    {
+        // do not overwrite the buffer of the previously set image
+        output->SetPixelContainer(TOutputImage::PixelContainer::New());
+        imageGrafted_ = false;
+    }
+    output->SetBufferedRegion(output->GetRequestedRegion());
+    output->Allocate();
+
+    switch (imageIO_->GetComponentType())
+    {
+    case itk::ImageIOBase::UCHAR:
+        readFile<unsigned char>();
+        break;
+    case itk::ImageIOBase::CHAR:
+        readFile<char>();
+        break;
+    case itk::ImageIOBase::USHORT:
+        readFile<unsigned short>();
+        break;
+    case itk::ImageIOBase::SHORT:
+        readFile<short>();
+        break;
+    case itk::ImageIOBase::UINT:
+        readFile<unsigned int>();
+        break;
+    case itk::ImageIOBase::INT:
+        readFile<int>();
+        break;
+    case itk::ImageIOBase::ULONG:
+        readFile<unsigned long>();
+        break;
+    case itk::ImageIOBase::LONG:
+        readFile<long>();
+        break;
+    case itk::ImageIOBase::FLOAT:
+        readFile<float>();
+        break;
+    case itk::ImageIOBase::DOUBLE:
+        readFile<double>();
+        break;
+    default:
+        itkExceptionMacro(<< "cannot read image " << fileName_ << ": unsupported pixel type");
+    }
+}
+
+template <class TOutputImage>
+template <class TComponent>
+void ShrinkingImageFileReader<TOutputImage>::readFile()
+{
+    TOutputImage* output = this->GetOutput();
+    long outputWidth = output->GetBufferedRegion().GetSize()[0];
+    long outputHeight = output->GetBufferedRegion().GetSize()[1];
+    PixelType* outputBuffer = output->GetBufferPointer();
+
+    itk::ProgressReporter progress(this, 0, outputHeight);
+
+    unsigned int numberOfDimensions = imageIO_->GetNumberOfDimensions();
+    itk::ImageIORegion fileRegion(numberOfDimensions);
+    for (unsigned int i = 0; i < numberOfDimensions; ++i)
+    {
+        fileRegion.SetIndex(i, 0);
+        fileRegion.SetSize(i, imageIO_->GetDimensions(i));
+    }
+
+    long rowLength = fileSize_[0] * imageIO_->GetNumberOfComponents();
+
+    // reading single rows only pays off if rows are skipped
+    if (shrinkFactor_ > 1 && numberOfDimensions >= 2 && imageIO_->CanStreamRead())
+    {
+        fileBuffer_.resize(rowLength * sizeof(TComponent));
+        const TComponent* fileRow = reinterpret_cast<const TComponent*>(&fileBuffer_[0]);
+
+        // read the first plane of the file only
+        for (unsigned int i = 1; i < numberOfDimensions; ++i)
+        {
+            fileRegion.SetSize(i, 1);
+        }
+
+        imageIO_->SetUseStreamedReading(true);
+        for (long y = 0; y < outputHeight; ++y)
+        {
+            fileRegion.SetIndex(1, offsets_[1] + y * (long)shrinkFactor_);
+            imageIO_->SetIORegion(fileRegion);
+            imageIO_->Read(&fileBuffer_[0]);
+
+            convertRow(fileRow, outputBuffer + y * outputWidth, outputWidth);
+            progress.CompletedPixel();
+        }
+    }
+    else
+    {
+        fileBuffer_.resize(imageIO_->GetImageSizeInBytes());
+        imageIO_->SetIORegion(fileRegion);
+        imageIO_->Read(&fileBuffer_[0]);
+
+        const TComponent* file = reinterpret_cast<const TComponent*>(&fileBuffer_[0]);
+        for (long y = 0; y < outputHeight; ++y)
+        {
+            const TComponent* fileRow = file + (offsets_[1] + y * (long)shrinkFactor_) * rowLength;
+            convertRow(fileRow, outputBuffer + y * outputWidth, outputWidth);
+            progress.CompletedPixel();
+        }
+    }
+}
+
+template <class TOutputImage>
+template <class TComponent>
+void ShrinkingImageFileReader<TOutputImage>::convertRow(const TComponent* fileRow, PixelType* outputRow, long outputWidth) const
+{
+    typedef itk::ConvertPixelBuffer<TComponent, PixelType, itk::DefaultConvertPixelTraits<PixelType> > PixelConverter;
+
+    int numberOfComponents = imageIO_->GetNumberOfComponents();
+    long step = shrinkFactor_ * numberOfComponents;
+    const TComponent* filePixel = fileRow + offsets_[0] * numberOfComponents;
+
+    if (numberOfComponents == 1)
+    {
+        // values beyond the range of the output pixel type are saturated
+        // instead of wrapped around
+        const double minimum = itk::NumericTraits<PixelType>::NonpositiveMin();
+        const double maximum = itk::NumericTraits<PixelType>::max();
+        for (long x = 0; x < outputWidth; ++x, filePixel += step)
+        {
+            double value = static_cast<double>(*filePixel);
+            outputRow[x] = static_cast<PixelType>(std::min(std::max(value, minimum), maximum));
+        }
+    }
+    else
+    {
+        // color pixels are converted like by itk::ImageFileReader
+        for (long x = 0; x < outputWidth; ++x, filePixel += step)
+        {
+            PixelConverter::Convert(const_cast<TComponent*>(filePixel), numberOfComponents, outputRow + x, 1);
+        }
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,242 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <itkImageFileWriter.h>
+#include <itkImageRegionIterator.h>
+#include <itksys/SystemTools.hxx>
+
+#include <Analysis.h>
+#include <Analyzer.h>
+#include <Scan.h>
+#include <analyzers/AnalyzerRegistry.h>
+#include <images.h>
+#include <io/AnalysisIO.h>
+
+/**
+ * Runs the serial and the parallel analysis over more cells than the
+ * analysis images can store.  The cells are appended to a stored analysis,
+ * which already contains nearly Analysis::MAX_ENCODABLE_CELL_ID cells.  Both
+ * analyses have to fail at the first image whose cell ids exceed the range,
+ * without writing the analysis images of the following images or the
+ * analysis.
+ */
+
+static const std::string DATA_DIRECTORY("cell_id_range_test/");
+
+static const int NUMBER_OF_IMAGE_SERIES = 6;
+
+/**
+ * Collects the error messages of an analyzer.
+ */
+class ErrorCollector : public PT::EventHandler<PT::AnalyzerEvent>
+{
+public:
+
+    void handleEvent(const PT::AnalyzerEvent& event)
+    {
+        if (event.getId() == PT::AnalyzerEvent::ERROR_MESSAGE)
+        {
+            errorMessages.push_back(event.getMessage());
+        }
+    }
+
+    std::vector<std::string> errorMessages;
+};
+
+/**
+ * Writes an image with a grid of round cells to the given file.
+ */
+static void writeCellImage(const std::string& filePath)
+{
+    const long width = 256;
+    const long height = 256;
+    const long cellDistance = 32;
+    const long cellRadius = 6;
+
+    PT::ImageSize size;
+    size[0] = width;
+    size[1] = height;
+    PT::IntensityImage::Pointer image = PT::IntensityImage::New();
+    image->SetRegions(PT::ImageRegion(size));
+    image->Allocate();
+
+    itk::ImageRegionIterator<PT::IntensityImage> it(image, image->GetLargestPossibleRegion());
+    for (; !it.IsAtEnd(); ++it)
+    {
+        long x = it.GetIndex()[0] % cellDistance - cellDistance / 2;
+        long y = it.GetIndex()[1] % cellDistance - cellDistance / 2;
+        it.Set(x * x + y * y <= cellRadius * cellRadius ? 3000 : 100);
+    }
+
+    typedef itk::ImageFileWriter<PT::IntensityImage> FileWriter;
+    FileWriter::Pointer fileWriter = FileWriter::New();
+    fileWriter->SetFileName(filePath.c_str());
+    fileWriter->SetInput(image);
+    fileWriter->Update();
+}
+
+static PT::ImageKey getImageKey(int imageSeriesIndex)
+{
+    return PT::ImageKey(PT::ImageLocation(imageSeriesIndex, 0, 0), 0);
+}
+
+/**
+ * Creates a scan of image series with a single image each, which all show
+ * the same cells.
+ */
+static std::auto_ptr<PT::Scan> createScan(int numberOfImageSeries, const std::string& imageFilePath)
+{
+    std::auto_ptr<PT::Scan> scan(new PT::Scan());
+    for (int i = 0; i < numberOfImageSeries; ++i)
+    {
+        PT::ImageMetadata imageMetadata;
+        imageMetadata.key = getImageKey(i);
+        imageMetadata.filepath = imageFilePath;
+        scan->addImageMetadata(imageMetadata);
+    }
+    return scan;
+}
+
+/**
+ * Analyzes the scan, continuing the analysis stored in the analysis
+ * directory, and returns the error messages.
+ */
+static std::vector<std::string> analyze(
+        const PT::Assay& assay, 
+        const PT::Scan& scan, 
+        const std::string& analysisDirectory, 
+        int numberOfThreads)
+{
+    ErrorCollector errorCollector;
+    std::auto_ptr<PT::Analyzer> analyzer = 
+        PT::AnalyzerRegistry::createAnalyzer(assay, &scan, analysisDirectory);
+    analyzer->setEventHandler(&errorCollector);
+    analyzer->setNumberOfThreads(numberOfThreads);
+    analyzer->setIncrementalEnabled(true);
+    analyzer->process();
+    return errorCollector.errorMessages;
+}
+
+static std::string createAnalysisDirectory(const std::string& name)
+{
+    std::string analysisDirectory = DATA_DIRECTORY + name + "/";
+    itksys::SystemTools::RemoveADirectory(analysisDirectory.c_str());
+    itksys::SystemTools::MakeDirectory(analysisDirectory.c_str());
+    return analysisDirectory;
+}
+
+/**
+ * Returns true if the analysis with the given number of threads fails as
+ * required.
+ */
+static bool testCellIdRange(
+        const PT::Assay& assay, 
+        const PT::Scan& scan, 
+        const PT::AnalysisMetadata& metadata, 
+        int numberOfCellsPerImage, 
+        int numberOfThreads)
+{
+    std::string analysisDirectory = createAnalysisDirectory(numberOfThreads == 1 ? "serial" : "parallel");
+    PT::AnalysisMetadata storedMetadata(metadata.featureNames, metadata.subregionNames, analysisDirectory);
+
+    // the cells of the first image still fit, the ones of the second do not
+    int numberOfStoredCells = PT::Analysis::MAX_ENCODABLE_CELL_ID - numberOfCellsPerImage - numberOfCellsPerImage / 2;
+    {
+        PT::Analysis storedAnalysis(storedMetadata);
+        for (int id = 1; id <= numberOfStoredCells; ++id)
+        {
+            PT::ImageLocation location(NUMBER_OF_IMAGE_SERIES, 0, 0);
+            storedAnalysis.addCell(std::auto_ptr<PT::Cell>(new PT::Cell(id, location)));
+        }
+        PT::saveAnalysis(storedAnalysis);
+    }
+
+    std::vector<std::string> errorMessages = analyze(assay, scan, analysisDirectory, numberOfThreads);
+
+    bool passed = true;
+    if (errorMessages.size() != 1 || errorMessages[0].find("exceeds the range") == std::string::npos)
+    {
+        std::cerr << numberOfThreads << " threads: the analysis did not fail because of the cell ids" << std::endl;
+        passed = false;
+    }
+
+    for (int i = 1; i < NUMBER_OF_IMAGE_SERIES; ++i)
+    {
+        if (itksys::SystemTools::FileExists(storedMetadata.getFilePath(getImageKey(i)).c_str()))
+        {
+            std::cerr << numberOfThreads << " threads: the analysis image of image series " << i 
+                << " was written" << std::endl;
+            passed = false;
+        }
+    }
+
+    std::auto_ptr<PT::Analysis> analysis = PT::loadAnalysis((analysisDirectory + "analysis.xml").c_str());
+    if (analysis->getNumberOfCells() != numberOfStoredCells)
+    {
+        std::cerr << numberOfThreads << " threads: the analysis was saved" << std::endl;
+        passed = false;
+    }
+
+    return passed;
+}
+
+int main(int argc, char** argv)
+{
+    itksys::SystemTools::MakeDirectory(DATA_DIRECTORY.c_str());
+    std::string imageFilePath = DATA_DIRECTORY + "cells.tif";
+    writeCellImage(imageFilePath);
+
+    std::auto_ptr<PT::Assay> assay = 
+        PT::AnalyzerRegistry::createAssay(PT::AnalyzerRegistry::getDefaultAnalyzerName());
+
+    // determine the number of cells found in an image
+    std::string measuringDirectory = createAnalysisDirectory("measuring");
+    std::auto_ptr<PT::Scan> measuringScan = createScan(1, imageFilePath);
+    if (!analyze(*assay, *measuringScan, measuringDirectory, 1).empty())
+    {
+        std::cerr << "the test image cannot be analyzed" << std::endl;
+        return 1;
+    }
+    std::auto_ptr<PT::Analysis> measuringAnalysis = 
+        PT::loadAnalysis((measuringDirectory + "analysis.xml").c_str());
+    int numberOfCellsPerImage = measuringAnalysis->getNumberOfCells();
+    if (numberOfCellsPerImage < 2)
+    {
+        std::cerr << "the test image yields " << numberOfCellsPerImage << " cells" << std::endl;
+        return 1;
+    }
+
+    std::auto_ptr<PT::Scan> scan = createScan(NUMBER_OF_IMAGE_SERIES, imageFilePath);
+    const PT::AnalysisMetadata& metadata = measuringAnalysis->getMetadata();
+    bool serialPassed = testCellIdRange(*assay, *scan, metadata, numberOfCellsPerImage, 1);
+    bool parallelPassed = testCellIdRange(*assay, *scan, metadata, numberOfCellsPerImage, 4);
+
+    return serialPassed && parallelPassed ? 0 : 1;
+}
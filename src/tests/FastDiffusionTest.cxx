@@ -0,0 +1,210 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <itkGradientAnisotropicDiffusionImageFilter.h>
+#include <itkImageFileReader.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+
+#include <filters/FastGradientAnisotropicDiffusionImageFilter.h>
+#include <images.h>
+
+/**
+ * Compares the FastGradientAnisotropicDiffusionImageFilter with
+ * itk::GradientAnisotropicDiffusionImageFilter over the range of the assay
+ * parameters.  The image is read from the file given as argument, e.g. an
+ * image of a scan.  Without an argument an image of cells with shot noise is
+ * generated.  Fails if the results differ by 1e-6 of the intensity range or
+ * more.
+ */
+
+static const double MAX_RELATIVE_ERROR = 1e-6;
+
+static const double TIME_STEP = 0.125;
+
+static const int NUMBERS_OF_ITERATIONS[] = { 1, 5, 10 };
+
+static const double CONDUCTANCES[] = { 0.1, 0.5, 1.0, 2.0, 5.0, 10.0 };
+
+typedef itk::GradientAnisotropicDiffusionImageFilter<PT::IntensityImage, PT::FloatImage> ReferenceFilter;
+
+typedef PT::FastGradientAnisotropicDiffusionImageFilter<PT::IntensityImage, PT::FloatImage> FastFilter;
+
+/**
+ * Returns an approximately normally distributed random number with a mean of
+ * 0 and a standard deviation of 1.
+ */
+static double randomNormal()
+{
+    double sum = 0;
+    for (int i = 0; i < 12; ++i)
+    {
+        sum += rand() / (RAND_MAX + 1.0);
+    }
+    return sum - 6.0;
+}
+
+/**
+ * Creates a 12-bit image of round cells of different sizes and brightness on
+ * a dark background, like the images of a scan.
+ */
+static PT::IntensityImage::Pointer createCellImage()
+{
+    const long width = 512;
+    const long height = 512;
+
+    PT::ImageSize size;
+    size[0] = width;
+    size[1] = height;
+    PT::IntensityImage::Pointer image = PT::IntensityImage::New();
+    image->SetRegions(PT::ImageRegion(size));
+    image->Allocate();
+
+    srand(7);
+    std::vector<double> intensities(width * height, 180.0);
+    for (int c = 0; c < 120; ++c)
+    {
+        double centerX = rand() % width;
+        double centerY = rand() % height;
+        double radius = 6 + rand() % 20;
+        double brightness = 400 + rand() % 3200;
+        for (long y = 0; y < height; ++y)
+        {
+            for (long x = 0; x < width; ++x)
+            {
+                double distance = sqrt((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY));
+                intensities[y * width + x] += brightness / (1 + exp((distance - radius) * 1.5));
+            }
+        }
+    }
+
+    itk::ImageRegionIterator<PT::IntensityImage> it(image, image->GetLargestPossibleRegion());
+    for (unsigned long i = 0; !it.IsAtEnd(); ++it, ++i)
+    {
+        double intensity = intensities[i] + randomNormal() * sqrt(intensities[i]);
+        it.Set(static_cast<unsigned short>(std::min(4095.0, std::max(0.0, floor(intensity)))));
+    }
+
+    return image;
+}
+
+static double computeIntensityRange(PT::IntensityImage* image)
+{
+    itk::ImageRegionConstIterator<PT::IntensityImage> it(image, image->GetLargestPossibleRegion());
+    unsigned short min = it.Get();
+    unsigned short max = it.Get();
+    for (; !it.IsAtEnd(); ++it)
+    {
+        min = std::min(min, it.Get());
+        max = std::max(max, it.Get());
+    }
+    return std::max(max - min, 1);
+}
+
+static double computeMaxDifference(PT::FloatImage* image1, PT::FloatImage* image2)
+{
+    itk::ImageRegionConstIterator<PT::FloatImage> it1(image1, image1->GetLargestPossibleRegion());
+    itk::ImageRegionConstIterator<PT::FloatImage> it2(image2, image2->GetLargestPossibleRegion());
+    double maxDifference = 0;
+    for (; !it1.IsAtEnd(); ++it1, ++it2)
+    {
+        maxDifference = std::max(maxDifference, fabs(static_cast<double>(it1.Get()) - it2.Get()));
+    }
+    return maxDifference;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " [<image file>]" << std::endl;
+        return 2;
+    }
+
+    PT::IntensityImage::Pointer image;
+    if (argc == 2)
+    {
+        typedef itk::ImageFileReader<PT::IntensityImage> Reader;
+        Reader::Pointer reader = Reader::New();
+        reader->SetFileName(argv[1]);
+        try
+        {
+            reader->Update();
+        }
+        catch (itk::ExceptionObject& ex)
+        {
+            std::cerr << ex << std::endl;
+            return 2;
+        }
+        image = reader->GetOutput();
+    }
+    else
+    {
+        image = createCellImage();
+    }
+
+    double intensityRange = computeIntensityRange(image);
+
+    bool failed = false;
+    for (unsigned int i = 0; i < sizeof(NUMBERS_OF_ITERATIONS) / sizeof(NUMBERS_OF_ITERATIONS[0]); ++i)
+    {
+        for (unsigned int c = 0; c < sizeof(CONDUCTANCES) / sizeof(CONDUCTANCES[0]); ++c)
+        {
+            ReferenceFilter::Pointer referenceFilter = ReferenceFilter::New();
+            referenceFilter->SetInput(image);
+            referenceFilter->SetNumberOfIterations(NUMBERS_OF_ITERATIONS[i]);
+            referenceFilter->SetTimeStep(TIME_STEP);
+            referenceFilter->SetConductanceParameter(CONDUCTANCES[c]);
+            referenceFilter->Update();
+
+            // several threads, so that the borders of the stripes are tested
+            FastFilter::Pointer fastFilter = FastFilter::New();
+            fastFilter->SetInput(image);
+            fastFilter->SetNumberOfIterations(NUMBERS_OF_ITERATIONS[i]);
+            fastFilter->SetTimeStep(TIME_STEP);
+            fastFilter->SetConductanceParameter(CONDUCTANCES[c]);
+            fastFilter->SetNumberOfThreads(4);
+            fastFilter->Update();
+
+            double relativeError = computeMaxDifference(referenceFilter->GetOutput(), fastFilter->GetOutput()) / intensityRange;
+            std::cout << "iterations " << NUMBERS_OF_ITERATIONS[i] 
+                << ", conductance " << CONDUCTANCES[c] 
+                << ": relative error " << relativeError << std::endl;
+            if (!(relativeError < MAX_RELATIVE_ERROR))
+            {
+                failed = true;
+            }
+        }
+    }
+
+    return failed ? 1 : 0;
+}
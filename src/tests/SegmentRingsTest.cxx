@@ -0,0 +1,178 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+
+#include <filters/SegmentRingsImageFilter.h>
+#include <filters/SegmentSelectionAndMergingImageFilter.h>
+#include <images.h>
+
+/**
+ * Compares the rings determined by the distance transform with the ones
+ * determined by the neighborhoods on random label images.  The images contain
+ * noise or discs, which also cross the image borders, and the ring widths
+ * range from 0 to 50.  Fails if a single label differs.
+ */
+
+static const int NUMBER_OF_IMAGES = 1000;
+
+static const int MAX_IMAGE_SIZE = 48;
+
+static const int MAX_RING_WIDTH = 50;
+
+typedef PT::SegmentSelectionAndMergingImageFilter<PT::ULongImage> SegmentSelectionAndMergingFilter;
+
+typedef PT::SegmentRingsImageFilter<PT::ULongImage, SegmentSelectionAndMergingFilter::LabelToSegmentKeyFunctor> SegmentRingsFilter;
+
+static int randomInteger(int n)
+{
+    return rand() % n;
+}
+
+/**
+ * Creates a label image of noise or of overlapping discs.  Zero is the label
+ * of the background.
+ */
+static PT::ULongImage::Pointer createLabelImage()
+{
+    long width = 1 + randomInteger(MAX_IMAGE_SIZE);
+    long height = 1 + randomInteger(MAX_IMAGE_SIZE);
+    int numberOfLabels = 1 + randomInteger(6);
+
+    std::vector<unsigned long> labels(width * height, 0);
+    if (randomInteger(3) == 0)
+    {
+        for (unsigned int i = 0; i < labels.size(); ++i)
+        {
+            labels[i] = randomInteger(numberOfLabels);
+        }
+    }
+    else
+    {
+        int numberOfDiscs = 1 + randomInteger(8);
+        for (int d = 0; d < numberOfDiscs; ++d)
+        {
+            long centerX = randomInteger(width);
+            long centerY = randomInteger(height);
+            long radius = 1 + randomInteger(2 * MAX_IMAGE_SIZE / 3);
+            unsigned long label = randomInteger(numberOfLabels);
+            for (long y = 0; y < height; ++y)
+            {
+                for (long x = 0; x < width; ++x)
+                {
+                    if ((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY) <= radius * radius)
+                    {
+                        labels[y * width + x] = label;
+                    }
+                }
+            }
+        }
+    }
+
+    PT::ImageSize size;
+    size[0] = width;
+    size[1] = height;
+    PT::ULongImage::Pointer image = PT::ULongImage::New();
+    image->SetRegions(PT::ImageRegion(size));
+    image->Allocate();
+    std::copy(labels.begin(), labels.end(), image->GetBufferPointer());
+
+    return image;
+}
+
+/**
+ * Returns random ring widths, most of them small, so that the neighborhoods
+ * stay affordable, but some zero and some up to MAX_RING_WIDTH.
+ */
+static std::vector<int> createRingWidths()
+{
+    std::vector<int> ringWidths(1 + randomInteger(3));
+    for (unsigned int i = 0; i < ringWidths.size(); ++i)
+    {
+        int kind = randomInteger(8);
+        if (kind == 0)
+        {
+            ringWidths[i] = 0;
+        }
+        else if (kind == 1)
+        {
+            ringWidths[i] = 1 + randomInteger(MAX_RING_WIDTH);
+        }
+        else
+        {
+            ringWidths[i] = 1 + randomInteger(6);
+        }
+    }
+    return ringWidths;
+}
+
+static PT::ULongImage::Pointer generateRings(
+        PT::ULongImage* labelImage, 
+        const std::vector<int>& ringWidths, 
+        bool distanceTransformEnabled)
+{
+    // several threads, so that the borders of the split regions are tested
+    SegmentRingsFilter::Pointer segmentRingsFilter = SegmentRingsFilter::New();
+    segmentRingsFilter->SetInput(labelImage);
+    segmentRingsFilter->setRingWidths(ringWidths);
+    segmentRingsFilter->setDistanceTransformEnabled(distanceTransformEnabled);
+    segmentRingsFilter->SetNumberOfThreads(3);
+    segmentRingsFilter->Update();
+    return segmentRingsFilter->GetOutput();
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+    for (int i = 0; i < NUMBER_OF_IMAGES; ++i)
+    {
+        PT::ULongImage::Pointer labelImage = createLabelImage();
+        std::vector<int> ringWidths = createRingWidths();
+
+        PT::ULongImage::Pointer expectedRings = generateRings(labelImage, ringWidths, false);
+        PT::ULongImage::Pointer rings = generateRings(labelImage, ringWidths, true);
+
+        itk::ImageRegionConstIterator<PT::ULongImage> expectedIt(expectedRings, expectedRings->GetLargestPossibleRegion());
+        itk::ImageRegionConstIterator<PT::ULongImage> it(rings, rings->GetLargestPossibleRegion());
+        for (; !it.IsAtEnd(); ++it, ++expectedIt)
+        {
+            if (it.Get() != expectedIt.Get())
+            {
+                std::cerr << "image " << i << ", pixel " << it.GetIndex() 
+                    << ": label " << it.Get() << " instead of " << expectedIt.Get() << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,422 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <itk_hash_map.h>
+
+#include <filters/SegmentSelectionAndMergingImageFilter.h>
+#include <images.h>
+
+/**
+ * Compares the SegmentSelectionAndMergingImageFilter with its original
+ * implementation on random label images like the ones of the watershed
+ * filter, with and without minimum and maximum segment sizes.  Fails if the
+ * label images, the numbers of segments or the segment sizes differ.
+ *
+ * The original implementation numbered the merged segments in the iteration
+ * order of an itk::hash_map, which is the order of the labels unless the
+ * number of buckets does not exceed the largest label.  Images for which the
+ * hash map iterated in a different order are skipped, because the numbering
+ * followed the buckets of the STL implementation then.
+ */
+
+static const int NUMBER_OF_IMAGES = 500;
+
+typedef PT::SegmentSelectionAndMergingImageFilter<PT::ULongImage> SegmentSelectionAndMergingFilter;
+
+/**
+ * The result of the original implementation.
+ */
+struct OriginalResult
+{
+    std::map<unsigned long, unsigned long> labelMap;
+
+    unsigned long numberOfSegments;
+
+    std::vector<unsigned long> segmentSizesInPixels;
+
+    // whether the hash map iterated over the labels in ascending order
+    bool labelOrdered;
+};
+
+typedef std::set<unsigned long> LabelSet;
+
+struct OriginalSegment
+{
+    LabelSet neighbors;
+
+    LabelSet mergedLabels;
+
+    unsigned long sizeInPixels;
+
+    OriginalSegment() : sizeInPixels(0) { }
+};
+
+/**
+ * Selects and merges the segments like the original GenerateData() of the
+ * filter.  Only the walking of the image is simplified, the 4-neighbors of a
+ * pixel outside of the image never belonged to another segment.
+ */
+static OriginalResult selectAndMergeOriginally(
+        const PT::ULongImage* image, 
+        unsigned long minimumSegmentSize, 
+        unsigned long maximumSegmentSize)
+{
+    typedef itk::hash_map<unsigned long, OriginalSegment> SegmentMap;
+    typedef SegmentMap::iterator SegmentMapIterator;
+
+    long width = image->GetLargestPossibleRegion().GetSize()[0];
+    long height = image->GetLargestPossibleRegion().GetSize()[1];
+    const unsigned long* labels = image->GetBufferPointer();
+
+    SegmentMap segmentMap;
+    for (long y = 0; y < height; ++y)
+    {
+        for (long x = 0; x < width; ++x)
+        {
+            unsigned long label = labels[y * width + x];
+            OriginalSegment& segment = segmentMap[label];
+            segment.sizeInPixels++;
+
+            const long offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+            for (int n = 0; n < 4; ++n)
+            {
+                long neighborX = x + offsets[n][0];
+                long neighborY = y + offsets[n][1];
+                if (neighborX < 0 || neighborX >= width || neighborY < 0 || neighborY >= height)
+                    continue;
+
+                unsigned long neighborLabel = labels[neighborY * width + neighborX];
+                if (neighborLabel != label)
+                    segment.neighbors.insert(neighborLabel);
+            }
+        }
+    }
+
+    OriginalResult result;
+    result.labelOrdered = true;
+    {
+        SegmentMapIterator segmentIt = segmentMap.begin();
+        unsigned long previousLabel = (*segmentIt).first;
+        for (++segmentIt; segmentIt != segmentMap.end(); ++segmentIt)
+        {
+            if ((*segmentIt).first < previousLabel)
+            {
+                result.labelOrdered = false;
+            }
+            previousLabel = (*segmentIt).first;
+        }
+    }
+
+    std::map<unsigned long, unsigned long>& labelMap = result.labelMap;
+    std::vector<unsigned long>& segmentSizesInPixels = result.segmentSizesInPixels;
+    unsigned long& numberOfSegments = result.numberOfSegments;
+
+    segmentSizesInPixels.resize(segmentMap.size() + 1);
+    segmentSizesInPixels[0] = 0;
+    numberOfSegments = 0;
+
+    // remove segments that are too big
+    if (maximumSegmentSize > 0)
+    {
+        SegmentMapIterator segmentIt = segmentMap.begin();
+        SegmentMapIterator segmentEnd = segmentMap.end();
+        while (segmentIt != segmentEnd)
+        {
+            unsigned long label = (*segmentIt).first;
+            OriginalSegment& segment = (*segmentIt).second;
+            ++segmentIt;
+
+            if (segment.sizeInPixels > maximumSegmentSize)
+            {
+                LabelSet::iterator neighborLabelIt = segment.neighbors.begin();
+                for (; neighborLabelIt != segment.neighbors.end(); ++neighborLabelIt)
+                {
+                    (*segmentMap.find(*neighborLabelIt)).second.neighbors.erase(label);
+                }
+
+                labelMap.insert(std::make_pair(label, 0UL));
+                segmentSizesInPixels[0] += segment.sizeInPixels;
+                segmentMap.erase(label);
+            }
+        }
+    }
+
+    // merge segments with their neighbors
+    {
+        SegmentMapIterator segmentIt = segmentMap.begin();
+        SegmentMapIterator segmentEnd = segmentMap.end();
+        while (segmentIt != segmentEnd)
+        {
+            unsigned long label = (*segmentIt).first;
+            OriginalSegment& segment = (*segmentIt).second;
+            ++segmentIt;
+
+            bool merged = false;
+            unsigned long mergeLabel = 0;
+
+            LabelSet::iterator neighborLabelIt = segment.neighbors.begin();
+            LabelSet::iterator neighborLabelEnd = segment.neighbors.end();
+            while (neighborLabelIt != neighborLabelEnd)
+            {
+                unsigned long neighborLabel = *neighborLabelIt;
+                ++neighborLabelIt;
+
+                OriginalSegment& neighborSegment = (*segmentMap.find(neighborLabel)).second;
+                if (!merged)
+                {
+                    neighborSegment.neighbors.erase(label);
+                    neighborSegment.mergedLabels.insert(label);
+                    neighborSegment.mergedLabels.insert(segment.mergedLabels.begin(), segment.mergedLabels.end());
+                    neighborSegment.sizeInPixels += segment.sizeInPixels;
+
+                    segment.neighbors.erase(neighborLabel);
+                    neighborSegment.neighbors.insert(segment.neighbors.begin(), segment.neighbors.end());
+
+                    mergeLabel = neighborLabel;
+                    merged = true;
+                }
+                else
+                {
+                    neighborSegment.neighbors.erase(label);
+                    neighborSegment.neighbors.insert(mergeLabel);
+                }
+            }
+
+            if (merged)
+                segmentMap.erase(label);
+        }
+    }
+
+    // sort out segments which are too small or too big, number the others
+    {
+        SegmentMapIterator segmentIt = segmentMap.begin();
+        SegmentMapIterator segmentEnd = segmentMap.end();
+        while (segmentIt != segmentEnd)
+        {
+            unsigned long label = (*segmentIt).first;
+            OriginalSegment& segment = (*segmentIt).second;
+            ++segmentIt;
+
+            unsigned long newLabel;
+            if ( (minimumSegmentSize > 0 && segment.sizeInPixels < minimumSegmentSize)
+                 || (maximumSegmentSize > 0 && segment.sizeInPixels > maximumSegmentSize) )
+            {
+                newLabel = 0;
+                segmentSizesInPixels[0] += segment.sizeInPixels;
+            }
+            else
+            {
+                ++numberOfSegments;
+                newLabel = numberOfSegments;
+                segmentSizesInPixels[newLabel] = segment.sizeInPixels;
+            }
+
+            LabelSet::iterator mergedLabelIt = segment.mergedLabels.begin();
+            for (; mergedLabelIt != segment.mergedLabels.end(); ++mergedLabelIt)
+            {
+                labelMap.insert(std::make_pair(*mergedLabelIt, newLabel));
+            }
+            labelMap.insert(std::make_pair(label, newLabel));
+            segmentMap.erase(label);
+        }
+    }
+
+    segmentSizesInPixels.resize(labelMap.size());
+
+    return result;
+}
+
+static int randomInteger(int n)
+{
+    return rand() % n;
+}
+
+/**
+ * Creates a label image like the ones of the watershed filter.  The image is
+ * divided into the weighted Voronoi regions of random seeds, which are
+ * labeled densely starting with 1 in random order.
+ */
+static PT::ULongImage::Pointer createLabelImage()
+{
+    long width = 32 + randomInteger(96);
+    long height = 32 + randomInteger(96);
+    int numberOfSeeds = 2 + randomInteger(400);
+
+    std::vector<long> seedX(numberOfSeeds);
+    std::vector<long> seedY(numberOfSeeds);
+    std::vector<long> seedWeights(numberOfSeeds);
+    std::vector<unsigned long> seedLabels(numberOfSeeds);
+    for (int s = 0; s < numberOfSeeds; ++s)
+    {
+        seedX[s] = randomInteger(width);
+        seedY[s] = randomInteger(height);
+        seedWeights[s] = 1 + randomInteger(4);
+        seedLabels[s] = s + 1;
+    }
+    std::random_shuffle(seedLabels.begin(), seedLabels.end(), randomInteger);
+
+    PT::ImageSize size;
+    size[0] = width;
+    size[1] = height;
+    PT::ULongImage::Pointer image = PT::ULongImage::New();
+    image->SetRegions(PT::ImageRegion(size));
+    image->Allocate();
+
+    unsigned long* pixel = image->GetBufferPointer();
+    for (long y = 0; y < height; ++y)
+    {
+        for (long x = 0; x < width; ++x, ++pixel)
+        {
+            int nearestSeed = 0;
+            long minDistance = -1;
+            for (int s = 0; s < numberOfSeeds; ++s)
+            {
+                long distance = ((x - seedX[s]) * (x - seedX[s]) + (y - seedY[s]) * (y - seedY[s])) * seedWeights[s];
+                if (minDistance < 0 || distance < minDistance)
+                {
+                    nearestSeed = s;
+                    minDistance = distance;
+                }
+            }
+            *pixel = seedLabels[nearestSeed];
+        }
+    }
+
+    return image;
+}
+
+/**
+ * Returns a segment size between the smallest and the largest segment of
+ * the image.
+ */
+static unsigned long createSegmentSize(const PT::ULongImage* image)
+{
+    std::map<unsigned long, unsigned long> sizes;
+    const unsigned long* pixel = image->GetBufferPointer();
+    const unsigned long* end = pixel + image->GetLargestPossibleRegion().GetNumberOfPixels();
+    for (; pixel != end; ++pixel)
+    {
+        ++sizes[*pixel];
+    }
+
+    std::map<unsigned long, unsigned long>::const_iterator it = sizes.begin();
+    std::advance(it, randomInteger(sizes.size()));
+    return (*it).second;
+}
+
+/**
+ * Returns true if the filter yields the result of the original
+ * implementation.
+ */
+static bool compareWithOriginal(
+        PT::ULongImage* image, 
+        unsigned long minimumSegmentSize, 
+        unsigned long maximumSegmentSize, 
+        const OriginalResult& original)
+{
+    SegmentSelectionAndMergingFilter::Pointer filter = SegmentSelectionAndMergingFilter::New();
+    filter->SetInput(image);
+    filter->setMinimumSegmentSize(minimumSegmentSize);
+    filter->setMaximumSegmentSize(maximumSegmentSize);
+    filter->SetNumberOfThreads(3);
+    filter->Update();
+
+    if (filter->getNumberOfSegments() != original.numberOfSegments)
+    {
+        std::cerr << filter->getNumberOfSegments() << " segments instead of " 
+            << original.numberOfSegments << std::endl;
+        return false;
+    }
+
+    if (filter->getSegmentSizesInPixels() != original.segmentSizesInPixels)
+    {
+        std::cerr << "the segment sizes differ" << std::endl;
+        return false;
+    }
+
+    const unsigned long* input = image->GetBufferPointer();
+    const unsigned long* output = filter->GetOutput()->GetBufferPointer();
+    unsigned long numberOfPixels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+    for (unsigned long i = 0; i < numberOfPixels; ++i)
+    {
+        unsigned long expectedLabel = (*original.labelMap.find(input[i])).second;
+        if (output[i] != expectedLabel)
+        {
+            std::cerr << "pixel " << i << ": label " << output[i] 
+                << " instead of " << expectedLabel << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+    int numberOfComparedImages = 0;
+    for (int i = 0; i < NUMBER_OF_IMAGES; ++i)
+    {
+        PT::ULongImage::Pointer image = createLabelImage();
+
+        unsigned long minimumSizes[2] = { 0, createSegmentSize(image) };
+        unsigned long maximumSizes[2] = { 0, createSegmentSize(image) };
+        for (int s = 0; s < 4; ++s)
+        {
+            unsigned long minimumSegmentSize = minimumSizes[s % 2];
+            unsigned long maximumSegmentSize = maximumSizes[s / 2];
+
+            OriginalResult original = selectAndMergeOriginally(image, minimumSegmentSize, maximumSegmentSize);
+            if (!original.labelOrdered)
+                continue;
+
+            if (!compareWithOriginal(image, minimumSegmentSize, maximumSegmentSize, original))
+            {
+                std::cerr << "image " << i << ", minimum size " << minimumSegmentSize 
+                    << ", maximum size " << maximumSegmentSize << std::endl;
+                return 1;
+            }
+            ++numberOfComparedImages;
+        }
+    }
+
+    // the hash map iterates in label order for nearly all images
+    if (numberOfComparedImages < 4 * NUMBER_OF_IMAGES * 9 / 10)
+    {
+        std::cerr << "only " << numberOfComparedImages << " results were compared" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
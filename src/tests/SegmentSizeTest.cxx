@@ -0,0 +1,178 @@
+/*==============================================================================
+Copyright (c) 2009, André Homeyer
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+==============================================================================*/ 
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <filters/SegmentSizeImageFilter.h>
+#include <images.h>
+
+/**
+ * Compares the dense path of the SegmentSizeImageFilter with the sparse one
+ * on random label images.  The labels of every image are spread out for the
+ * sparse path, keeping their order, so that both paths have to rank the
+ * segments equally.  Most images contain segments of equal size, whose order
+ * depends on their labels.  Fails if the segment sizes or a single label
+ * differ.
+ */
+
+static const int NUMBER_OF_IMAGES = 1000;
+
+static const int MAX_IMAGE_SIZE = 64;
+
+typedef PT::SegmentSizeImageFilter<PT::ULongImage> SegmentSizeFilter;
+
+static int randomInteger(int n)
+{
+    return rand() % n;
+}
+
+/**
+ * Creates a label image of noise or of rectangles.  Zero is the label of the
+ * background.
+ */
+static PT::ULongImage::Pointer createLabelImage()
+{
+    long width = 1 + randomInteger(MAX_IMAGE_SIZE);
+    long height = 1 + randomInteger(MAX_IMAGE_SIZE);
+    int numberOfLabels = 1 + randomInteger(300);
+
+    std::vector<unsigned long> labels(width * height, 0);
+    if (randomInteger(2) == 0)
+    {
+        for (unsigned int i = 0; i < labels.size(); ++i)
+        {
+            labels[i] = randomInteger(numberOfLabels);
+        }
+    }
+    else
+    {
+        for (int r = 0; r < numberOfLabels; ++r)
+        {
+            long beginX = randomInteger(width);
+            long beginY = randomInteger(height);
+            long endX = std::min(width, beginX + 1 + randomInteger(16));
+            long endY = std::min(height, beginY + 1 + randomInteger(16));
+            for (long y = beginY; y < endY; ++y)
+            {
+                for (long x = beginX; x < endX; ++x)
+                {
+                    labels[y * width + x] = r;
+                }
+            }
+        }
+    }
+
+    PT::ImageSize size;
+    size[0] = width;
+    size[1] = height;
+    PT::ULongImage::Pointer image = PT::ULongImage::New();
+    image->SetRegions(PT::ImageRegion(size));
+    image->Allocate();
+    std::copy(labels.begin(), labels.end(), image->GetBufferPointer());
+
+    return image;
+}
+
+/**
+ * Returns a copy of the image whose labels span a larger range than the
+ * image, so that the filter takes the sparse path.
+ */
+static PT::ULongImage::Pointer spreadLabels(const PT::ULongImage* image)
+{
+    unsigned long numberOfPixels = image->GetBufferedRegion().GetNumberOfPixels();
+
+    PT::ULongImage::Pointer spreadImage = PT::ULongImage::New();
+    spreadImage->SetRegions(image->GetBufferedRegion());
+    spreadImage->Allocate();
+
+    const unsigned long* label = image->GetBufferPointer();
+    unsigned long* spreadLabel = spreadImage->GetBufferPointer();
+    for (unsigned long i = 0; i < numberOfPixels; ++i)
+    {
+        spreadLabel[i] = label[i] * (numberOfPixels + 1);
+    }
+
+    return spreadImage;
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+    for (int i = 0; i < NUMBER_OF_IMAGES; ++i)
+    {
+        PT::ULongImage::Pointer labelImage = createLabelImage();
+        PT::ULongImage::Pointer spreadLabelImage = spreadLabels(labelImage);
+        unsigned long numberOfPixels = labelImage->GetBufferedRegion().GetNumberOfPixels();
+
+        // several threads, so that the stripes of the dense path are tested
+        SegmentSizeFilter::Pointer denseFilter = SegmentSizeFilter::New();
+        denseFilter->SetInput(labelImage);
+        denseFilter->SetNumberOfThreads(3);
+
+        SegmentSizeFilter::Pointer sparseFilter = SegmentSizeFilter::New();
+        sparseFilter->SetInput(spreadLabelImage);
+
+        // sort out segments in every second image
+        if (randomInteger(2) == 0)
+        {
+            unsigned long minimumSegmentSize = randomInteger(8);
+            unsigned long maximumSegmentSize = randomInteger(numberOfPixels + 1);
+            unsigned long maxNumberOfSegments = 1 + randomInteger(100);
+            denseFilter->setMinimumSegmentSize(minimumSegmentSize);
+            denseFilter->setMaximumSegmentSize(maximumSegmentSize);
+            denseFilter->setMaxNumberOfSegments(maxNumberOfSegments);
+            sparseFilter->setMinimumSegmentSize(minimumSegmentSize);
+            sparseFilter->setMaximumSegmentSize(maximumSegmentSize);
+            sparseFilter->setMaxNumberOfSegments(maxNumberOfSegments);
+        }
+
+        denseFilter->Update();
+        sparseFilter->Update();
+
+        if (denseFilter->getSegmentSizesInPixels() != sparseFilter->getSegmentSizesInPixels())
+        {
+            std::cerr << "image " << i << ": the segment sizes differ" << std::endl;
+            return 1;
+        }
+
+        const unsigned long* denseLabel = denseFilter->GetOutput()->GetBufferPointer();
+        const unsigned long* sparseLabel = sparseFilter->GetOutput()->GetBufferPointer();
+        for (unsigned long p = 0; p < numberOfPixels; ++p)
+        {
+            if (denseLabel[p] != sparseLabel[p])
+            {
+                std::cerr << "image " << i << ", pixel " << p 
+                    << ": label " << denseLabel[p] << " instead of " << sparseLabel[p] << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}